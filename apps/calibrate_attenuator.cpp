@@ -9,29 +9,52 @@
 #include <Attenuator.hh>
 #include <PowerMeter.hh>
 #include <Laser.hh>
+#include <EnergyAcquisition.hh>
 
 #include <chrono>
 #include <thread>
 #include <cmath>
+#include <stdexcept>
 
 using device::PowerMeter;
 using device::Laser;
 using device::Attenuator;
+using device::EnergyAcquisition;
+using device::EnergySample;
+
+// the laser fires at 10 Hz: give each sample twice its period, plus some slack to start
+static const uint32_t sample_timeout_ms = 200;
+static const uint32_t sampling_slack_ms = 2000;
 
 void sample_laser(PowerMeter &m, const uint32_t num_samples, std::vector<double> &samples)
 {
-
-  for (size_t i = 0 ; i < num_samples; i++)
+  // the acquisition only publishes new readings (EF), so there is no need
+  // to pace the queries to the laser rate
+  EnergyAcquisition<PowerMeter> acq(m);
+  EnergyAcquisition<PowerMeter>::Ring::Reader reader(acq.ring());
+  // a laser that stopped (or a meter that does not see it) must not hang the calibration
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(sampling_slack_ms + static_cast<uint64_t>(num_samples) * sample_timeout_ms);
+  acq.start();
+  EnergySample s;
+  while (samples.size() < num_samples)
   {
-    // just keep taking samples until you can move on
-    // no point in taking samples more often than 100 ms
-    double tmp;
-    if (m.read_energy(tmp))
+    if (reader.pop(s))
+    {
+      samples.push_back(s.energy);
+    }
+    else if (std::chrono::steady_clock::now() > deadline)
+    {
+      acq.stop();
+      throw std::runtime_error("sample_laser : timed out after " + std::to_string(samples.size()) +
+                               " of " + std::to_string(num_samples) + " samples");
+    }
+    else
     {
-      samples.push_back(tmp);
-      std::this_thread::sleep_for(std::chrono::milliseconds(99.5));
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
   }
+  acq.stop();
 }
 
 
@@ -0,0 +1,49 @@
+/*
+ * capture_dump.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *  Prints a serial traffic capture (Device::start_capture), one read or
+ *  write per line, with its time since the start of the capture.
+ *
+ *  usage: capture_dump <capture>
+ */
+
+#include <Capture.hh>
+#include <utilities.hh>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    std::cerr << "usage: " << argv[0] << " <capture>" << std::endl;
+    return 1;
+  }
+  std::vector<device::CaptureRecord> records;
+  try
+  {
+    records = device::read_capture(argv[1]);
+  }
+  catch(std::exception &e)
+  {
+    std::cerr << "capture_dump : " << e.what() << std::endl;
+    return 1;
+  }
+  uint64_t bytes_out = 0, bytes_in = 0;
+  const uint64_t t0 = records.empty() ? 0 : records.front().timestamp_ns;
+  for (const device::CaptureRecord &r : records)
+  {
+    std::printf("%14.6f %s %4zu [%s]\n",static_cast<double>(r.timestamp_ns - t0) * 1e-6,
+                r.outbound ? ">>" : "<<",r.data.size(),util::escape(r.data).c_str());
+    (r.outbound ? bytes_out : bytes_in) += r.data.size();
+  }
+  std::printf("%zu records, %llu bytes written, %llu bytes read\n",records.size(),
+              static_cast<unsigned long long>(bytes_out),static_cast<unsigned long long>(bytes_in));
+  return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * device_emulator.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *  Serves one instrument model on a pseudo-terminal, so that the drivers
+ *  (or serial_manager) can be pointed at it as at the real port.
+ *
+ *  usage: device_emulator <surelite|vega|attenuator> [options]
+ *    -l <us>     answer latency
+ *    -b <baud>   pace the bytes as a serial line at this rate
+ *    -L <path>   also make a symlink to the pty at path
+ *    -r <Hz>     (vega) pulse rate
+ *    -e <J>      (vega) mean pulse energy
+ *    -v          print the traffic
+ */
+
+#include <Emulators.hh>
+#include <utilities.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <string>
+
+extern "C"
+{
+#include <unistd.h>
+};
+
+using device::DeviceModel;
+using device::PtyServer;
+
+static PtyServer *g_server = nullptr;
+
+static void handle_signal(int)
+{
+  if (g_server != nullptr)
+  {
+    g_server->stop();
+  }
+}
+
+// prints both directions of the traffic of a model
+class TraceModel : public DeviceModel
+{
+public:
+  explicit TraceModel (std::shared_ptr<DeviceModel> model) : m_model(model) {}
+  virtual void receive(const char *data, const size_t len, std::string &reply) override
+  {
+    const size_t before = reply.size();
+    m_model->receive(data,len,reply);
+    std::cout << "<< [" << util::escape(std::string(data,len)) << "]";
+    if (reply.size() > before)
+    {
+      std::cout << "  >> [" << util::escape(reply.substr(before)) << "]";
+    }
+    std::cout << std::endl;
+  }
+private:
+  std::shared_ptr<DeviceModel> m_model;
+};
+
+static void usage(const char *prog)
+{
+  std::cerr << "usage: " << prog << " <surelite|vega|attenuator> [-l latency_us] [-b baud] [-L link]"
+            << " [-r rate_hz] [-e energy_j] [-v]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  const std::string type(argv[1]);
+  uint32_t latency_us = 0;
+  uint32_t baud = 0;
+  std::string link;
+  double rate = 10.0;
+  double energy = 1.1e-4;
+  bool verbose = false;
+  // the device type comes first
+  optind = 2;
+  int opt;
+  while ((opt = getopt(argc,argv,"l:b:L:r:e:v")) != -1)
+  {
+    switch (opt)
+    {
+      case 'l':
+        latency_us = std::strtoul(optarg,NULL,0);
+        break;
+      case 'b':
+        baud = std::strtoul(optarg,NULL,0);
+        break;
+      case 'L':
+        link = optarg;
+        break;
+      case 'r':
+        rate = std::strtod(optarg,NULL);
+        break;
+      case 'e':
+        energy = std::strtod(optarg,NULL);
+        break;
+      case 'v':
+        verbose = true;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  std::shared_ptr<DeviceModel> model;
+  if (type == "surelite")
+  {
+    model = std::make_shared<device::SureliteModel>();
+  }
+  else if (type == "vega")
+  {
+    std::shared_ptr<device::VegaModel> vega = std::make_shared<device::VegaModel>();
+    vega->set_pulses(rate,energy);
+    model = vega;
+  }
+  else if (type == "attenuator")
+  {
+    model = std::make_shared<device::AttenuatorModel>();
+  }
+  else
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  if (verbose)
+  {
+    model = std::make_shared<TraceModel>(model);
+  }
+
+  try
+  {
+    PtyServer server(model);
+    server.set_latency_us(latency_us);
+    server.set_pace_baud(baud);
+    if (!link.empty())
+    {
+      unlink(link.c_str());
+      if (symlink(server.slave_name().c_str(),link.c_str()) == -1)
+      {
+        std::perror("symlink");
+        return 1;
+      }
+    }
+    g_server = &server;
+    std::signal(SIGINT,handle_signal);
+    std::signal(SIGTERM,handle_signal);
+    // the port, for scripts to pick up
+    std::cout << server.slave_name() << std::endl;
+    server.run();
+    g_server = nullptr;
+    if (!link.empty())
+    {
+      unlink(link.c_str());
+    }
+    std::cerr << type << " : " << server.bytes_in() << " bytes in, "
+              << server.bytes_out() << " bytes out" << std::endl;
+  }
+  catch(std::exception &e)
+  {
+    std::cerr << "device_emulator : " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,307 @@
+/*
+ * fault_harness.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *  Runs the drivers against the emulated instruments under a set of fault
+ *  profiles (dropped, garbled, cut short, late and error replies, devices
+ *  that go away) and reports what each costs: throughput, failed calls,
+ *  time to recover and wrong values that got through.
+ *
+ *  usage: fault_harness [options]
+ *    -d <device>  surelite, vega or attenuator (default: all of them)
+ *    -t <s>       seconds per profile (default 5)
+ *    -p <prob>    fault probability per reply (default 0.01)
+ *    -l <us>      answer latency
+ *    -b <baud>    pace the bytes as a serial line at this rate
+ */
+
+#include <Emulators.hh>
+#include <QuantileSketch.hh>
+#include <Laser.hh>
+#include <PowerMeter.hh>
+#include <Attenuator.hh>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <unistd.h>
+};
+
+using namespace device;
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(const Clock::time_point t0)
+{
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+struct Profile
+{
+  std::string name;
+  FaultProfile faults;
+};
+
+struct Result
+{
+  uint64_t calls;
+  uint64_t failed;
+  uint64_t wrong;           ///< calls that returned a value that cannot be right
+  double elapsed;
+  QuantileSketch latency;   ///< ms, successful calls
+  QuantileSketch recovery;  ///< ms, from the first failed call to the next good one
+  FaultCounts faults;
+
+  Result () : calls(0), failed(0), wrong(0), elapsed(0.0), latency(), recovery(), faults() {}
+};
+
+// one call of the driver. Returns false if the value is wrong; throws if it fails
+typedef std::function<bool()> Call;
+
+struct Target
+{
+  std::shared_ptr<Device> driver;
+  Call call;
+};
+
+static Target make_target(const std::string &type, PtyTransport *t)
+{
+  Target tg;
+  if (type == "surelite")
+  {
+    std::shared_ptr<Laser> l = std::make_shared<Laser>("emulated",9600,t);
+    tg.driver = l;
+    tg.call = [l]() -> bool
+    {
+      std::string code, msg;
+      l->security(code,msg);
+      return (code == "00");
+    };
+  }
+  else if (type == "vega")
+  {
+    std::shared_ptr<PowerMeter> p = std::make_shared<PowerMeter>("emulated",9600,t);
+    tg.driver = p;
+    tg.call = [p]() -> bool
+    {
+      double e = 0.0;
+      if (p->read_energy(e))
+      {
+        // 1.1e-4 J, 2% spread
+        return (std::fabs(e - 1.1e-4) < 1.1e-5);
+      }
+      return true;
+    };
+  }
+  else
+  {
+    std::shared_ptr<Attenuator> a = std::make_shared<Attenuator>("emulated",9600,t);
+    tg.driver = a;
+    tg.call = [a]() -> bool
+    {
+      int32_t pos;
+      Attenuator::MotorState st;
+      a->get_position(pos,st);
+      return (pos == 0 && st == Attenuator::Stopped);
+    };
+  }
+  return tg;
+}
+
+static std::shared_ptr<DeviceModel> make_model(const std::string &type)
+{
+  if (type == "surelite")
+  {
+    return std::make_shared<SureliteModel>();
+  }
+  if (type == "vega")
+  {
+    std::shared_ptr<VegaModel> v = std::make_shared<VegaModel>();
+    v->set_pulses(1000.0,1.1e-4);
+    return v;
+  }
+  return std::make_shared<AttenuatorModel>();
+}
+
+static Result run(const std::string &type, const Profile &p, const double duration,
+                  const uint32_t latency_us, const uint32_t baud)
+{
+  Result r;
+  std::shared_ptr<FaultyModel> faulty = std::make_shared<FaultyModel>(make_model(type));
+  PtyTransport *t = new PtyTransport(faulty);
+  t->server().set_latency_us(latency_us);
+  t->server().set_pace_baud(baud);
+  // the constructors talk to the device: no faults until they are done
+  Target tg = make_target(type,t);
+  FaultProfile faults = p.faults;
+  // error replies with the terminator of the device
+  faults.error_reply = (type == "vega") ? "?ERROR\r\n" : (type == "surelite") ? "?\r" : "?\n\r";
+  faulty->set_profile(faults);
+
+  bool failing = false;
+  Clock::time_point failed_at;
+  const Clock::time_point t0 = Clock::now();
+  while (seconds_since(t0) < duration)
+  {
+    const Clock::time_point c0 = Clock::now();
+    bool ok = false;
+    r.calls++;
+    try
+    {
+      if (!tg.call())
+      {
+        r.wrong++;
+      }
+      ok = true;
+    }
+    catch(std::exception &e)
+    {
+      r.failed++;
+    }
+    if (ok)
+    {
+      const Clock::time_point c1 = Clock::now();
+      r.latency.add(std::chrono::duration<double,std::milli>(c1 - c0).count());
+      if (failing)
+      {
+        r.recovery.add(std::chrono::duration<double,std::milli>(c1 - failed_at).count());
+        failing = false;
+      }
+    }
+    else if (!failing)
+    {
+      failing = true;
+      failed_at = c0;
+    }
+  }
+  r.elapsed = seconds_since(t0);
+  r.faults = faulty->counts();
+  return r;
+}
+
+static void print_header()
+{
+  std::printf("%-11s %-11s %7s %8s %6s %6s %6s %8s %8s %8s %9s %9s\n",
+              "device","profile","faults","calls/s","calls","failed","wrong",
+              "p50 ms","p99 ms","max ms","recov ms","recov max");
+}
+
+static void print_result(const std::string &type, const Profile &p, const Result &r)
+{
+  const double rate = (r.elapsed > 0.0) ? static_cast<double>(r.calls - r.failed) / r.elapsed : 0.0;
+  double p50 = 0.0, p99 = 0.0, mx = 0.0;
+  if (!r.latency.empty())
+  {
+    std::vector<double> q = r.latency.quantiles({0.5,0.99});
+    p50 = q[0];
+    p99 = q[1];
+    mx = r.latency.max();
+  }
+  double rec = 0.0, rec_max = 0.0;
+  if (!r.recovery.empty())
+  {
+    rec = r.recovery.quantile(0.5);
+    rec_max = r.recovery.max();
+  }
+  std::printf("%-11s %-11s %7llu %8.1f %6llu %6llu %6llu %8.2f %8.2f %8.1f %9.1f %9.1f\n",
+              type.c_str(),p.name.c_str(),
+              static_cast<unsigned long long>(r.faults.faults()),rate,
+              static_cast<unsigned long long>(r.calls),static_cast<unsigned long long>(r.failed),
+              static_cast<unsigned long long>(r.wrong),p50,p99,mx,rec,rec_max);
+  std::fflush(stdout);
+}
+
+static std::vector<Profile> profiles(const double prob)
+{
+  std::vector<Profile> ps;
+  Profile p;
+  p.name = "clean";
+  ps.push_back(p);
+  p.name = "drop";
+  p.faults = FaultProfile();
+  p.faults.drop = prob;
+  ps.push_back(p);
+  p.name = "garble";
+  p.faults = FaultProfile();
+  p.faults.garble = prob;
+  ps.push_back(p);
+  p.name = "partial";
+  p.faults = FaultProfile();
+  p.faults.partial = prob;
+  ps.push_back(p);
+  p.name = "delay";
+  p.faults = FaultProfile();
+  p.faults.delay = prob;
+  ps.push_back(p);
+  p.name = "error";
+  p.faults = FaultProfile();
+  p.faults.error = prob;
+  ps.push_back(p);
+  p.name = "disconnect";
+  p.faults = FaultProfile();
+  p.faults.disconnect = prob / 10.0;
+  ps.push_back(p);
+  return ps;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> devices = {"surelite","vega","attenuator"};
+  double duration = 5.0;
+  double prob = 0.01;
+  uint32_t latency_us = 0;
+  uint32_t baud = 0;
+  int opt;
+  while ((opt = getopt(argc,argv,"d:t:p:l:b:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd':
+        devices = {optarg};
+        break;
+      case 't':
+        duration = std::strtod(optarg,NULL);
+        break;
+      case 'p':
+        prob = std::strtod(optarg,NULL);
+        break;
+      case 'l':
+        latency_us = std::strtoul(optarg,NULL,0);
+        break;
+      case 'b':
+        baud = std::strtoul(optarg,NULL,0);
+        break;
+      default:
+        std::cerr << "usage: " << argv[0] << " [-d device] [-t seconds] [-p probability] [-l latency_us] [-b baud]" << std::endl;
+        return 1;
+    }
+  }
+
+  print_header();
+  for (const std::string &d : devices)
+  {
+    for (const Profile &p : profiles(prob))
+    {
+      try
+      {
+        print_result(d,p,run(d,p,duration,latency_us,baud));
+      }
+      catch(std::exception &e)
+      {
+        std::cerr << d << " / " << p.name << " : " << e.what() << std::endl;
+      }
+    }
+  }
+  return 0;
+}
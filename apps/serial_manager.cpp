@@ -17,6 +17,9 @@
 #include <cerrno>
 #include <string>
 #include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
 
 extern "C"
 {
@@ -51,8 +54,23 @@ typedef struct iols_config_t
   iols_dev_t laser;
   iols_dev_t attenuator;
   iols_dev_t power_meter;
+  // instrument capabilities are cached here ("" : always query them)
+  std::string cache_dir;
 }iols_config_t;
 
+// where the start up of a device is at
+enum map_state_t {map_pending = 0, map_ready = 1, map_failed = 2};
+
+typedef struct iols_map_t
+{
+  std::atomic<int> state;
+  // duration of each phase, in ms
+  double locate_ms;
+  double open_ms;
+  double query_ms;
+  double total_ms;
+} iols_map_t;
+
 typedef struct iolaser_t
 {
   iols_config_t config;
@@ -60,6 +78,9 @@ typedef struct iolaser_t
   device::Laser *laser;
   device::PowerMeter *power_meter;
 
+  iols_map_t laser_map;
+  iols_map_t attenuator_map;
+  iols_map_t power_meter_map;
 } iolaser_t;
 
 
@@ -73,11 +94,27 @@ iolaser_t iols;
 bool g_ignore_laser;
 bool g_ignore_pm;
 bool g_ignore_attenuator;
+// the devices are mapped concurrently, each in its own thread
+std::vector<std::thread> g_map_threads;
+std::mutex g_map_mutex;
+std::condition_variable g_map_cv;
+std::chrono::steady_clock::time_point g_map_start;
+std::atomic<int> g_map_left;
+
 //
 // Prototypes
 //
 int run_command(int argc, char** argv);
 
+// ms since t, and restart t (phase timing)
+double lap_ms(std::chrono::steady_clock::time_point &t)
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double,std::milli>(now - t).count();
+  t = now;
+  return ms;
+}
+
 
 int map_laser()
 {
@@ -88,7 +125,9 @@ int map_laser()
     spdlog::error("Already have an instance of the laser. Not building a new one and risking failure.");
     return 0;
   }
+  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
   iols.config.laser.port = util::find_port(iols.config.laser.serial_nr);
+  iols.laser_map.locate_ms = lap_ms(t);
   if (!iols.config.laser.port_valid())
   {
     spdlog::error("Failed to find Laser. Expected to see a device with serial number {0}",iols.config.laser.serial_nr);
@@ -100,6 +139,7 @@ int map_laser()
   {
     spdlog::trace("Creating device instance");
     iols.laser = new device::Laser(iols.config.laser.port.c_str(),iols.config.laser.baud_rate);
+    iols.laser_map.open_ms = lap_ms(t);
     spdlog::trace("Instance created");
 
     // -- this sets the cache variables so that we can get a whole ton of stuff out of it
@@ -116,6 +156,7 @@ int map_laser()
     uint32_t count;
     iols.laser->get_shot_count(count);
     spdlog::info("Laser shot count [{0}]",count);
+    iols.laser_map.query_ms = lap_ms(t);
 
     spdlog::info("Laser initialized. Ready for operation");
   }
@@ -251,7 +292,9 @@ int map_attenuator()
   }
 
   spdlog::info("Initializing the attenuator");
+  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
   iols.config.attenuator.port = util::find_port(iols.config.attenuator.serial_nr);
+  iols.attenuator_map.locate_ms = lap_ms(t);
   if (!iols.config.attenuator.port_valid())
   {
     spdlog::error("Failed to find Attenuator. Expected to see a device with serial number {0}",iols.config.attenuator.serial_nr);
@@ -263,9 +306,11 @@ int map_attenuator()
   {
     spdlog::trace("Creating device instance");
     iols.attenuator = new device::Attenuator(iols.config.attenuator.port.c_str(),iols.config.attenuator.baud_rate);
+    iols.attenuator_map.open_ms = lap_ms(t);
     spdlog::trace("Instance created");
 
     ret = query_attenuator_settings();
+    iols.attenuator_map.query_ms = lap_ms(t);
     if (ret != 0)
     {
       spdlog::error("Failed to query attenuator");
@@ -322,81 +367,42 @@ int query_power_meter_settings()
   try
   {
 
-    // do some query on functionality
-    spdlog::debug("Querying head information");
-    std::string tp, sn,name;
-    bool pw,en,fq;
-    iols.power_meter->head_info(tp,sn,name,pw,en,fq);
+    // the static metadata comes from the cache, if the instrument, the head
+    // and the firmware are the ones it was taken from
+    spdlog::debug("Querying capabilities");
+    bool cached = iols.power_meter->load_capabilities(iols.config.cache_dir);
+    const device::PowerMeter::Capabilities &caps = iols.power_meter->get_capabilities();
+    spdlog::debug("Capabilities {0} (firmware [{1}])",cached ? "from the cache" : "queried",caps.firmware);
     spdlog::debug("HEAD INFO :\n"
         "Type           : {0}\n"
         "Serial number  : {1}\n"
         "Name           : {2}\n"
-        "Power capable  : {3}\n"
-        "Energy capable  : {4}\n"
-        "Frequency capable  : {5}\n"
-        , tp,sn,pw,en,fq);
-    spdlog::debug("Querying the instrument:");
-    iols.power_meter->inst_info(tp, sn, name);
+        "Capabilities   : {3:x}\n"
+        , caps.head_type,caps.head_sn,caps.head_name,caps.head_word);
     spdlog::debug("INSTRUMENT INFO :\n"
         "ID             : {0}\n"
         "Serial number  : {1}\n"
         "Name           : {2}\n"
-        ,tp,sn,name);
-    spdlog::debug("Querying range:");
-    int16_t cur;
-    std::map<int16_t,std::string> rmap;
-    iols.power_meter->get_all_ranges(cur);
-    iols.power_meter->get_range_map(rmap);
-    spdlog::debug("Current range [{0}]",cur);
+        ,caps.inst_id,caps.inst_sn,caps.inst_name);
     spdlog::debug("RANGES :");
-    for (auto item : rmap)
+    for (auto item : caps.ranges)
     {
       spdlog::debug("{0} : {1}",item.first,item.second );
     }
-
-    // now query the user threshold
-    uint16_t current,min,max;
-    spdlog::debug("Checking user threshold");
-    iols.power_meter->query_user_threshold(current, min, max);
-    spdlog::debug("Response : {0} : [{1} , {2}]",current,min,max);
-
-    // get pulse widths
-    std::map<uint16_t,std::string> umap;
-    spdlog::debug("Checking pulse options");
-    iols.power_meter->pulse_length(0, current);
-    iols.power_meter->get_pulse_map(umap);
-    spdlog::debug("Current pulse width [{0}]",current);
-    spdlog::debug("OPTIONS :");
-    for (auto item : umap)
+    spdlog::debug("User threshold : [{0} , {1}]",caps.threshold_ranges.first,caps.threshold_ranges.second);
+    spdlog::debug("PULSE WIDTH OPTIONS :");
+    for (auto item : caps.pulse_lengths)
     {
       spdlog::debug("{0} : [{1}]",item.first,item.second);
     }
-
-    // get wavelengths
-    spdlog::debug("Querying wavelength capabilities (method 1)");
-    iols.power_meter->get_all_wavelengths(name);
-    spdlog::debug("Raw answer [{0}]",name);
-
-    // Not implemented
-    //     cout<< log(label) << "Querying wavelength capabilities (method 2)" << endl;
-    //     std::string raw_answer;
-    //     m_pm->get_all_wavelengths(raw_answer);
-    //     cout << log(label) << "Current selection : " << cur << endl;
-
-
-    // averaging settings
-    spdlog::debug("Querying averaging settings");
-    iols.power_meter->average_query(0, current);
-    // -- this actually also fills the map on the first execution
-    iols.power_meter->get_averages_map(umap);
-    spdlog::debug("Current average setting [{0}]",current);
-    spdlog::debug("OPTIONS :");
-    for (auto item : umap)
+    spdlog::debug("Wavelength capabilities [{0}]",caps.wavelengths);
+    spdlog::debug("AVERAGING OPTIONS :");
+    for (auto item : caps.ave_windows)
     {
       spdlog::debug("{0} : [{1}]",item.first,item.second);
     }
 
-    // max frequency
+    // max frequency depends on the pulse width setting: always ask
     spdlog::debug("Querying for max frequency");
     uint32_t u32;
     iols.power_meter->max_freq(u32);
@@ -446,7 +452,9 @@ int map_power_meter()
     return 0;
   }
 
+  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
   iols.config.power_meter.port = util::find_port(iols.config.power_meter.serial_nr);
+  iols.power_meter_map.locate_ms = lap_ms(t);
   if (!iols.config.power_meter.port_valid())
   {
     spdlog::error("Failed to find PowerMeter. Expected to see a device with serial number {0}",iols.config.power_meter.serial_nr);
@@ -459,9 +467,11 @@ int map_power_meter()
   {
     spdlog::trace("Creating device instance");
     iols.power_meter = new device::PowerMeter(iols.config.power_meter.port.c_str(),iols.config.power_meter.baud_rate);
+    iols.power_meter_map.open_ms = lap_ms(t);
     spdlog::trace("Instance created");
 
     ret = query_power_meter_settings();
+    iols.power_meter_map.query_ms = lap_ms(t);
     if (ret != 0)
     {
       spdlog::error("Failed inital check on power meter");
@@ -499,9 +509,39 @@ int map_power_meter()
   }
   return ret;
 }
-int map_devices()
+void report_mapping();
+
+// run one mapping function and publish the outcome. The last one to finish
+// reports the timing
+void map_device(const std::string name, int (*map)(), iols_map_t &status)
 {
-  int ret = 0;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  int ret = map();
+  status.total_ms = lap_ms(t0);
+  bool ok = (ret == 0);
+  if (!ok)
+  {
+    spdlog::critical("Failed to initialize the {0}",name);
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_map_mutex);
+    status.state = ok ? map_ready : map_failed;
+  }
+  g_map_cv.notify_all();
+  if (--g_map_left == 0)
+  {
+    report_mapping();
+  }
+}
+
+// start mapping every device that is not ignored. Does not wait
+void start_mapping()
+{
+  g_map_start = std::chrono::steady_clock::now();
+  g_map_left = (g_ignore_attenuator ? 0 : 1) + (g_ignore_laser ? 0 : 1) + (g_ignore_pm ? 0 : 1);
+  iols.laser_map.state = map_pending;
+  iols.attenuator_map.state = map_pending;
+  iols.power_meter_map.state = map_pending;
   if (g_ignore_attenuator)
   {
     spdlog::warn("Attenuator is being ignored. Skipping mapping");
@@ -509,64 +549,134 @@ int map_devices()
   else
   {
     spdlog::debug("Mapping the attenuator");
-    ret = map_attenuator();
-    if (ret != 0)
-    {
-      spdlog::critical("Failed to initialize the attenuator");
-    }
-
-    if (iols.attenuator == nullptr)
-    {
-      spdlog::error("There is no open instance of the attenuator");
-      return 1;
-    }
-
+    g_map_threads.push_back(std::thread(map_device,std::string("attenuator"),map_attenuator,std::ref(iols.attenuator_map)));
   }
-
   if (g_ignore_laser)
   {
     spdlog::warn("Laser is being ignored. Skipping mapping");
   }
   else
   {
-
     spdlog::debug("Mapping the laser");
-    ret = map_laser();
-    if (ret != 0)
-    {
-      spdlog::critical("Failed to initalize the laser");
-    }
-    if (iols.laser == nullptr)
-    {
-      spdlog::error("There is no open instance of the laser");
-      return 1;
-    }
-
+    g_map_threads.push_back(std::thread(map_device,std::string("laser"),map_laser,std::ref(iols.laser_map)));
   }
   if (g_ignore_pm)
   {
-    spdlog::warn("Attenuator is being ignored.No operations possible");
+    spdlog::warn("Power meter is being ignored. Skipping mapping");
   }
   else
   {
-
     spdlog::debug("Mapping the power meter");
-    ret = map_power_meter();
-    if (ret != 0)
+    g_map_threads.push_back(std::thread(map_device,std::string("power meter"),map_power_meter,std::ref(iols.power_meter_map)));
+  }
+}
+
+// the mapping status of the devices that are not ignored
+std::vector<iols_map_t*> mapped_devices()
+{
+  std::vector<iols_map_t*> devs;
+  if (!g_ignore_attenuator)
+  {
+    devs.push_back(&iols.attenuator_map);
+  }
+  if (!g_ignore_laser)
+  {
+    devs.push_back(&iols.laser_map);
+  }
+  if (!g_ignore_pm)
+  {
+    devs.push_back(&iols.power_meter_map);
+  }
+  return devs;
+}
+
+/**
+ * Wait for the mapping.
+ * @param first_only return as soon as one device is ready
+ * @return number of devices ready
+ */
+size_t wait_mapping(const bool first_only)
+{
+  std::vector<iols_map_t*> devs = mapped_devices();
+  size_t ready = 0;
+  std::unique_lock<std::mutex> lock(g_map_mutex);
+  g_map_cv.wait(lock,[&]()
+  {
+    size_t done = 0;
+    ready = 0;
+    for (iols_map_t *d : devs)
     {
-      spdlog::critical("Failed a query to the power meter");
+      if (d->state != map_pending)
+      {
+        done++;
+      }
+      if (d->state == map_ready)
+      {
+        ready++;
+      }
     }
-    if (iols.power_meter == nullptr)
+    return (done == devs.size() || (first_only && ready > 0));
+  });
+  return ready;
+}
+
+void join_mapping()
+{
+  for (std::thread &t : g_map_threads)
+  {
+    if (t.joinable())
     {
-      spdlog::error("There is no open instance of the power meter");
-      return 1;
+      t.join();
     }
   }
-  return ret;
+  g_map_threads.clear();
+}
+
+// per phase timing of the mapping. Call once all of it is done
+void report_mapping()
+{
+  double wall = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - g_map_start).count();
+  double sum = 0.0;
+  spdlog::info("Device start up (ms)  :  locate     open    query    total");
+  const std::vector<std::pair<std::string,iols_map_t*> > devs = {{"attenuator",&iols.attenuator_map},
+                                                                  {"laser",&iols.laser_map},
+                                                                  {"power meter",&iols.power_meter_map}};
+  for (const std::pair<std::string,iols_map_t*> &d : devs)
+  {
+    if (d.second->state == map_pending)
+    {
+      continue;
+    }
+    spdlog::info("  {0:<20}: {1:8.1f} {2:8.1f} {3:8.1f} {4:8.1f}{5}",d.first,d.second->locate_ms,
+                 d.second->open_ms,d.second->query_ms,d.second->total_ms,
+                 (d.second->state == map_ready) ? "" : "  (failed)");
+    sum += d.second->total_ms;
+  }
+  spdlog::info("All devices up in {0:.1f} ms (one after the other: {1:.1f} ms)",wall,sum);
+}
+
+/**
+ * Check that a device can take commands.
+ */
+bool device_ready(const iols_map_t &status, const std::string name)
+{
+  if (status.state == map_pending)
+  {
+    spdlog::warn("The {0} is still initializing. Try again in a moment.",name);
+    return false;
+  }
+  if (status.state == map_failed)
+  {
+    spdlog::error("The {0} failed to initialize. No operations possible",name);
+    return false;
+  }
+  return true;
 }
 
 int unmap_devices()
 {
+  // a device may still be starting up
+  join_mapping();
   spdlog::info("Destroying the device instances");
   spdlog::trace("Destroying the power meter");
   if (iols.power_meter)
@@ -709,6 +819,10 @@ int run_command(int argc, char** argv)
         spdlog::error("Laser is being ignored.No operations possible");
         return 0;
       }
+      if (!device_ready(iols.laser_map,"laser"))
+      {
+        return 0;
+      }
       if (iols.laser == nullptr)
       {
         spdlog::error("There is no open instance of the laser");
@@ -812,6 +926,10 @@ int run_command(int argc, char** argv)
         spdlog::error("Attenuator is being ignored.No operations possible");
         return 0;
       }
+      if (!device_ready(iols.attenuator_map,"attenuator"))
+      {
+        return 0;
+      }
       if (iols.attenuator == nullptr)
       {
         spdlog::error("There is no open instance of the attenuator");
@@ -974,6 +1092,10 @@ int run_command(int argc, char** argv)
         spdlog::error("Power meter is being ignored.No operations possible");
         return 0;
       }
+      if (!device_ready(iols.power_meter_map,"power meter"))
+      {
+        return 0;
+      }
       if (iols.power_meter == nullptr)
       {
         spdlog::error("There is no open instance of the power meter");
@@ -1314,6 +1436,8 @@ int main(int argc, char** argv)
   spdlog::set_level(spdlog::level::trace); // Set global log level to info
 
   std::string config_file = "config.json";
+  const char *home = std::getenv("HOME");
+  iols.config.cache_dir = std::string(home ? home : ".") + "/.cache/lasercontrol";
 
 
   // set default values for the control variables
@@ -1442,6 +1566,11 @@ int main(int argc, char** argv)
       spdlog::warn("Can't find laser S/N setting. Ignoring it.");
       g_ignore_pm = true;
     }
+    if (conf.contains("cache_dir"))
+    {
+      iols.config.cache_dir = conf["cache_dir"];
+    }
+    spdlog::debug("Capability cache in [{0}]",iols.config.cache_dir);
   }
   catch(std::exception &e)
   {
@@ -1451,13 +1580,11 @@ int main(int argc, char** argv)
 
 
 
-  // map the devices
-  int ret = 0;
+  // map the devices, all at once. The command line opens as soon as one of
+  // them is ready; the others keep starting up in the background
   spdlog::info("Mapping the devices");
-
-  ret = map_devices();
-  //ret = map_laser();
-  if (ret != 0)
+  start_mapping();
+  if (!mapped_devices().empty() && wait_mapping(true) == 0)
   {
     spdlog::critical("Failed to map devices. Clearing out.");
     unmap_devices();
@@ -75,7 +75,11 @@ public:
    * @param baud_rate
    */
   Attenuator () { };
-  Attenuator (const char* port, const uint32_t baud_rate = 38400 );
+  /**
+   * @param transport link to use instead of the serial port (e.g., a
+   *        LoopbackTransport). The device takes ownership
+   */
+  Attenuator (const char* port, const uint32_t baud_rate = 38400, Transport *transport = nullptr);
   virtual ~Attenuator ();
 
   /**
@@ -222,6 +226,13 @@ public:
   void get_position(int32_t &position, uint16_t &status, bool wait= false);
   void get_position(int32_t &position, enum MotorState &status, bool wait = false);
 
+  /**
+   * Asynchronous version of get_position (without waiting for the motor to stop)
+   *
+   * @return future holding the position (first) and the motor status (second)
+   */
+  std::future<std::pair<int32_t,uint16_t> > async_get_position();
+
 
   /**
      * @fn void set_transmission(const float)
@@ -0,0 +1,167 @@
+/*
+ * Capture.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Byte level captures of the serial traffic: a recorder that taps a
+ *      serial::Serial, and a transport that plays a capture back to a driver.
+ */
+
+#ifndef INCLUDE_CAPTURE_HH_
+#define INCLUDE_CAPTURE_HH_
+
+#include <Transport.hh>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <chrono>
+
+namespace device
+{
+
+  /// one read or write, as seen by the driver
+  struct CaptureRecord
+  {
+    uint64_t timestamp_ns;  ///< CLOCK_MONOTONIC
+    bool outbound;          ///< written by the driver (false: read)
+    std::string data;
+  };
+
+  /**
+   * Records every byte a port reads and writes, with its time and direction.
+   *
+   * File layout: a header (magic, version, start time in CLOCK_REALTIME and
+   * CLOCK_MONOTONIC), then one record per read or write:
+   *   varint  ns since the previous record (since the start for the first)
+   *   varint  length << 1 | outbound
+   *   bytes
+   * A command and its answer take a few bytes on top of the data. Records are
+   * kept in memory and written in chunks of flush_bytes, so a call costs a
+   * clock read and a copy; a capture cut short (crash, power) loses at most
+   * the last chunk.
+   */
+  class TrafficRecorder : public serial::Tap
+  {
+  public:
+    /// @throws std::runtime_error if the file cannot be created
+    explicit TrafficRecorder (const std::string &path, const size_t flush_bytes = 65536);
+    virtual ~TrafficRecorder ();
+
+    virtual void onRead(const uint8_t *data, size_t length) override;
+    virtual void onWrite(const uint8_t *data, size_t length) override;
+
+    /// write out what is buffered
+    void flush();
+    /// flush and close the file. Later traffic is ignored. Called by the destructor
+    void close();
+
+    const std::string &path() const {return m_path;}
+    uint64_t records() const;
+    /// traffic bytes recorded (both directions)
+    uint64_t bytes() const;
+
+  private:
+    TrafficRecorder (const TrafficRecorder &other) = delete;
+    TrafficRecorder (TrafficRecorder &&other) = delete;
+    TrafficRecorder& operator= (const TrafficRecorder &other) = delete;
+    TrafficRecorder& operator= (TrafficRecorder &&other) = delete;
+
+    void record(const bool outbound, const uint8_t *data, const size_t length);
+    /// called with the mutex held
+    void write_out();
+
+    std::string m_path;
+    int m_fd;
+    size_t m_flush_bytes;
+    uint64_t m_last_ns;
+    uint64_t m_records;
+    uint64_t m_bytes;
+    std::vector<uint8_t> m_buffer;
+    mutable std::mutex m_mutex;
+  };
+
+  /**
+   * Read a whole capture. A record cut short at the end of the file (the
+   * recorder did not get to close it) is left out.
+   * @throws std::runtime_error if the file cannot be read or is not a capture
+   */
+  std::vector<CaptureRecord> read_capture(const std::string &path);
+
+  /**
+   * Plays a capture back to a driver, in place of the instrument.
+   *
+   * Each write is matched against the next bytes the driver wrote in the
+   * capture (differences are counted in mismatches()), and the bytes it read
+   * after that are handed out at their recorded time since the write, divided
+   * by the speed. At speed 0 they are available at once: the run is then as
+   * fast as the driver code, which is what parser benchmarks want.
+   *
+   * Reads that find no complete line return what there is as soon as the
+   * capture has nothing more before the next write, instead of waiting out
+   * the timeout (as LoopbackTransport does).
+   */
+  class ReplayTransport : public Transport
+  {
+  public:
+    /// @throws std::runtime_error if the capture cannot be read
+    explicit ReplayTransport (const std::string &path, const double speed = 1.0);
+    explicit ReplayTransport (const std::vector<CaptureRecord> &records, const double speed = 1.0);
+    virtual ~ReplayTransport () {}
+
+    virtual void open() override {m_open = true;}
+    virtual void close() override {m_open = false;}
+    virtual bool is_open() const override {return m_open;}
+
+    virtual void set_timeout_ms(const uint32_t ms) override {m_timeout_ms = ms;}
+
+    virtual size_t write(const std::string &data) override;
+    virtual size_t readline(std::string &line, const size_t size, const std::string &eol) override;
+    virtual std::vector<std::string> readlines(const size_t size, const std::string &eol, const size_t max_lines) override;
+    virtual bool wait_readable() override;
+
+    virtual void flush_input() override;
+    virtual void flush_output() override {}
+
+    /// start over from the first record
+    void rewind();
+    void set_speed(const double speed) {m_speed = speed;}
+
+    /// true once every record has been played and read
+    bool done() const {return (m_next == m_records.size() && m_rx_pos == m_rx.size());}
+    /// bytes written that differ from the capture, or go past its end
+    uint64_t mismatches() const {return m_mismatches;}
+    size_t records() const {return m_records.size();}
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    /// move the reads that are due to the receive buffer
+    void release(const Clock::time_point now);
+    /// true if a read is still to come before the next write
+    bool pending() const {return (m_next < m_records.size() && !m_records[m_next].outbound);}
+    /// when the next read is due
+    Clock::time_point due() const;
+    /// wait for the next read, until the deadline at most
+    void wait_next(const Clock::time_point deadline) const;
+
+    std::vector<CaptureRecord> m_records;
+    double m_speed;
+    bool m_open;
+    uint32_t m_timeout_ms;
+    // next record, and how much of it (if a write) has been matched
+    size_t m_next;
+    size_t m_next_offset;
+    // the recorded time of the last write, and when it was replayed
+    uint64_t m_anchor_ns;
+    Clock::time_point m_anchor;
+    std::string m_rx;
+    size_t m_rx_pos;
+    uint64_t m_mismatches;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_CAPTURE_HH_ */
@@ -8,8 +8,25 @@
 #ifndef INCLUDE_DEVICE_HH_
 #define INCLUDE_DEVICE_HH_
 #include <string>
+#include <vector>
 #include <cstdint>
+#include <future>
+#include <mutex>
+#include <type_traits>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <semaphore.h>
+#include <ctime>
 #include <serial/serial.h>
+#include <Reactor.hh>
+#include <MPSCQueue.hh>
+#include <Transport.hh>
+#include <Capture.hh>
+#include <QueryCache.hh>
+#include <WriteShadow.hh>
 
 //#define DEBUG 1
 namespace device
@@ -20,14 +37,26 @@ namespace device
   public:
     enum RetStatus {Success=0, Failed=0x1};
 
-    Device ( ) {};
+    /// Answer to a raw command issued with submit()
+    struct Response
+    {
+      Response() : success(false) {}
+      bool success;
+      std::vector<std::string> lines;  ///< answer lines, terminators included
+    };
 
-    Device (const char* port, const uint32_t baud_rate);
+    Device ( ) : m_cmd_interval_ms(0), m_next_cmd({0,0}), m_reactor(nullptr), m_reactor_port(-1), m_io_depth(0), m_worker_run(false), m_producers(0), m_worker_stop(false) {};
+
+    /**
+     * @param transport link to the instrument. The device takes ownership.
+     *        If null, the serial port is used
+     */
+    Device (const char* port, const uint32_t baud_rate, Transport *transport = nullptr);
     virtual ~Device ();
 
-    bool is_open() {return m_serial.isOpen();}
+    bool is_open() {return (m_transport && m_transport->is_open());}
 
-    void close() {m_serial.close();}
+    void close() {if (m_transport) m_transport->close();}
 
     void set_timeout(const uint32_t ms) { m_timeout_ms = ms; }
     void get_timeout(uint32_t &ms) {ms = m_timeout_ms;}
@@ -39,18 +68,209 @@ namespace device
     const std::string get_port() {return m_comport;}
     const uint32_t get_baud() {return m_baud;}
 
-    bool read_lines(std::vector<std::string> &lines);
+    /**
+     * Read the lines of an answer. If expected_lines is not zero, return as soon as
+     * that many lines have been received (e.g. echo + answer) instead of waiting
+     * for the read timeout to expire.
+     *
+     * On a timeout the last line may be incomplete (it does not end in the read
+     * suffix). It is handed back all the same, but does not count as an answer.
+     *
+     * @param lines
+     * @param expected_lines number of lines that make up a complete answer (0: read until timeout)
+     * @return false if fewer than expected_lines complete lines arrived
+     */
+    bool read_lines(std::vector<std::string> &lines, const size_t expected_lines = 0);
     void set_timeout_ms(uint32_t t);
 
+    /**
+     * Minimum gap between consecutive commands, as mandated by the manufacturer.
+     * write_cmd only waits for whatever is left of the gap since the previous
+     * command went out (nothing at all if the caller was idle long enough).
+     */
+    void set_cmd_interval_ms(const uint32_t ms) {m_cmd_interval_ms = ms;}
+    uint32_t get_cmd_interval_ms() const {return m_cmd_interval_ms;}
+
+    /**
+     * Hand the port over to an event loop, so that several devices can be driven
+     * from a single thread. While attached, the port is owned by the reactor and
+     * commands should be issued with post_cmd instead of the blocking methods.
+     *
+     * @param r reactor that will drive the port. Must outlive the attachment
+     * @param min_interval_ms minimum interval between commands. The device
+     *        command interval is used if it is larger
+     */
+    void attach(Reactor &r, const uint32_t min_interval_ms = 0);
+    /// give the port back. Commands still queued fail; the reactor is done with the port on return
+    void detach();
+    bool is_attached() const {return (m_reactor != nullptr);}
+
+    /**
+     * Queue a command in the reactor the device is attached to. The prefix and
+     * suffix are added as in write_cmd, and the answer is framed on the read suffix.
+     *
+     * @param cmd command, without prefix and suffix
+     * @param lines number of lines that make up the answer (0: no answer)
+     * @param cb completion callback, called from the reactor thread
+     */
+    void post_cmd(const std::string cmd, const size_t lines, Reactor::Callback cb);
+
+    /**
+     * Asynchronous command API.
+     *
+     * Send a raw command (without prefix/suffix) and collect the given number of
+     * answer lines without blocking the caller. If the device is attached to a
+     * reactor the command is queued there, otherwise it is queued in the worker,
+     * which is started if it is not running yet. The worker holds the device I/O
+     * lock, so the commands do not interleave with the blocking methods either.
+     *
+     * @param cmd command, without prefix and suffix
+     * @param lines number of lines that make up the answer (0: no answer expected)
+     */
+    std::future<Response> submit(const std::string cmd, const size_t lines = 1);
+    /// Completion-callback variant of submit. The callback may run on another thread.
+    void submit(const std::string cmd, const size_t lines, std::function<void(const Response &)> cb);
+
+    /**
+     * Dedicated I/O thread.
+     *
+     * Once started, the worker owns the port: the methods of the derived classes
+     * hand their transactions (command + answer) to it through a lock-free queue
+     * and wait for the result, and the asynchronous API enqueues without waiting.
+     * Any number of threads can then use the device at the same time without
+     * interleaving bytes on the wire. The asynchronous API starts it on first use.
+     *
+     * stop_worker() executes whatever is still queued before returning. Jobs
+     * enqueued once it has started run directly on the caller's thread.
+     */
+    void start_worker();
+    void stop_worker();
+    bool has_worker() const {return m_worker_run.load(std::memory_order_acquire);}
+
+    /**
+     * Record the traffic of the port (both directions, byte for byte) to a
+     * capture file, for ReplayTransport to play back. Replaces any capture in
+     * progress. It can be started and stopped while the port is in use (by the
+     * worker or a reactor): the file is closed when stop_capture returns, and
+     * the bytes of a call still running then are left out of it.
+     *
+     * @throws std::runtime_error if the transport is not a serial port or
+     *         the file cannot be created
+     */
+    void start_capture(const std::string &path);
+    void stop_capture();
+    bool is_capturing() const {return (m_capture != nullptr);}
+
+    /**
+     * Answers to the slow, rarely changing queries. The rules (what is
+     * cached, for how long, and which commands make it stale) are declared
+     * by each device in its constructor; callers can turn it off or clear it.
+     */
+    QueryCache &query_cache() {return m_query_cache;}
+    /**
+     * Last settings written, to skip the setter commands that would change
+     * nothing (and their pacing). Each device declares which commands are
+     * settings; it is off until enabled here.
+     */
+    WriteShadow &write_shadow() {return m_write_shadow;}
+
   protected:
     /// local member declaration
     ///
     bool write_cmd(const std::string cmd);
+    /// write several commands back to back, in a single write
+    bool write_batch(const std::vector<std::string> &cmds);
 
     bool read_cmd(std::string &answer);
 
     void reset_connection();
 
+    /// create the serial transport unless one was given, set the timeout and open it
+    void open_transport();
+    /// @throws serial::PortNotOpenedException if the device has no transport
+    Transport &transport()
+    {
+      if (!m_transport)
+      {
+        throw serial::PortNotOpenedException("Device has no transport");
+      }
+      return *m_transport;
+    }
+
+    /// wait until the command interval since the previous command has elapsed
+    void pace();
+    /// start the command interval (called once a command is out)
+    void mark_cmd_sent();
+
+    /**
+     * Run a (blocking) device method in the background, queued in the worker
+     * (started if needed). Used to build the typed async_* wrappers of the
+     * derived classes. Exceptions thrown by the call are delivered through the future.
+     *
+     * @throws std::runtime_error if the device is attached to a reactor, which
+     *         owns the port: use submit or post_cmd instead
+     */
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> run_async(F f)
+    {
+      typedef typename std::result_of<F()>::type R;
+      if (m_reactor != nullptr)
+      {
+        throw std::runtime_error("Device : blocking calls are not available while attached to a reactor");
+      }
+      start_worker();
+      std::shared_ptr<std::packaged_task<R()> > task = std::make_shared<std::packaged_task<R()> >(f);
+      std::future<R> res = task->get_future();
+      enqueue([task]() {(*task)();});
+      return res;
+    }
+
+    /**
+     * True if a worker is running and the caller is not the worker itself, i.e.,
+     * the caller must hand its transaction over with run_on_worker. A thread
+     * already holding the I/O lock finishes on its own: the worker would wait for it.
+     */
+    bool off_worker() const
+    {
+      const std::thread::id self = std::this_thread::get_id();
+      return (has_worker() && (self != m_worker_id.load()) && (self != m_io_owner.load()));
+    }
+
+    /**
+     * Device I/O lock, taken by the blocking methods around a transaction that
+     * runs on the caller's thread, and by the worker around each job. Recursive,
+     * as the device methods call each other.
+     */
+    class IOLock
+    {
+    public:
+      explicit IOLock (Device &d);
+      ~IOLock ();
+    private:
+      IOLock (const IOLock &other) = delete;
+      IOLock& operator= (const IOLock &other) = delete;
+      Device &m_device;
+    };
+
+    /**
+     * Execute f in the worker thread and wait for its result (or exception).
+     */
+    template <typename F>
+    typename std::result_of<F()>::type run_on_worker(F f)
+    {
+      typedef typename std::result_of<F()>::type R;
+      std::packaged_task<R()> task(f);
+      std::future<R> res = task.get_future();
+      // the caller waits, so the task can live in its stack
+      std::packaged_task<R()> *tp = &task;
+      enqueue([tp]() {(*tp)();});
+      return res.get();
+    }
+
+    void enqueue(std::function<void()> job);
+
+    Response execute(const std::string cmd, const size_t lines);
+
     std::string m_comport;
     uint32_t m_baud;
 
@@ -59,11 +279,44 @@ namespace device
     std::string m_read_sfx;
     //
     uint32_t m_timeout_ms;
-    serial::Serial m_serial;
+    std::unique_ptr<Transport> m_transport;
+
+    // pacing: minimum gap and earliest time (CLOCK_MONOTONIC) of the next command
+    uint32_t m_cmd_interval_ms;
+    struct timespec m_next_cmd;
+
+    Reactor *m_reactor;
+    int m_reactor_port;
+
+    // shared with the port, whose I/O calls hold a reference while they use it
+    std::shared_ptr<TrafficRecorder> m_capture;
+    QueryCache m_query_cache;
+    WriteShadow m_write_shadow;
+
+    // device I/O lock (see IOLock), with its owner and nesting depth
+    std::recursive_mutex m_io_mutex;
+    std::atomic<std::thread::id> m_io_owner;
+    uint32_t m_io_depth;
+
+    // serializes start_worker and stop_worker
+    std::mutex m_worker_ctl;
+
+    // worker thread. The semaphore is posted once per queued job. m_producers
+    // counts the threads inside enqueue, so that stop_worker can wait for them
+    // before queuing the stop request and destroying the semaphore
+    std::thread m_worker;
+    std::atomic<std::thread::id> m_worker_id;
+    std::atomic<bool> m_worker_run;
+    std::atomic<int> m_producers;
+    bool m_worker_stop;   ///< only touched by the worker
+    sem_t m_worker_sem;
+    MPSCQueue<std::function<void()> > m_jobs;
 
 
   private:
 
+    void worker_loop();
+
     Device (const Device &other) = delete;
     Device (Device &&other) = delete;
     Device& operator= (const Device &other) = delete;
@@ -0,0 +1,89 @@
+/*
+ * DeviceProbe.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Finds out which instrument sits behind each serial port, by asking.
+ */
+
+#ifndef INCLUDE_DEVICEPROBE_HH_
+#define INCLUDE_DEVICEPROBE_HH_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+namespace device
+{
+
+  /// what answered on a port
+  struct ProbeResult
+  {
+    enum Kind {Unknown=0, Ophir=1, Surelite=2, Attenuator=3};
+
+    ProbeResult () : kind(Unknown), elapsed_ms(0.0) {}
+
+    std::string port;
+    Kind kind;
+    /// as reported by the instrument: the Ophir meter ($II) or the attenuator
+    /// controller (n). The Surelite has none
+    std::string serial_number;
+    /// USB serial number of the adapter ("" if not a USB port)
+    std::string adapter_serial;
+    /// identification answers, for the logs
+    std::string info;
+    /// why the port could not be probed ("" if it was)
+    std::string error;
+    double elapsed_ms;
+
+    static const char *kind_name(const Kind k);
+  };
+
+  /**
+   * Identifies the instruments on a set of ports, all at once.
+   *
+   * Every port is opened and handed to a Reactor, which then runs the
+   * identification sequence on all of them concurrently. On each port, until
+   * one answers:
+   *   9600 baud   Ophir     $II (then $HI, for the head)
+   *   9600 baud   Surelite  SE
+   *   38400 baud  attenuator n
+   * Only queries are sent. Each gets a short deadline, and a stray '\r'
+   * goes before the Surelite and attenuator queries, to clear whatever the
+   * previous one left in their input buffer. The whole probe then takes at
+   * most the three deadlines, whatever the number of ports.
+   *
+   * Ports in use by a driver must be left out: their traffic would get
+   * mixed with the probe's.
+   */
+  class DeviceProbe
+  {
+  public:
+    DeviceProbe () : m_deadline_ms(200), m_gap_ms(20) {}
+    virtual ~DeviceProbe () {}
+
+    /// how long each query waits for its answer
+    void set_deadline_ms(const uint32_t ms) {m_deadline_ms = ms;}
+    uint32_t get_deadline_ms() const {return m_deadline_ms;}
+
+    /// results by port
+    std::map<std::string,ProbeResult> probe(const std::vector<std::string> &ports);
+    /// probe every port in util::PortIndex
+    std::map<std::string,ProbeResult> probe_all();
+
+  private:
+    DeviceProbe (const DeviceProbe &other) = delete;
+    DeviceProbe (DeviceProbe &&other) = delete;
+    DeviceProbe& operator= (const DeviceProbe &other) = delete;
+    DeviceProbe& operator= (DeviceProbe &&other) = delete;
+
+    uint32_t m_deadline_ms;
+    // between the clearing '\r' and the query, for the echo to come and be flushed
+    uint32_t m_gap_ms;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_DEVICEPROBE_HH_ */
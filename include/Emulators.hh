@@ -0,0 +1,234 @@
+/*
+ * Emulators.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Wire level models of the instruments: what the Surelite controller,
+ *      the Ophir Vega and the attenuator controller send back, byte for byte,
+ *      for what the drivers write. Served on a pty (PtyServer) or in process
+ *      (LoopbackTransport).
+ */
+
+#ifndef INCLUDE_EMULATORS_HH_
+#define INCLUDE_EMULATORS_HH_
+
+#include <Transport.hh>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <random>
+#include <mutex>
+
+namespace device
+{
+
+  /**
+   * Surelite controller. Commands end in '\r' and are echoed back as they
+   * arrive; the queries (SE, SC) then send their answer, also '\r'
+   * terminated. Setters only get the echo.
+   *
+   * The shot count runs at the repetition rate while firing.
+   */
+  class SureliteModel : public ScriptedModel
+  {
+  public:
+    SureliteModel ();
+    virtual ~SureliteModel () {}
+
+    /// two digit code answered to SE ("00" is normal)
+    void set_security(const std::string &code) {m_security = code;}
+
+    uint64_t shot_count();
+    bool firing() const {return m_firing;}
+    bool shutter_open() const {return m_shutter;}
+    uint32_t prescale() const {return m_prescale;}
+    double pump_hv() const {return m_hv;}
+    double rate() const {return m_rate;}
+    uint32_t qswitch() const {return m_qswitch;}
+
+  protected:
+    virtual void answer(const std::string &cmd, std::string &reply) override;
+
+  private:
+    void count_shots();
+
+    std::string m_security;
+    bool m_firing;
+    bool m_shutter;
+    uint32_t m_prescale;
+    double m_hv;
+    double m_rate;
+    uint32_t m_qswitch;
+    double m_shots;
+    uint64_t m_last_ns;
+  };
+
+  /**
+   * Ophir Vega with a pyroelectric head, in energy mode. Commands come with
+   * the '$' prefix and "\r\n"; answers are "*..." or, for errors, "?...",
+   * terminated by "\r\n".
+   *
+   * The head sees pulses at a set rate, with a gaussian spread around a mean
+   * energy. EF flags a pulse not yet read out with SE.
+   */
+  class VegaModel : public ScriptedModel
+  {
+  public:
+    VegaModel ();
+    virtual ~VegaModel () {}
+
+    /**
+     * Pulses seen by the head.
+     * @param rate_hz pulse rate (0: none)
+     * @param energy_j mean energy, in J
+     * @param spread relative sigma of the energies
+     */
+    void set_pulses(const double rate_hz, const double energy_j, const double spread = 0.02);
+
+    uint64_t pulses() const {return m_pulses;}
+
+  protected:
+    virtual void answer(const std::string &cmd, std::string &reply) override;
+
+  private:
+    void take_pulses();
+    void ok(std::string &reply, const std::string &data = "");
+    void error(std::string &reply, const std::string &what);
+
+    // settings
+    int32_t m_range;
+    uint32_t m_wavelength;
+    uint32_t m_average;
+    uint32_t m_bc20;
+    uint32_t m_mains;
+    uint32_t m_mode;
+    uint32_t m_pulse_length;
+    uint32_t m_threshold;
+    uint32_t m_e_threshold;
+    std::vector<std::string> m_wavelengths;
+    // the beam
+    double m_rate;
+    double m_energy;
+    double m_spread;
+    std::mt19937_64 m_rng;
+    // the readings
+    uint64_t m_next_ns;
+    uint64_t m_pulses;
+    double m_last;
+    bool m_new;
+    double m_exposure;
+    uint64_t m_exposure_pulses;
+    uint64_t m_exposure_start_ns;
+  };
+
+  /**
+   * Attenuator (stepper) controller. Commands end in '\r'; answers start
+   * with the command letters and end in "\n\r", with the fields separated
+   * by ';'. Setters are not answered.
+   *
+   * Moves run at the maximum speed, in steps per second.
+   */
+  class AttenuatorModel : public ScriptedModel
+  {
+  public:
+    AttenuatorModel ();
+    virtual ~AttenuatorModel () {}
+
+    int32_t position();
+    bool moving();
+    const std::string &name() const {return m_name;}
+
+  protected:
+    virtual void answer(const std::string &cmd, std::string &reply) override;
+
+  private:
+    void move_to(const int64_t target);
+    void stop_here();
+
+    int64_t m_from;
+    int64_t m_target;
+    uint64_t m_move_start_ns;
+    uint32_t m_max_speed;
+    uint32_t m_acceleration;
+    uint32_t m_deceleration;
+    uint32_t m_current_move;
+    uint32_t m_current_idle;
+    uint32_t m_resolution;
+    bool m_enabled;
+    std::string m_name;
+  };
+
+  /**
+   * Faults a FaultyModel injects, as the probability of each per reply.
+   * At most one fault hits a reply; they are drawn in the order below.
+   */
+  struct FaultProfile
+  {
+    double drop;            ///< the reply is never sent
+    double garble;          ///< a few bytes of the reply are replaced
+    double partial;         ///< the reply is cut short, before its terminator
+    double delay;           ///< the reply is held back delay_ms
+    double error;           ///< the reply is replaced by error_reply
+    double disconnect;      ///< the device is gone for disconnect_ms: it takes no
+                            ///< input and sends nothing
+    uint32_t delay_ms;
+    uint32_t disconnect_ms;
+    std::string error_reply;
+
+    FaultProfile ()
+      : drop(0.0), garble(0.0), partial(0.0), delay(0.0), error(0.0), disconnect(0.0),
+        delay_ms(500), disconnect_ms(2000), error_reply("?ERROR\r\n") {}
+  };
+
+  /// what a FaultyModel did so far
+  struct FaultCounts
+  {
+    uint64_t replies;
+    uint64_t dropped;
+    uint64_t garbled;
+    uint64_t partial;
+    uint64_t delayed;
+    uint64_t errors;
+    uint64_t disconnects;
+    uint64_t lost_input;    ///< bytes that came while disconnected
+
+    uint64_t faults() const {return dropped + garbled + partial + delayed + errors + disconnects;}
+  };
+
+  /**
+   * Puts faults between a model and the line, to measure how the drivers
+   * recover. The profile can be changed while serving.
+   */
+  class FaultyModel : public DeviceModel
+  {
+  public:
+    FaultyModel (std::shared_ptr<DeviceModel> model, const FaultProfile &profile = FaultProfile(),
+                 const uint64_t seed = 0x5eed);
+    virtual ~FaultyModel () {}
+
+    void set_profile(const FaultProfile &profile);
+    FaultCounts counts() const;
+    void reset_counts();
+
+    virtual void receive(const char *data, const size_t len, std::string &reply) override;
+    virtual uint64_t reply_delay_ns() override {return m_delay_ns;}
+
+  private:
+    FaultyModel (const FaultyModel &other) = delete;
+    FaultyModel (FaultyModel &&other) = delete;
+    FaultyModel& operator= (const FaultyModel &other) = delete;
+    FaultyModel& operator= (FaultyModel &&other) = delete;
+
+    std::shared_ptr<DeviceModel> m_model;
+    FaultProfile m_profile;
+    FaultCounts m_counts;
+    std::mt19937_64 m_rng;
+    uint64_t m_dead_until_ns;
+    uint64_t m_delay_ns;
+    mutable std::mutex m_mutex;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_EMULATORS_HH_ */
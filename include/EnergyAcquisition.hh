@@ -0,0 +1,434 @@
+/*
+ * EnergyAcquisition.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Background acquisition of energy readings from a power meter.
+ */
+
+#ifndef INCLUDE_ENERGYACQUISITION_HH_
+#define INCLUDE_ENERGYACQUISITION_HH_
+
+#include <SampleRing.hh>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cerrno>
+#include <ctime>
+#include <exception>
+#include <chrono>
+#include <algorithm>
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  /// One energy reading
+  struct EnergySample
+  {
+    uint64_t timestamp_ns;  ///< CLOCK_MONOTONIC, taken when the reading came in
+    double energy;          ///< energy of the pulse (or of all the pulses, in exposure mode)
+    uint32_t pulses;        ///< pulses in this sample: 1, or the pulses accumulated by the meter since the previous sample
+  };
+
+  /**
+   * Polls a power meter from a dedicated thread and publishes every new reading,
+   * timestamped, into a SampleRing. Any number of consumers can follow the
+   * stream with their own SampleRing::Reader without ever blocking the poller.
+   *
+   * The meter only needs a `bool read_energy(double &)` method, so this works
+   * the same with PowerMeter and PowerMeterSim.
+   *
+   * By default the meter is polled back to back (the rate is set by the round
+   * trip of the queries). A minimum poll period can be set for meters that
+   * always report a new value (e.g. the simulator).
+   *
+   * Adaptive polling: once the pulse period is known, either given with
+   * set_pulse_rate() (Laser::get_output_rate(), PowerMeter::send_frequency)
+   * or measured from the intervals between new readings, the poller sleeps
+   * until shortly before the next expected pulse and only then polls until the
+   * reading comes in. Every hit re-anchors the schedule, so the phase does not
+   * drift. If no pulse shows up within one period past the expected time, it
+   * falls back to continuous polling until the next hit.
+   *
+   * Exposure mode (set_auto_exposure): when the pulse rate gets too close to
+   * what the EF/SE polling can sustain (measured from the query round trips),
+   * or above the sensor limit (MF), pulses would be lost. The engine then
+   * switches the meter to exposure mode (FX) and reads the accumulated energy
+   * and pulse count (EE) every exposure period, publishing one sample per read.
+   * When the pulse rate drops well below the limit it switches back (FE).
+   * The meter then also needs force_exposure, force_energy, exposure_energy
+   * and max_freq.
+   *
+   * Typical usage:
+   *   EnergyAcquisition<PowerMeter> acq(meter);
+   *   acq.start();
+   *   EnergyAcquisition<PowerMeter>::Ring::Reader rd(acq.ring());
+   *   EnergySample s;
+   *   while (rd.pop(s)) {...}
+   */
+  template <typename Meter, size_t N = 4096>
+  class EnergyAcquisition
+  {
+  public:
+    typedef SampleRing<EnergySample,N> Ring;
+
+    explicit EnergyAcquisition (Meter &meter, const uint32_t min_period_us = 0)
+      : m_meter(meter),
+        m_min_period_us(min_period_us),
+        m_run(false),
+        m_fixed_period_ns(0),
+        m_period_ns(0),
+        m_auto_exposure(false),
+        m_exposure_period_ms(200),
+        m_in_exposure(false),
+        m_polls(0),
+        m_errors(0),
+        m_expected(0),
+        m_last_hit(0),
+        m_measured(0),
+        m_rt_ns(0),
+        m_max_freq(0),
+        m_exposure_unsupported(false),
+        m_ee_energy(0.0),
+        m_ee_pulses(0),
+        m_ee_time(0)
+    {}
+
+    virtual ~EnergyAcquisition ()
+    {
+      stop();
+    }
+
+    void start()
+    {
+      if (m_run.load())
+      {
+        return;
+      }
+      m_run = true;
+      m_thread = std::thread(&EnergyAcquisition::poll_loop,this);
+    }
+
+    void stop()
+    {
+      m_run = false;
+      if (m_thread.joinable())
+      {
+        m_thread.join();
+      }
+    }
+
+    bool is_running() const {return m_run.load();}
+
+    /// Only change while stopped
+    void set_min_period_us(const uint32_t us) {m_min_period_us = us;}
+
+    /**
+     * Expected pulse rate (Hz). 0 (default) measures it from the readings.
+     * Can be changed at any time, e.g. when the laser settings change.
+     */
+    void set_pulse_rate(const double hz)
+    {
+      m_fixed_period_ns = (hz > 0.0) ? static_cast<uint64_t>(1e9/hz) : 0;
+    }
+    /// pulse period in use (0: not known yet)
+    uint64_t get_period_ns() const {return m_period_ns.load();}
+
+    /// Switch to exposure mode automatically at high pulse rates. Only change while stopped
+    void set_auto_exposure(const bool a) {m_auto_exposure = a;}
+    /// interval between exposure reads (EE). Only change while stopped
+    void set_exposure_period_ms(const uint32_t ms) {m_exposure_period_ms = ms;}
+    bool in_exposure_mode() const {return m_in_exposure.load();}
+
+    const Ring &ring() const {return m_ring;}
+
+    /// queries issued, new readings and failed queries so far
+    uint64_t get_polls() const {return m_polls.load();}
+    uint64_t get_samples() const {return m_ring.count();}
+    uint64_t get_errors() const {return m_errors.load();}
+
+    static uint64_t now_ns()
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC,&ts);
+      return static_cast<uint64_t>(ts.tv_sec)*1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+  private:
+    static void sleep_until_ns(const uint64_t t)
+    {
+      struct timespec ts;
+      ts.tv_sec = static_cast<time_t>(t / 1000000000ULL);
+      ts.tv_nsec = static_cast<long>(t % 1000000000ULL);
+      while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,nullptr) == EINTR)
+      {
+      }
+    }
+
+    void poll_loop()
+    {
+      m_expected = 0;
+      m_last_hit = 0;
+      m_measured = 0;
+      m_rt_ns = 0;
+      m_max_freq = 0;
+      m_exposure_unsupported = false;
+      if (m_auto_exposure)
+      {
+        try
+        {
+          m_meter.max_freq(m_max_freq);
+        }
+        catch(std::exception &e)
+        {
+          // no sensor limit then. The polling capacity still applies
+          m_max_freq = 0;
+        }
+      }
+      // earliest time of the next query (minimum poll period)
+      uint64_t next_poll = now_ns();
+      while (m_run.load())
+      {
+        if (m_in_exposure.load())
+        {
+          exposure_step();
+          continue;
+        }
+        const uint64_t fixed = m_fixed_period_ns.load();
+        const uint64_t period = (fixed > 0) ? fixed : m_measured;
+        m_period_ns = period;
+        uint64_t wake = next_poll;
+        if (period > 0 && m_expected > 0)
+        {
+          // start polling a bit ahead of the pulse, to absorb jitter
+          const uint64_t guard = std::max<uint64_t>(2000000ULL,period/20);
+          if (m_expected - guard > wake)
+          {
+            wake = m_expected - guard;
+          }
+        }
+        if (wake > now_ns())
+        {
+          sleep_until_ns(wake);
+        }
+        const uint64_t start = now_ns();
+        next_poll = start + static_cast<uint64_t>(m_min_period_us)*1000ULL;
+        double energy = 0.0;
+        bool fresh = false;
+        try
+        {
+          fresh = m_meter.read_energy(energy);
+        }
+        catch(std::exception &e)
+        {
+#ifdef DEBUG
+          std::cout << "EnergyAcquisition::poll_loop : Failed to read energy : " << e.what() << std::endl;
+#endif
+          m_errors++;
+          // do not hammer a meter that is not answering
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          continue;
+        }
+        m_polls++;
+        const uint64_t end = now_ns();
+        // polling capacity: EWMA (1/8) of the query round trip
+        m_rt_ns = (m_rt_ns == 0) ? (end - start) : (m_rt_ns - m_rt_ns/8 + (end - start)/8);
+        if (fresh)
+        {
+          EnergySample s;
+          s.timestamp_ns = end;
+          s.energy = energy;
+          s.pulses = 1;
+          m_ring.push(s);
+          // the pulse came before this query was sent
+          if (m_last_hit > 0)
+          {
+            const uint64_t interval = start - m_last_hit;
+            if (m_measured == 0)
+            {
+              m_measured = interval;
+            }
+            else if (interval > m_measured/2 && interval < m_measured + m_measured/2)
+            {
+              // EWMA (1/8). Intervals spanning missed pulses are ignored
+              m_measured = m_measured - m_measured/8 + interval/8;
+            }
+            else if (fixed == 0 && m_expected == 0)
+            {
+              // not locked and way off: the rate changed. Start over
+              m_measured = interval;
+            }
+          }
+          m_last_hit = start;
+          m_expected = (period > 0) ? start + period : 0;
+        }
+        else if (m_expected > 0 && period > 0 && start > m_expected + period)
+        {
+          // the pulse did not show up: poll continuously until it does
+#ifdef DEBUG
+          std::cout << "EnergyAcquisition::poll_loop : Lost the pulse train. Polling continuously." << std::endl;
+#endif
+          m_expected = 0;
+        }
+        if (m_auto_exposure && !m_exposure_unsupported && period > 0 && (period < min_pulse_period_ns()))
+        {
+          enter_exposure();
+        }
+      }
+      if (m_in_exposure.load())
+      {
+        leave_exposure();
+      }
+    }
+
+    /**
+     * Shortest pulse period that can still be followed pulse by pulse: 25% above
+     * the query round trip, and no faster than the sensor limit
+     */
+    uint64_t min_pulse_period_ns() const
+    {
+      uint64_t p = m_rt_ns + m_rt_ns/4;
+      if (m_max_freq > 0)
+      {
+        p = std::max<uint64_t>(p,1000000000ULL/m_max_freq);
+      }
+      return p;
+    }
+
+    void enter_exposure()
+    {
+      bool success = false;
+      try
+      {
+        m_meter.force_exposure(success);
+        if (success)
+        {
+          // start of the accumulation
+          double e;
+          uint32_t et;
+          m_meter.exposure_energy(e,m_ee_pulses,et);
+          m_ee_energy = e;
+          m_ee_time = now_ns();
+        }
+      }
+      catch(std::exception &e)
+      {
+        m_errors++;
+        success = false;
+      }
+      if (!success)
+      {
+#ifdef DEBUG
+        std::cout << "EnergyAcquisition::enter_exposure : Meter refused exposure mode. Staying with per pulse readings." << std::endl;
+#endif
+        m_exposure_unsupported = true;
+        return;
+      }
+#ifdef DEBUG
+      std::cout << "EnergyAcquisition::enter_exposure : Pulse period " << m_period_ns.load() << " ns is too short. Switched to exposure mode." << std::endl;
+#endif
+      m_in_exposure = true;
+    }
+
+    void leave_exposure()
+    {
+      bool success = false;
+      try
+      {
+        m_meter.force_energy(success);
+      }
+      catch(std::exception &e)
+      {
+        m_errors++;
+      }
+      m_in_exposure = false;
+      // the pulse train has to be found again
+      m_expected = 0;
+      m_last_hit = 0;
+      m_measured = 0;
+#ifdef DEBUG
+      std::cout << "EnergyAcquisition::leave_exposure : Back to per pulse readings (" << success << ")" << std::endl;
+#endif
+    }
+
+    void exposure_step()
+    {
+      sleep_until_ns(m_ee_time + static_cast<uint64_t>(m_exposure_period_ms)*1000000ULL);
+      double energy = 0.0;
+      uint32_t pulses = 0;
+      uint32_t et = 0;
+      try
+      {
+        m_meter.exposure_energy(energy,pulses,et);
+      }
+      catch(std::exception &e)
+      {
+        m_errors++;
+        m_ee_time = now_ns();
+        return;
+      }
+      m_polls++;
+      const uint64_t now = now_ns();
+      // the meter accumulates. A smaller count means that it started over
+      const bool restarted = (pulses < m_ee_pulses);
+      const uint32_t dp = restarted ? pulses : (pulses - m_ee_pulses);
+      const double de = restarted ? energy : (energy - m_ee_energy);
+      const uint64_t dt = now - m_ee_time;
+      m_ee_energy = energy;
+      m_ee_pulses = pulses;
+      m_ee_time = now;
+      if (dp > 0)
+      {
+        EnergySample s;
+        s.timestamp_ns = now;
+        s.energy = de;
+        s.pulses = dp;
+        m_ring.push(s);
+      }
+      // pulse period seen by the meter. Go back with some hysteresis
+      const uint64_t period = (dp > 0) ? dt/dp : 0;
+      m_period_ns = period;
+      if (!m_auto_exposure || period == 0 || period > 2*min_pulse_period_ns())
+      {
+        leave_exposure();
+      }
+    }
+
+    EnergyAcquisition (const EnergyAcquisition &other) = delete;
+    EnergyAcquisition (EnergyAcquisition &&other) = delete;
+    EnergyAcquisition& operator= (const EnergyAcquisition &other) = delete;
+    EnergyAcquisition& operator= (EnergyAcquisition &&other) = delete;
+
+    Meter &m_meter;
+    uint32_t m_min_period_us;
+    std::atomic<bool> m_run;
+    std::thread m_thread;
+    std::atomic<uint64_t> m_fixed_period_ns;
+    std::atomic<uint64_t> m_period_ns;
+    bool m_auto_exposure;
+    uint32_t m_exposure_period_ms;
+    std::atomic<bool> m_in_exposure;
+    std::atomic<uint64_t> m_polls;
+    std::atomic<uint64_t> m_errors;
+    Ring m_ring;
+
+    // poller state, only touched by the poll thread
+    uint64_t m_expected;    ///< expected time of the next pulse (0: unknown)
+    uint64_t m_last_hit;
+    uint64_t m_measured;    ///< pulse period measured from the hits
+    uint64_t m_rt_ns;       ///< query round trip
+    uint32_t m_max_freq;    ///< sensor limit (MF), 0 if unknown
+    bool m_exposure_unsupported;
+    double m_ee_energy;     ///< last exposure reading
+    uint32_t m_ee_pulses;
+    uint64_t m_ee_time;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_ENERGYACQUISITION_HH_ */
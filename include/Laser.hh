@@ -44,7 +44,11 @@ public:
   enum Security{Normal=0,NoSerial=1,BadFlow=2,OverTemp=3,NotUsed=4,LaserHead=5,ExtInterlock=6,ChargePileUp=7,SimmerFail=8,FlowSwitch=9};
 
   Laser () {};
-  Laser (const char* port, const uint32_t baud_rate = 9600);
+  /**
+   * @param transport link to use instead of the serial port (e.g., a
+   *        LoopbackTransport). The device takes ownership
+   */
+  Laser (const char* port, const uint32_t baud_rate = 9600, Transport *transport = nullptr);
   virtual ~Laser ();
 
   /**
@@ -127,6 +131,20 @@ public:
    */
   void set_qswitch(uint32_t qs);
 
+  /**
+   * Rate (Hz) at which pulses leave the laser, based on the repetition rate
+   * and the prescale that were last set: every pre-th shot is extracted
+   * (a prescale of 0 or 1 extracts every shot).
+   */
+  float get_output_rate() const;
+
+  /**
+   * Asynchronous versions of the queries. These return immediately and
+   * deliver the answer (or the exception) through the future.
+   */
+  std::future<std::string> async_security();
+  std::future<uint32_t> async_get_shot_count();
+
 
   //void set_timeout_ms(uint32_t t);
 
@@ -138,6 +156,11 @@ private:
   bool write_cmd(const std::string cmd);
   bool read_cmd(std::string &answer);
 
+  /// Shape of the answer to the queries (SE, SC): the controller echoes the
+  /// command and then sends the answer, each line terminated by '\r'.
+  /// Reads complete as soon as both lines are in.
+  static const size_t m_query_answer_lines = 2;
+
   // disallow any kind of copy constructor or assignment operators
   Laser (Laser &&other) = delete;
   Laser (const Laser &other) = delete;
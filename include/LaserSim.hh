@@ -68,6 +68,7 @@ namespace device
 
     void set_qswitch(uint32_t qs);
 
+    float get_output_rate() const;
 
   private:
 
@@ -0,0 +1,99 @@
+/*
+ * MPSCQueue.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Unbounded multi-producer, single-consumer queue (D. Vyukov's
+ *      node based design). Producers never block each other: a push is a
+ *      single atomic exchange plus a store.
+ */
+
+#ifndef INCLUDE_MPSCQUEUE_HH_
+#define INCLUDE_MPSCQUEUE_HH_
+
+#include <atomic>
+#include <utility>
+
+namespace device
+{
+
+  /**
+   * Lock-free queue with any number of producers and exactly one consumer.
+   *
+   * push() can be called concurrently from any thread. pop() and empty() must
+   * only be called from the consumer thread.
+   *
+   * Note that pop() may transiently report an empty queue while a producer is
+   * in the middle of a push (between the exchange and the link). Consumers that
+   * know an element is coming (e.g. because they were signaled) should retry.
+   */
+  template <typename T>
+  class MPSCQueue
+  {
+  public:
+    MPSCQueue ()
+    {
+      Node *stub = new Node();
+      m_head.store(stub,std::memory_order_relaxed);
+      m_tail = stub;
+    }
+
+    virtual ~MPSCQueue ()
+    {
+      T discard;
+      while (pop(discard))
+      {
+      }
+      delete m_tail;
+    }
+
+    void push(T value)
+    {
+      Node *n = new Node();
+      n->value = std::move(value);
+      Node *prev = m_head.exchange(n,std::memory_order_acq_rel);
+      // between the exchange and this store the chain is momentarily broken
+      prev->next.store(n,std::memory_order_release);
+    }
+
+    bool pop(T &value)
+    {
+      Node *tail = m_tail;
+      Node *next = tail->next.load(std::memory_order_acquire);
+      if (next == nullptr)
+      {
+        return false;
+      }
+      value = std::move(next->value);
+      // next becomes the new stub
+      m_tail = next;
+      delete tail;
+      return true;
+    }
+
+    bool empty() const
+    {
+      return (m_tail->next.load(std::memory_order_acquire) == nullptr);
+    }
+
+  private:
+    struct Node
+    {
+      Node() : next(nullptr) {}
+      std::atomic<Node*> next;
+      T value;
+    };
+
+    MPSCQueue (const MPSCQueue &other) = delete;
+    MPSCQueue (MPSCQueue &&other) = delete;
+    MPSCQueue& operator= (const MPSCQueue &other) = delete;
+    MPSCQueue& operator= (MPSCQueue &&other) = delete;
+
+    std::atomic<Node*> m_head;  ///< producers side
+    Node *m_tail;               ///< consumer side (the stub)
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_MPSCQUEUE_HH_ */
@@ -0,0 +1,97 @@
+/*
+ * PortIndex.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      In-memory index of the serial ports, kept until /dev changes.
+ */
+
+#ifndef INCLUDE_PORTINDEX_HH_
+#define INCLUDE_PORTINDEX_HH_
+
+#include <serial/serial.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <mutex>
+
+namespace util
+{
+
+  /**
+   * serial::list_ports() globs /dev and reads a handful of sysfs files per
+   * port, every time. The index does it once and keeps the result until a
+   * serial device node is created or removed in /dev (inotify). Lookups only
+   * check for pending inotify events (a non-blocking read) before going to
+   * the hash maps.
+   *
+   * Ports are indexed by path, description, hardware id and USB serial
+   * number. A key that matches none of them exactly is searched as a
+   * substring of those fields, as find_port always did, over the cached list.
+   *
+   * If inotify is not available the list is rebuilt on every lookup.
+   * Thread safe.
+   */
+  class PortIndex
+  {
+  public:
+    /// index shared by the whole process
+    static PortIndex &instance();
+
+    PortIndex ();
+    virtual ~PortIndex ();
+
+    /**
+     * Port matching key (see above). If several do, the first one listed.
+     * @return false if none does
+     */
+    bool find(const std::string &key, serial::PortInfo &info);
+    std::vector<serial::PortInfo> ports();
+
+    /// force a rescan on the next lookup
+    void invalidate();
+    /**
+     * Wait until a serial device node comes or goes (hot plug), or return at
+     * once if one did since the last lookup.
+     * @return false on timeout, or if there is no inotify to wait on
+     */
+    bool wait_change(const uint32_t timeout_ms);
+
+    /// number of scans so far
+    uint64_t scans() const;
+    bool watching() const {return (m_inotify != -1);}
+
+  private:
+    PortIndex (const PortIndex &other) = delete;
+    PortIndex (PortIndex &&other) = delete;
+    PortIndex& operator= (const PortIndex &other) = delete;
+    PortIndex& operator= (PortIndex &&other) = delete;
+
+    typedef std::unordered_map<std::string,size_t> Map;
+
+    /// read the pending events; invalidates if any is about a serial port.
+    /// Called with the mutex held
+    void drain();
+    /// rescan if needed. Called with the mutex held
+    void refresh();
+    static void add_key(Map &m, const std::string &key, const size_t idx);
+
+    int m_inotify;
+    bool m_valid;
+    uint64_t m_scans;
+    std::vector<serial::PortInfo> m_ports;
+    Map m_by_port;
+    Map m_by_description;
+    Map m_by_hardware_id;
+    Map m_by_serial;
+    mutable std::mutex m_mutex;
+  };
+
+  /// USB serial number in a hardware id ("USB VID:PID=0403:6001 SNR=A9J0G3SV"), or ""
+  std::string serial_number(const std::string &hardware_id);
+
+} /* namespace util */
+
+#endif /* INCLUDE_PORTINDEX_HH_ */
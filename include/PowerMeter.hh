@@ -11,6 +11,7 @@
 
 #include <vector>
 #include <map>
+#include <string>
 #include <mutex>
 #include <Device.hh>
 
@@ -40,8 +41,43 @@ public:
   // NOTE: Only the measurements valid for Vega instrument are implemented
   enum MeasurementMode{mmQuery=0,mmPassive=1,mmPower=2,mmEnergy=3,mmExposure=4};
 
+  /**
+   * What the instrument and its head can do (see load_capabilities).
+   * Only the firmware or a different head changes any of it
+   */
+  struct Capabilities
+  {
+    Capabilities () : head_word(0), threshold_ranges(0xFFFF,0xFFFF) {}
+
+    // VE
+    std::string firmware;
+    // II
+    std::string inst_id;
+    std::string inst_sn;
+    std::string inst_name;
+    // HI
+    std::string head_type;
+    std::string head_sn;
+    std::string head_name;
+    uint32_t head_word;
+    // AR (without the current setting)
+    std::map<int16_t,std::string> ranges;
+    // PL
+    std::map<uint16_t,std::string> pulse_lengths;
+    // AQ
+    std::map<uint16_t,std::string> ave_windows;
+    // UT : min, max
+    std::pair<uint16_t, uint16_t> threshold_ranges;
+    // AW, raw. The current selection in it is the one at the time of the query
+    std::string wavelengths;
+  };
+
   PowerMeter () { };
-  PowerMeter (const char* port, const uint32_t baud_rate = 9600);
+  /**
+   * @param transport link to use instead of the serial port (e.g., a
+   *        LoopbackTransport). The device takes ownership
+   */
+  PowerMeter (const char* port, const uint32_t baud_rate = 9600, Transport *transport = nullptr);
   virtual ~PowerMeter ();
 
   /**
@@ -211,8 +247,16 @@ public:
 
 
   // Wrapper method that combines EF and SE
+  // In pipelined mode both queries are sent in a single round trip. A pulse
+  // that lands between the two makes EF say 0 while SE already has it (and
+  // clears the flag): an SE value that differs from the last one returned
+  // is then reported as new. A pulse of exactly the same energy is missed.
   bool read_energy(double &energy);
 
+  // Asynchronous version of read_energy
+  // first: whether there was a new reading, second: the energy
+  std::future<std::pair<bool,double> > async_read_energy();
+
   // SF
   // Send frequency : Queries device for frequency at which the laser is firing.
   void send_frequency(double &value);
@@ -308,12 +352,47 @@ public:
   void get_averages_map(std::map<uint16_t,std::string> &r) {r = m_ave_windows;}
   const std::pair<uint16_t, uint16_t> get_threshold_ranges() const {return m_threshold_ranges;}
 
+  /**
+   * Fills the maps above (and the capabilities) without querying them all.
+   *
+   * The static metadata takes a handful of round trips (AR, AW, AQ, PL, UT)
+   * on every start. Instead, a single batch (VE, II and HI, pipelined)
+   * identifies the instrument and the head, and the rest is read from
+   * <cache_dir>/ophir_<instrument S/N>_<head S/N>.cap if the firmware
+   * version recorded there is the same. Otherwise everything is queried and
+   * the file is (re)written. A head swap thus picks a different file.
+   *
+   * @param cache_dir where the files go. Created if needed. Empty: no cache
+   * @return true if the capabilities came from the cache
+   */
+  bool load_capabilities(const std::string &cache_dir);
+  const Capabilities &get_capabilities() const {return m_caps;}
+
+  /**
+   * Pipelined queries.
+   *
+   * Write all commands back to back and then collect the answers, which the
+   * instrument sends in the same order. A batch costs about one round trip
+   * instead of one per command. Answers are trimmed as in send_cmd.
+   *
+   * @param cmds commands, without prefix/suffix
+   * @param resps answers, one per command
+   * @return false if not all answers arrived
+   */
+  bool send_cmds(const std::vector<std::string> &cmds, std::vector<std::string> &resps, bool repeat = true);
+
+  // use pipelining in the composite queries (read_energy). Off by default
+  void set_pipelined(const bool p) {m_pipelined = p;}
+  bool get_pipelined() const {return m_pipelined;}
+
 private:
 
   bool send_cmd(const std::string cmd, std::string &resp, bool repeat = true);
   void init_pulse_lengths();
-
-  std::mutex m_cmd_mutex;
+  // the capability cache file. false if it is not there, unreadable or not for this firmware
+  bool read_capabilities(const std::string &path, Capabilities &caps);
+  // false if it could not be written (the cache is then just not used)
+  bool write_capabilities(const std::string &path, const Capabilities &caps);
 
   MeasurementMode m_mmode;
   int16_t m_range;
@@ -332,8 +411,12 @@ private:
 
   std::map<char,std::string> m_measurement_units;
   std::pair<uint16_t, uint16_t> m_threshold_ranges;
+  Capabilities m_caps;
 
-  uint16_t m_interval_between_cmds_ms;
+  bool m_pipelined;
+  // last energy returned by read_energy, to catch the pulses EF missed
+  bool m_have_last_energy;
+  double m_last_energy;
 };
 
 }
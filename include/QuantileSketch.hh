@@ -0,0 +1,86 @@
+/*
+ * QuantileSketch.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      KLL streaming quantile sketch (Karnin, Lang, Liberty 2016).
+ */
+
+#ifndef INCLUDE_QUANTILESKETCH_HH_
+#define INCLUDE_QUANTILESKETCH_HH_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace device
+{
+
+  /**
+   * Approximate quantiles of a stream in bounded memory.
+   *
+   * The sketch keeps a stack of compactors: level h holds items that stand for
+   * 2^h samples each. When a level fills up it is sorted and every other item
+   * (random offset) moves one level up. With the default k = 200 the rank error
+   * is around 1.5% and the sketch holds a few hundred doubles, no matter how
+   * many samples went in. Updates are amortized O(1).
+   *
+   * Sketches merge: the result is as good as a single sketch over both streams,
+   * so runs and systems can be combined. serialize() / deserialize() move
+   * sketches between processes (native byte order).
+   */
+  class QuantileSketch
+  {
+  public:
+    explicit QuantileSketch (const uint32_t k = 200);
+    virtual ~QuantileSketch () {}
+
+    void add(const double x);
+    void merge(const QuantileSketch &other);
+    void reset();
+
+    uint64_t count() const {return m_n;}
+    bool empty() const {return (m_n == 0);}
+    double min() const {return m_min;}
+    double max() const {return m_max;}
+
+    /**
+     * Value below which a fraction q of the samples fall.
+     * @param q in [0,1]. 0 and 1 give the exact min and max
+     */
+    double quantile(const double q) const;
+    /// several quantiles in one pass (sorted or not)
+    std::vector<double> quantiles(const std::vector<double> &qs) const;
+    /// fraction of the samples <= x
+    double rank(const double x) const;
+
+    /// number of items actually retained
+    size_t retained() const;
+
+    void serialize(std::string &out) const;
+    /// @throws std::runtime_error if the data is not a valid sketch
+    void deserialize(const std::string &in);
+
+  private:
+    uint32_t capacity(const size_t level) const {return m_capacities[level];}
+    /// recompute the level capacities (after the number of levels changed)
+    void update_capacities();
+    void compress();
+    void compact(const size_t level);
+    bool coin();
+
+    uint32_t m_k;
+    uint64_t m_n;
+    double m_min;
+    double m_max;
+    size_t m_size;          ///< items in all the levels
+    uint64_t m_rng;         ///< xorshift state for the compaction offsets
+    std::vector<std::vector<double> > m_levels;
+    std::vector<uint32_t> m_capacities;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_QUANTILESKETCH_HH_ */
@@ -0,0 +1,100 @@
+/*
+ * QueryCache.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Read-through cache of the answers to slow device queries.
+ */
+
+#ifndef INCLUDE_QUERYCACHE_HH_
+#define INCLUDE_QUERYCACHE_HH_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <mutex>
+
+namespace device
+{
+
+  /**
+   * Answers to queries that rarely change (serial numbers, versions, the
+   * units of the current mode...), kept so that asking again does not cost
+   * a round trip on the serial line.
+   *
+   * Each device declares its rules once, when it is built:
+   *   cache(query, ttl)            the answer to query is good for ttl ms
+   *   invalidate_on(cmd, queries)  sending cmd makes those answers stale
+   *   clear_on(cmd)                sending cmd makes every answer stale
+   * Commands are matched by their mnemonic (up to the first space), so that
+   * "WN 2" falls under "WN". Queries are cached by their full text.
+   *
+   * Device::write_cmd (and the other ways out to the port) report every
+   * command with sent(), which applies the rules. A reconnection clears
+   * everything, as the instrument may not be the same one anymore.
+   *
+   * Thread safe.
+   */
+  class QueryCache
+  {
+  public:
+    /// ttl: keep until invalidated
+    static const uint32_t forever = 0xFFFFFFFF;
+
+    QueryCache ();
+    virtual ~QueryCache () {}
+
+    // rules
+    void cache(const std::string &query, const uint32_t ttl_ms);
+    void invalidate_on(const std::string &cmd, const std::vector<std::string> &queries);
+    void clear_on(const std::string &cmd);
+
+    /**
+     * @return true, and the answer, if query is cached and has not expired
+     */
+    bool lookup(const std::string &query, std::string &answer);
+    /// keep the answer to query (if it is a cached one)
+    void store(const std::string &query, const std::string &answer);
+    /// cmd went out to the instrument: apply the rules
+    void sent(const std::string &cmd);
+    /// drop all the answers (the rules stay)
+    void clear();
+
+    /// off: lookup always misses and nothing is stored
+    void set_enabled(const bool e);
+    bool get_enabled() const;
+
+    /// lookups answered from the cache
+    uint64_t hits() const;
+
+  private:
+    QueryCache (const QueryCache &other) = delete;
+    QueryCache (QueryCache &&other) = delete;
+    QueryCache& operator= (const QueryCache &other) = delete;
+    QueryCache& operator= (QueryCache &&other) = delete;
+
+    struct Entry
+    {
+      Entry () : ttl_ms(0), valid(false), expires_ns(0) {}
+      uint32_t ttl_ms;
+      bool valid;
+      int64_t expires_ns;   ///< steady clock
+      std::string answer;
+    };
+
+    static std::string mnemonic(const std::string &cmd);
+
+    bool m_enabled;
+    std::unordered_map<std::string,Entry> m_entries;
+    std::unordered_map<std::string,std::vector<std::string> > m_invalidates;
+    std::unordered_set<std::string> m_clears;
+    uint64_t m_hits;
+    mutable std::mutex m_mutex;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_QUERYCACHE_HH_ */
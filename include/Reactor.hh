@@ -0,0 +1,171 @@
+/*
+ * Reactor.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Single-threaded event loop (epoll) that drives the serial ports of
+ *      several devices at once. Linux only.
+ */
+
+#ifndef INCLUDE_REACTOR_HH_
+#define INCLUDE_REACTOR_HH_
+
+#include <serial/serial.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace device
+{
+
+  /**
+   * Event-loop transport for serial ports.
+   *
+   * The reactor owns the file descriptors of any number of serial::Serial ports
+   * and multiplexes them with a single epoll instance. Commands are queued per port
+   * and executed one at a time on each port (write, then collect the answer lines),
+   * while all the ports progress concurrently. Each command completes through a
+   * callback, which is always called from the thread running the loop.
+   *
+   * Ports handed to the reactor must not be used directly (read/write) while
+   * registered, otherwise bytes end up split between the two.
+   *
+   * Typical usage:
+   *   Reactor r;
+   *   int id = r.add_port(serial, 50);
+   *   r.submit(id, Reactor::Command("SE\r", "\r", 2, 500, callback));
+   *   r.run(); // in a dedicated thread, stopped with r.stop()
+   */
+  class Reactor
+  {
+  public:
+    typedef std::function<void(bool success, std::vector<std::string> &lines)> Callback;
+
+    struct Command
+    {
+      Command() : lines(0), timeout_ms(0) {}
+      Command(const std::string d, const std::string e, const size_t l, const uint32_t t, Callback cb)
+        : data(d), eol(e), lines(l), timeout_ms(t), done(cb) {}
+
+      std::string data;     ///< bytes to write (prefix and suffix included)
+      std::string eol;      ///< terminator of each answer line
+      size_t lines;         ///< number of lines that make up the answer (0: no answer expected)
+      uint32_t timeout_ms;  ///< deadline for the write, counted from the start of the command, and then
+                            ///< for the complete answer, counted from the end of the write
+      Callback done;        ///< completion callback. Partial lines are passed on timeout
+    };
+
+    Reactor ();
+    virtual ~Reactor ();
+
+    /**
+     * Register an open port with the loop. Any pending input is dropped.
+     *
+     * @param port an open serial port. Must outlive its registration, which
+     *        ends when remove_port returns
+     * @param min_interval_ms minimum interval between the start of two consecutive
+     *        commands on this port (device mandated pacing)
+     * @return port id to be used in submit()
+     */
+    int add_port(serial::Serial &port, const uint32_t min_interval_ms = 0);
+
+    /**
+     * Unregister a port. Pending commands complete with a failure.
+     *
+     * Synchronous: once it returns the loop does not touch the port (or its
+     * file descriptor) anymore, so it can be closed and freed. From another
+     * thread it waits for the loop to get to it; if no thread is running the
+     * loop the removal runs in the caller, and so do the callbacks of the
+     * failed commands. It can also be called from a callback.
+     */
+    void remove_port(const int id);
+
+    /**
+     * Queue a command on a port. Can be called from any thread.
+     */
+    void submit(const int id, const Command &cmd);
+
+    /**
+     * Run the loop until stop() is called.
+     */
+    void run();
+
+    /**
+     * Process the events that are ready, waiting at most timeout_ms for them.
+     * @return false if the reactor was stopped
+     */
+    bool run_once(const int timeout_ms);
+
+    void stop();
+
+    bool is_running() const {return m_running.load();}
+
+  private:
+    typedef std::chrono::steady_clock clock;
+
+    struct Port
+    {
+      int id;
+      serial::Serial *serial;
+      int fd;
+      std::chrono::milliseconds min_interval;
+      clock::time_point next_write;
+      std::deque<Command> queue;
+      // command in progress
+      bool busy;
+      Command current;
+      size_t tx_offset;
+      bool want_write;
+      clock::time_point deadline;   ///< for the write, then (restarted) for the complete answer
+      std::string rx;
+      std::vector<std::string> lines;
+      bool closed;                  ///< unregistered, waiting to be erased
+    };
+
+    Reactor (const Reactor &other) = delete;
+    Reactor (Reactor &&other) = delete;
+    Reactor& operator= (const Reactor &other) = delete;
+    Reactor& operator= (Reactor &&other) = delete;
+
+    void post(std::function<void()> op);
+    void run_posted();
+    void wake();
+
+    /// drop the port from epoll and fail its commands. It stays in m_ports
+    void unregister(Port &p);
+    void start_next(Port &p);
+    void handle_write(Port &p);
+    void handle_read(Port &p);
+    void frame_lines(Port &p);
+    void complete(Port &p, bool success);
+    void update_events(Port &p, bool want_write);
+    int next_timeout_ms(const int limit_ms);
+    void check_timers();
+
+    int m_epoll_fd;
+    int m_wake_fd;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_stop;
+    std::atomic<int> m_next_id;
+
+    std::mutex m_post_mutex;
+    std::vector<std::function<void()> > m_posted;
+
+    // held by whoever runs the loop (or the posted ops), and its thread
+    std::mutex m_loop_mutex;
+    std::atomic<std::thread::id> m_loop_thread;
+
+    std::map<int,Port> m_ports;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_REACTOR_HH_ */
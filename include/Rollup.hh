@@ -0,0 +1,173 @@
+/*
+ * Rollup.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Multi-resolution aggregates (1 s, 1 min, 1 h) of the device metrics
+ *      the application feeds in, persisted to a directory.
+ */
+
+#ifndef INCLUDE_ROLLUP_HH_
+#define INCLUDE_ROLLUP_HH_
+
+#include <EnergyAcquisition.hh>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+namespace device
+{
+
+  /**
+   * Metrics that get rolled up, per device. Rollups::update derives the energy
+   * and the frequency from the acquisition samples; the others are only there
+   * if the application add()s them (e.g. from its own polling of the devices).
+   */
+  enum Metric {MetricEnergy=0, MetricFrequency=1, MetricAttenuatorPosition=2, MetricShotCount=3};
+
+  /// series id of a metric of a device. Device ids are defined by the application
+  inline uint32_t rollup_series(const uint32_t device, const Metric metric)
+  {
+    return (device << 8) | static_cast<uint32_t>(metric);
+  }
+
+  /**
+   * Aggregate of the samples of one series in one time bucket.
+   * Buckets of the same series merge (coarser buckets, several runs).
+   */
+  struct RollupBucket
+  {
+    uint64_t start_ns;
+    uint32_t series;
+    uint32_t reserved;
+    uint64_t count;
+    double min;
+    double max;
+    double sum;
+    double sum2;    ///< sum of squares
+
+    void add(const double x);
+    void merge(const RollupBucket &other);
+    double mean() const {return (count > 0) ? sum / static_cast<double>(count) : 0.0;}
+    double variance() const;
+  };
+
+  /**
+   * Rollups of any number of series at a few fixed resolutions.
+   *
+   * Nothing feeds it on its own: the application hands it the samples of an
+   * EnergyAcquisition (update, or drain on a ring reader of its own) and any
+   * other series through add().
+   *
+   * Every sample goes into the open bucket of its series at each resolution,
+   * O(1). Samples must come in time order (as for the TimeSeriesStore): when
+   * one falls in a later bucket, the open buckets of that resolution are
+   * closed and queued for the file rollup_<width>s.dat in the store directory.
+   * Files are fixed size records in time order, written on flush() or when
+   * enough are queued. Queries binary search the file and add the queued and
+   * open buckets, so they see everything up to the last sample.
+   *
+   * Timestamps are wall clock (CLOCK_REALTIME, ns since the epoch), so that
+   * the files carry on across reboots; update() converts the CLOCK_MONOTONIC
+   * time of the acquisition samples. After a restart the samples resume in
+   * the last bucket on disk, which then has two records: queries merge them.
+   *
+   * One writer; queries can come from any thread.
+   */
+  class Rollups
+  {
+  public:
+    static const uint32_t any_series = 0xFFFFFFFF;
+    static const uint64_t second_ns = 1000000000ULL;
+
+    /**
+     * @param dir directory of the files (created if needed)
+     * @param widths_ns bucket widths, whole seconds. Default 1 s, 1 min, 1 h
+     * @throws std::runtime_error on I/O errors or if a file does not match its width
+     */
+    explicit Rollups (const std::string &dir,
+                      const std::vector<uint64_t> &widths_ns = {second_ns, 60*second_ns, 3600*second_ns});
+    virtual ~Rollups ();
+
+    /**
+     * @param timestamp_ns wall clock (CLOCK_REALTIME)
+     * @return false if the sample is older than the last one (dropped)
+     */
+    bool add(const uint32_t series, const uint64_t timestamp_ns, const double x);
+
+    /**
+     * Energy per pulse and pulse frequency from an acquisition sample, taken
+     * to the wall clock. The frequency needs the previous sample of the same device.
+     */
+    void update(const uint32_t device, const EnergySample &s);
+
+    /// consume whatever is pending on a ring reader
+    template <typename Reader>
+    size_t drain(const uint32_t device, Reader &reader)
+    {
+      size_t n = 0;
+      EnergySample s;
+      while (reader.pop(s))
+      {
+        update(device,s);
+        n++;
+      }
+      return n;
+    }
+
+    /**
+     * Buckets of one resolution that start in [t0, t1], in time order.
+     * @param width_ns one of the widths of the constructor
+     * @return number of buckets added to out
+     * @throws std::runtime_error if there is no such resolution
+     */
+    size_t query(const uint64_t width_ns, const uint64_t t0, const uint64_t t1,
+                 std::vector<RollupBucket> &out, const uint32_t series = any_series) const;
+
+    /// coarsest resolution that still gives at least min_buckets over [t0, t1]
+    uint64_t pick_width(const uint64_t t0, const uint64_t t1, const size_t min_buckets) const;
+
+    const std::vector<uint64_t> &widths() const {return m_widths;}
+
+    /// write the closed buckets out (open buckets stay in memory)
+    void flush();
+
+  private:
+    struct Level
+    {
+      uint64_t width;
+      std::string path;
+      int fd;
+      uint64_t stored;                 ///< buckets in the file
+      uint64_t open_start;
+      std::unordered_map<uint32_t,RollupBucket> open;
+      std::vector<RollupBucket> closed;
+    };
+
+    Rollups (const Rollups &other) = delete;
+    Rollups (Rollups &&other) = delete;
+    Rollups& operator= (const Rollups &other) = delete;
+    Rollups& operator= (Rollups &&other) = delete;
+
+    void open_level(Level &l);
+    void close_buckets(Level &l);
+    void write_closed(Level &l);
+
+    std::string m_dir;
+    std::vector<uint64_t> m_widths;
+    std::vector<Level> m_levels;
+    uint64_t m_last_ts;
+    // CLOCK_REALTIME - CLOCK_MONOTONIC, taken when built
+    int64_t m_mono_to_real_ns;
+    // previous sample of each device, for the frequency
+    std::unordered_map<uint32_t,uint64_t> m_last_sample;
+    mutable std::mutex m_mutex;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_ROLLUP_HH_ */
@@ -0,0 +1,173 @@
+/*
+ * SampleRing.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Single-producer, multi-consumer broadcast ring buffer. Every consumer
+ *      sees every sample (as long as it keeps up), and the producer never
+ *      waits for the consumers: slow readers lose the oldest samples instead.
+ */
+
+#ifndef INCLUDE_SAMPLERING_HH_
+#define INCLUDE_SAMPLERING_HH_
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+namespace device
+{
+
+  /**
+   * Lock-free ring of the last N samples.
+   *
+   * push() must only be called from one thread. Any number of Readers
+   * can consume concurrently, each one with its own position. Every slot is
+   * protected by a sequence counter (seqlock), so a reader that gets lapped
+   * by the producer while copying notices it and skips ahead.
+   *
+   * T must be trivially copyable. N must be a power of 2.
+   */
+  template <typename T, size_t N = 4096>
+  class SampleRing
+  {
+    static_assert((N > 0) && ((N & (N - 1)) == 0), "SampleRing size must be a power of 2");
+    static_assert(std::is_trivially_copyable<T>::value, "SampleRing elements must be trivially copyable");
+
+  public:
+    SampleRing () : m_head(0)
+    {
+      for (size_t i = 0; i < N; i++)
+      {
+        m_slots[i].seq.store(0,std::memory_order_relaxed);
+      }
+    }
+    virtual ~SampleRing () {}
+
+    /// Publish a sample. Single producer only
+    void push(const T &value)
+    {
+      const uint64_t s = m_head.load(std::memory_order_relaxed);
+      Slot &slot = m_slots[s & (N - 1)];
+      // odd: write in progress
+      slot.seq.store(2*s + 1,std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot.value = value;
+      slot.seq.store(2*s + 2,std::memory_order_release);
+      m_head.store(s + 1,std::memory_order_release);
+    }
+
+    /// Total number of samples published so far
+    uint64_t count() const {return m_head.load(std::memory_order_acquire);}
+
+    static constexpr size_t capacity() {return N;}
+
+    /**
+     * Copy the most recent sample.
+     * @return false if nothing was published yet
+     */
+    bool latest(T &value) const
+    {
+      while (true)
+      {
+        const uint64_t h = m_head.load(std::memory_order_acquire);
+        if (h == 0)
+        {
+          return false;
+        }
+        if (read_slot(h - 1,value))
+        {
+          return true;
+        }
+      }
+    }
+
+    /**
+     * Consumer position. Each consumer owns one, and only uses it from one thread.
+     */
+    class Reader
+    {
+    public:
+      /// start from the next sample to be published
+      explicit Reader (const SampleRing &ring) : m_ring(ring), m_cursor(ring.count()), m_lost(0) {}
+
+      /**
+       * Get the next sample, if there is one. Never blocks.
+       * @return false if the reader is up to date
+       */
+      bool pop(T &value)
+      {
+        while (true)
+        {
+          const uint64_t h = m_ring.count();
+          if (m_cursor == h)
+          {
+            return false;
+          }
+          if (h - m_cursor > N)
+          {
+            // lapped: the oldest samples are gone
+            m_lost += (h - N) - m_cursor;
+            m_cursor = h - N;
+          }
+          if (m_ring.read_slot(m_cursor,value))
+          {
+            m_cursor++;
+            return true;
+          }
+          // overwritten while copying. Look at the head again
+        }
+      }
+
+      /// number of samples available right now
+      uint64_t available() const
+      {
+        const uint64_t h = m_ring.count();
+        return (h - m_cursor > N) ? N : (h - m_cursor);
+      }
+      /// samples overwritten before this reader got to them
+      uint64_t lost() const {return m_lost;}
+      /// skip everything that is pending
+      void skip() {m_cursor = m_ring.count();}
+
+    private:
+      const SampleRing &m_ring;
+      uint64_t m_cursor;
+      uint64_t m_lost;
+    };
+
+  private:
+    struct Slot
+    {
+      std::atomic<uint64_t> seq;  ///< 2*s+2 once sample s is in, odd while being written
+      T value;
+    };
+
+    bool read_slot(const uint64_t s, T &value) const
+    {
+      const Slot &slot = m_slots[s & (N - 1)];
+      const uint64_t before = slot.seq.load(std::memory_order_acquire);
+      if (before != 2*s + 2)
+      {
+        return false;
+      }
+      value = slot.value;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t after = slot.seq.load(std::memory_order_relaxed);
+      return (after == before);
+    }
+
+    SampleRing (const SampleRing &other) = delete;
+    SampleRing (SampleRing &&other) = delete;
+    SampleRing& operator= (const SampleRing &other) = delete;
+    SampleRing& operator= (SampleRing &&other) = delete;
+
+    std::atomic<uint64_t> m_head;
+    Slot m_slots[N];
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_SAMPLERING_HH_ */
@@ -0,0 +1,197 @@
+/*
+ * Statistics.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Online statistics over the energy stream. Everything is O(1) per
+ *      sample (amortized for the sliding windows) and costs no serial traffic.
+ */
+
+#ifndef INCLUDE_STATISTICS_HH_
+#define INCLUDE_STATISTICS_HH_
+
+#include <EnergyAcquisition.hh>
+#include <QuantileSketch.hh>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace device
+{
+
+  /**
+   * Running mean, variance, min and max since the last reset (Welford).
+   *
+   * add(values,n) is the batch path for replayed data: it reduces the block
+   * with SIMD (SSE2, when available) and merges it in with the pairwise
+   * formula of Chan et al., which keeps the same numerical stability.
+   */
+  class RunningStats
+  {
+  public:
+    RunningStats () {reset();}
+    virtual ~RunningStats () {}
+
+    void reset();
+    void add(const double x);
+    void add(const double *values, const size_t n);
+    /// combine with the statistics of another (disjoint) set of samples
+    void merge(const RunningStats &other);
+
+    uint64_t count() const {return m_n;}
+    double mean() const {return m_mean;}
+    /// sample variance (n-1). 0 with less than 2 samples
+    double variance() const;
+    double stddev() const;
+    /// sqrt(<x^2>)
+    double rms() const;
+    double min() const {return m_min;}
+    double max() const {return m_max;}
+
+  private:
+    uint64_t m_n;
+    double m_mean;
+    double m_m2;    ///< sum of squared deviations from the mean
+    double m_min;
+    double m_max;
+  };
+
+  /**
+   * Statistics over the samples of the last window_ns nanoseconds and/or the
+   * last max_samples samples (0 means no limit of that kind).
+   *
+   * Replaces the fixed average windows of the meter (AQ: 0.5 s to 30 s) with
+   * windows of any length. Mean and variance are updated with Welford's
+   * insertion and removal; min and max use monotonic queues.
+   */
+  class WindowStats
+  {
+  public:
+    WindowStats (const uint64_t window_ns, const size_t max_samples = 0);
+    virtual ~WindowStats () {}
+
+    void reset();
+    /// samples must come in time order
+    void add(const uint64_t timestamp_ns, const double x);
+
+    uint64_t count() const {return m_samples.size();}
+    double mean() const {return m_mean;}
+    double variance() const;
+    double stddev() const;
+    double rms() const;
+    double min() const;
+    double max() const;
+
+    uint64_t get_window_ns() const {return m_window_ns;}
+
+  private:
+    struct Entry
+    {
+      uint64_t t;
+      double x;
+      uint64_t seq;
+    };
+    void expire(const uint64_t now_ns);
+    void remove_oldest();
+
+    uint64_t m_window_ns;
+    size_t m_max_samples;
+    std::deque<Entry> m_samples;
+    std::deque<Entry> m_min_q;  ///< increasing values
+    std::deque<Entry> m_max_q;  ///< decreasing values
+    double m_mean;
+    double m_m2;
+    // sample counter. Also triggers an exact recomputation every so often,
+    // to wash out the removal round-off
+    uint64_t m_updates;
+  };
+
+  /**
+   * Exponentially weighted mean and variance with time constant tau_ns.
+   * The weight of each sample follows the actual time since the previous one,
+   * so irregular sampling (missed pulses, exposure reads) is handled.
+   */
+  class EwmaStats
+  {
+  public:
+    explicit EwmaStats (const uint64_t tau_ns);
+    virtual ~EwmaStats () {}
+
+    void reset();
+    void add(const uint64_t timestamp_ns, const double x);
+
+    bool valid() const {return m_init;}
+    double mean() const {return m_mean;}
+    double variance() const {return m_var;}
+    double stddev() const;
+
+  private:
+    uint64_t m_tau_ns;
+    bool m_init;
+    uint64_t m_last_t;
+    double m_mean;
+    double m_var;
+  };
+
+  /**
+   * Statistics stage attached to the energy stream of an EnergyAcquisition.
+   *
+   * Keeps the running statistics, a quantile sketch, plus any number of
+   * sliding windows and exponential averages, all fed with the energy per
+   * pulse (exposure samples contribute their average energy per pulse).
+   *
+   *   EnergyStats stats;
+   *   size_t w = stats.add_window(10000000000ULL); // 10 s
+   *   EnergyAcquisition<PowerMeter>::Ring::Reader rd(acq.ring());
+   *   stats.drain(rd);
+   *   stats.window(w).mean();
+   */
+  class EnergyStats
+  {
+  public:
+    EnergyStats () : m_pulses(0) {}
+    virtual ~EnergyStats () {}
+
+    /// @return index of the new window
+    size_t add_window(const uint64_t window_ns, const size_t max_samples = 0);
+    /// @return index of the new average
+    size_t add_ewma(const uint64_t tau_ns);
+
+    void update(const EnergySample &s);
+
+    /// consume whatever is pending on a ring reader
+    template <typename Reader>
+    size_t drain(Reader &reader)
+    {
+      size_t n = 0;
+      EnergySample s;
+      while (reader.pop(s))
+      {
+        update(s);
+        n++;
+      }
+      return n;
+    }
+
+    void reset();
+
+    const RunningStats &total() const {return m_total;}
+    /// distribution since the last reset (p1, p50, p99, ...). Mergeable across runs
+    const QuantileSketch &sketch() const {return m_sketch;}
+    const WindowStats &window(const size_t i) const {return m_windows.at(i);}
+    const EwmaStats &ewma(const size_t i) const {return m_ewma.at(i);}
+    uint64_t get_pulses() const {return m_pulses;}
+
+  private:
+    RunningStats m_total;
+    QuantileSketch m_sketch;
+    std::vector<WindowStats> m_windows;
+    std::vector<EwmaStats> m_ewma;
+    uint64_t m_pulses;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_STATISTICS_HH_ */
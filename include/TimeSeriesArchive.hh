@@ -0,0 +1,170 @@
+/*
+ * TimeSeriesArchive.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Compressed, read-mostly archive of time-series records, for long runs.
+ */
+
+#ifndef INCLUDE_TIMESERIESARCHIVE_HH_
+#define INCLUDE_TIMESERIESARCHIVE_HH_
+
+#include <TimeSeriesStore.hh>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace device
+{
+
+  /**
+   * Columns of a decoded block. Decoding into plain arrays (rather than
+   * records) keeps the scans over the values tight: RunningStats::add(values,n)
+   * takes them as they are.
+   */
+  struct BlockColumns
+  {
+    std::vector<uint64_t> timestamps;
+    std::vector<double> values;
+    std::vector<uint32_t> devices;
+    std::vector<uint32_t> flags;
+
+    size_t size() const {return timestamps.size();}
+    void clear();
+  };
+
+  /**
+   * Gorilla style block codec (Pelkonen et al., VLDB 2015).
+   *
+   * Timestamps are stored as delta of deltas: a steady acquisition rate gives
+   * a single bit per sample, jitter a few tens. Values are XORed with the
+   * previous one and only the meaningful bits are kept, reusing the previous
+   * leading/trailing zero window when it fits. Device and flags cost one bit
+   * when they do not change.
+   *
+   * The ratio depends on the data: sequences of identical or close values
+   * compress well, full-precision noise much less (the low mantissa bits of
+   * decimal readings are not correlated).
+   */
+  class BlockCodec
+  {
+  public:
+    /// most distinct devices in a block
+    static const size_t max_devices = 64;
+
+    /**
+     * Encode n records (in time order) and append them to out.
+     * @throws std::runtime_error if they come from more than max_devices devices
+     */
+    static void encode(const Record *recs, const size_t n, std::vector<uint8_t> &out);
+    /**
+     * Decode a block of count records.
+     * @throws std::runtime_error if the data ends too soon
+     */
+    static void decode(const uint8_t *data, const size_t len, const uint32_t count, BlockColumns &out);
+  };
+
+  /// where a block is in the archive and what it holds
+  struct BlockInfo
+  {
+    uint64_t first_ts;
+    uint64_t last_ts;
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t count;
+  };
+
+  /**
+   * Writes an archive file: header, blocks of up to block_records records,
+   * then the block index and a footer pointing to it. The file is only valid
+   * after close().
+   *
+   * A block also holds at most BlockCodec::max_devices distinct devices: a
+   * record from one more device closes the block early and starts the next.
+   */
+  class ArchiveWriter
+  {
+  public:
+    /// @throws std::runtime_error if the file cannot be created
+    ArchiveWriter (const std::string &path, const uint32_t block_records = 4096);
+    virtual ~ArchiveWriter ();
+
+    /// @return false if the record is older than the last one (dropped)
+    bool append(const Record &r);
+    /// write the last block and the index. Called by the destructor
+    void close();
+
+    uint64_t records() const {return m_records;}
+    /// bytes in the file so far
+    uint64_t bytes() const {return m_offset;}
+
+  private:
+    ArchiveWriter (const ArchiveWriter &other) = delete;
+    ArchiveWriter (ArchiveWriter &&other) = delete;
+    ArchiveWriter& operator= (const ArchiveWriter &other) = delete;
+    ArchiveWriter& operator= (ArchiveWriter &&other) = delete;
+
+    void write_block();
+    void write_all(const void *data, const size_t len);
+
+    std::string m_path;
+    int m_fd;
+    uint32_t m_block_records;
+    uint64_t m_offset;
+    uint64_t m_records;
+    uint64_t m_last_ts;
+    std::vector<Record> m_pending;
+    std::vector<uint32_t> m_block_devices;   ///< devices in m_pending
+    std::vector<uint8_t> m_buffer;
+    std::vector<BlockInfo> m_index;
+  };
+
+  /**
+   * Reads an archive file (memory mapped). Any block can be decoded on its
+   * own; time-range queries only decode the blocks that overlap the range.
+   */
+  class ArchiveReader
+  {
+  public:
+    /// @throws std::runtime_error if the file is not a complete archive
+    explicit ArchiveReader (const std::string &path);
+    virtual ~ArchiveReader ();
+
+    size_t blocks() const {return m_index.size();}
+    const BlockInfo &block(const size_t i) const {return m_index.at(i);}
+    uint64_t count() const;
+
+    void read_block(const size_t i, BlockColumns &out) const;
+
+    /**
+     * Records with t0 <= timestamp <= t1, optionally of one device only.
+     * @return number of records added to out
+     */
+    size_t query(const uint64_t t0, const uint64_t t1, std::vector<Record> &out,
+                 const uint32_t device = TimeSeriesStore::any_device) const;
+
+  private:
+    ArchiveReader (const ArchiveReader &other) = delete;
+    ArchiveReader (ArchiveReader &&other) = delete;
+    ArchiveReader& operator= (const ArchiveReader &other) = delete;
+    ArchiveReader& operator= (ArchiveReader &&other) = delete;
+
+    std::string m_path;
+    int m_fd;
+    const uint8_t *m_map;
+    size_t m_map_len;
+    std::vector<BlockInfo> m_index;
+  };
+
+  /**
+   * Copy a whole store into a new archive.
+   * @return number of records written
+   */
+  uint64_t archive_store(const TimeSeriesStore &store, const std::string &path,
+                         const uint32_t block_records = 4096);
+
+} /* namespace device */
+
+#endif /* INCLUDE_TIMESERIESARCHIVE_HH_ */
@@ -0,0 +1,143 @@
+/*
+ * TimeSeriesStore.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Append-only binary store for measurements (energy, device telemetry),
+ *      memory mapped and split in fixed size segments. Linux only.
+ */
+
+#ifndef INCLUDE_TIMESERIESSTORE_HH_
+#define INCLUDE_TIMESERIESSTORE_HH_
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+namespace device
+{
+
+  /**
+   * Fixed size record. Timestamps are CLOCK_MONOTONIC or epoch nanoseconds,
+   * as long as they never go backwards within a store.
+   */
+  struct Record
+  {
+    uint64_t timestamp_ns;
+    double value;
+    uint32_t device;    ///< device/channel id, defined by the application
+    uint32_t flags;
+  };
+
+  /**
+   * Time-series store.
+   *
+   * Records go to segment files (segment_NNNNNNNN.tss) in a directory. Each
+   * segment is a header plus room for a fixed number of records, mapped in
+   * memory: an append is a copy into the mapping plus an update of the record
+   * count, so it is cheap enough for the acquisition thread. When a segment is
+   * full the next one is created. Dirty pages are written out (msync + fdatasync)
+   * by a background thread every flush interval, or on flush().
+   *
+   * Records must be appended in time order, which makes every segment sorted:
+   * time-range queries use the segment table and a sparse in-memory index (one
+   * timestamp every index_stride records) to find the start in O(log n), then
+   * read the records in place.
+   *
+   * One writer thread; queries can come from any thread. A store opened read
+   * only sees the records that were committed (count in the header) when it
+   * was opened.
+   */
+  class TimeSeriesStore
+  {
+  public:
+    enum Mode {ReadOnly=0, ReadWrite=1};
+
+    static const uint32_t any_device = 0xFFFFFFFF;
+
+    /**
+     * @param dir directory holding the segments. Created if needed (read-write)
+     * @param records_per_segment segment size, for new segments
+     * @param flush_interval_ms period of the background sync (0: only on flush())
+     * @throws std::runtime_error on I/O errors or corrupt segments
+     */
+    TimeSeriesStore (const std::string &dir, const Mode mode = ReadWrite,
+                     const uint64_t records_per_segment = (1ULL << 20),
+                     const uint32_t flush_interval_ms = 1000);
+    virtual ~TimeSeriesStore ();
+
+    /**
+     * Append a record.
+     * @return false if it is older than the last one (the record is dropped)
+     */
+    bool append(const Record &r);
+    bool append(const uint64_t timestamp_ns, const double value, const uint32_t device, const uint32_t flags = 0);
+
+    /**
+     * Records with t0 <= timestamp <= t1, optionally of one device only.
+     * @return number of records added to out
+     */
+    size_t query(const uint64_t t0, const uint64_t t1, std::vector<Record> &out,
+                 const uint32_t device = any_device) const;
+
+    /**
+     * Records by position, for sequential reads of the whole store.
+     * @param first position of the first record (0 is the oldest)
+     * @return number of records added to out (0 past the end)
+     */
+    size_t read(const uint64_t first, const size_t n, std::vector<Record> &out) const;
+
+    /// total number of records
+    uint64_t count() const;
+    /// @return false if the store is empty
+    bool time_range(uint64_t &first, uint64_t &last) const;
+
+    /// write everything out to disk now
+    void flush();
+
+    static const size_t index_stride = 1024;
+
+  private:
+    struct Segment;
+
+    void open_segments();
+    Segment *create_segment(const uint32_t seq);
+    Segment *map_segment(const std::string &path, const uint32_t seq, const bool create);
+    void rotate();
+    void sync_segment(Segment &s);
+    void flush_loop();
+    size_t scan(const Segment &s, const uint64_t t0, const uint64_t t1, std::vector<Record> &out, const uint32_t device, bool &past_end) const;
+
+    TimeSeriesStore (const TimeSeriesStore &other) = delete;
+    TimeSeriesStore (TimeSeriesStore &&other) = delete;
+    TimeSeriesStore& operator= (const TimeSeriesStore &other) = delete;
+    TimeSeriesStore& operator= (TimeSeriesStore &&other) = delete;
+
+    std::string m_dir;
+    Mode m_mode;
+    uint64_t m_records_per_segment;
+    uint32_t m_flush_interval_ms;
+
+    // segment table. Guarded by m_seg_mutex for structural changes and syncs;
+    // the writer appends to the last segment without locking
+    mutable std::mutex m_seg_mutex;
+    std::vector<std::unique_ptr<Segment> > m_segments;
+    Segment *m_active;
+    uint64_t m_last_ts;
+
+    std::thread m_flusher;
+    std::mutex m_flush_mutex;
+    std::condition_variable m_flush_cv;
+    bool m_stop;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_TIMESERIESSTORE_HH_ */
@@ -0,0 +1,276 @@
+/*
+ * Transport.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Byte transports under Device: the serial port, a pseudo-terminal
+ *      served by a device model, and an in-process loopback.
+ */
+
+#ifndef INCLUDE_TRANSPORT_HH_
+#define INCLUDE_TRANSPORT_HH_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <serial/serial.h>
+
+namespace device
+{
+
+  /**
+   * What Device needs from a link: line oriented reads with a timeout,
+   * writes and buffer flushes. Lines are returned with their terminator, as
+   * serial::Serial does, and a read that times out returns what it got.
+   */
+  class Transport
+  {
+  public:
+    Transport () {}
+    virtual ~Transport () {}
+
+    virtual void open() = 0;
+    virtual void close() = 0;
+    virtual bool is_open() const = 0;
+
+    virtual void set_timeout_ms(const uint32_t ms) = 0;
+
+    /// @return number of bytes written
+    virtual size_t write(const std::string &data) = 0;
+    /// @return number of bytes read (0 on timeout)
+    virtual size_t readline(std::string &line, const size_t size, const std::string &eol) = 0;
+    /// read lines until max_lines (0: no limit) or the timeout
+    virtual std::vector<std::string> readlines(const size_t size, const std::string &eol, const size_t max_lines) = 0;
+    /// wait (up to the timeout) for something to read
+    virtual bool wait_readable() = 0;
+
+    virtual void flush_input() = 0;
+    virtual void flush_output() = 0;
+
+    /// underlying serial port, for the Reactor. nullptr if there is none
+    virtual serial::Serial *serial_port() {return nullptr;}
+
+  private:
+    Transport (const Transport &other) = delete;
+    Transport (Transport &&other) = delete;
+    Transport& operator= (const Transport &other) = delete;
+    Transport& operator= (Transport &&other) = delete;
+  };
+
+  /**
+   * The instrument side of a link: gets the bytes the driver writes and
+   * produces the bytes the instrument sends back.
+   */
+  class DeviceModel
+  {
+  public:
+    virtual ~DeviceModel () {}
+    /// append the answer (if any) to the bytes in data to reply
+    virtual void receive(const char *data, const size_t len, std::string &reply) = 0;
+    /// extra time to hold back the reply just made (PtyServer only)
+    virtual uint64_t reply_delay_ns() {return 0;}
+  };
+
+  /**
+   * Table driven model. Input is framed on the command terminator; each
+   * command gets the reply of the first rule that matches it (exact command,
+   * then the longest prefix), or the default reply. Replies are sent as given,
+   * terminators included. With echo on, every command is first sent back
+   * (as the Surelite does).
+   */
+  class ScriptedModel : public DeviceModel
+  {
+  public:
+    explicit ScriptedModel (const std::string &cmd_eol = "\r") : m_eol(cmd_eol), m_echo(false), m_received(0) {}
+    virtual ~ScriptedModel () {}
+
+    void on(const std::string &cmd, const std::string &reply) {m_exact[cmd] = reply;}
+    void on_prefix(const std::string &prefix, const std::string &reply) {m_prefix[prefix] = reply;}
+    void set_default(const std::string &reply) {m_default = reply;}
+    void set_echo(const bool echo) {m_echo = echo;}
+
+    uint64_t received() const {return m_received;}
+    const std::string &last_command() const {return m_last;}
+
+    virtual void receive(const char *data, const size_t len, std::string &reply) override;
+
+  protected:
+    /// reply to one command (without terminator)
+    virtual void answer(const std::string &cmd, std::string &reply);
+
+  private:
+    std::string m_eol;
+    bool m_echo;
+    std::map<std::string,std::string> m_exact;
+    std::map<std::string,std::string> m_prefix;
+    std::string m_default;
+    std::string m_pending;
+    std::string m_last;
+    uint64_t m_received;
+  };
+
+  /**
+   * serial::Serial backend (8N1), the default transport of the devices.
+   */
+  class SerialTransport : public Transport
+  {
+  public:
+    SerialTransport (const std::string &port, const uint32_t baud_rate);
+    virtual ~SerialTransport ();
+
+    virtual void open() override {m_serial.open();}
+    virtual void close() override {m_serial.close();}
+    virtual bool is_open() const override {return m_serial.isOpen();}
+
+    virtual void set_timeout_ms(const uint32_t ms) override;
+
+    virtual size_t write(const std::string &data) override {return m_serial.write(data);}
+    virtual size_t readline(std::string &line, const size_t size, const std::string &eol) override
+    {
+      return m_serial.readline(line,size,eol);
+    }
+    virtual std::vector<std::string> readlines(const size_t size, const std::string &eol, const size_t max_lines) override
+    {
+      return m_serial.readlines(size,eol,max_lines);
+    }
+    virtual bool wait_readable() override {return m_serial.waitReadable();}
+
+    virtual void flush_input() override {m_serial.flushInput();}
+    virtual void flush_output() override {m_serial.flushOutput();}
+
+    virtual serial::Serial *serial_port() override {return &m_serial;}
+
+  protected:
+    serial::Serial m_serial;
+  };
+
+  /**
+   * The instrument end of a pseudo-terminal: a device model answering on the
+   * master side, from a background thread (start()) or the calling one
+   * (run()). Drivers open the slave as any serial port.
+   *
+   * The link can be given the timing of the real instrument: a latency
+   * between the end of a command and the start of its answer, and the pace
+   * of a serial line (10 bits per byte at pace_baud) in both directions.
+   * Both default to off (answers as fast as the kernel can carry them).
+   * Linux only.
+   */
+  class PtyServer
+  {
+  public:
+    /**
+     * @param model answers the commands. May be null: then the master end
+     *        is left to the caller (master_fd())
+     * @throws serial::IOException if no pty can be allocated
+     */
+    explicit PtyServer (std::shared_ptr<DeviceModel> model);
+    virtual ~PtyServer ();
+
+    const std::string &slave_name() const {return m_slave;}
+    int master_fd() const {return m_master;}
+
+    /// delay from the last byte of a command to the first of the answer
+    void set_latency_us(const uint32_t us) {m_latency_ns = static_cast<uint64_t>(us) * 1000;}
+    /// pace the bytes as a serial line at this rate (0: no pacing)
+    void set_pace_baud(const uint32_t baud) {m_byte_ns = (baud > 0) ? 10000000000ULL / baud : 0;}
+
+    /// serve from a background thread
+    void start();
+    /// serve from the calling thread, until stop()
+    void run();
+    /// stop serving. Safe from a signal handler
+    void stop();
+
+    uint64_t bytes_in() const {return m_bytes_in.load();}
+    uint64_t bytes_out() const {return m_bytes_out.load();}
+
+  private:
+    PtyServer (const PtyServer &other) = delete;
+    PtyServer (PtyServer &&other) = delete;
+    PtyServer& operator= (const PtyServer &other) = delete;
+    PtyServer& operator= (PtyServer &&other) = delete;
+
+    std::shared_ptr<DeviceModel> m_model;
+    int m_master;
+    int m_keep;
+    int m_wake[2];
+    std::string m_slave;
+    std::thread m_server;
+    std::atomic<uint64_t> m_latency_ns;
+    std::atomic<uint64_t> m_byte_ns;
+    std::atomic<uint64_t> m_bytes_in;
+    std::atomic<uint64_t> m_bytes_out;
+  };
+
+  /**
+   * Pseudo-terminal backend. The driver talks to the slave end through the
+   * normal serial stack (termios, kernel tty buffers), and a device model
+   * answers on the master end from a background thread. Measures the whole
+   * stack without hardware. Linux only.
+   */
+  class PtyTransport : public SerialTransport
+  {
+  public:
+    /**
+     * @param model answers the commands. May be null: then the master end
+     *        is left to the caller (master_fd())
+     * @throws serial::IOException if no pty can be allocated
+     */
+    PtyTransport (std::shared_ptr<DeviceModel> model, const uint32_t baud_rate = 9600);
+    virtual ~PtyTransport ();
+
+    const std::string &slave_name() const {return m_server.slave_name();}
+    int master_fd() const {return m_server.master_fd();}
+    /// the instrument end, to set its timing
+    PtyServer &server() {return m_server;}
+
+  private:
+    PtyServer m_server;
+  };
+
+  /**
+   * In-process backend: writes go straight to a device model and its replies
+   * are read back from memory. No kernel, no timing: what is left is the cost
+   * of the protocol code itself. A read that finds no complete line returns
+   * the partial data at once, as a serial read would after its timeout.
+   */
+  class LoopbackTransport : public Transport
+  {
+  public:
+    explicit LoopbackTransport (std::shared_ptr<DeviceModel> model);
+    virtual ~LoopbackTransport () {}
+
+    virtual void open() override {m_open = true;}
+    virtual void close() override;
+    virtual bool is_open() const override {return m_open;}
+
+    virtual void set_timeout_ms(const uint32_t ms) override {m_timeout_ms = ms;}
+
+    virtual size_t write(const std::string &data) override;
+    virtual size_t readline(std::string &line, const size_t size, const std::string &eol) override;
+    virtual std::vector<std::string> readlines(const size_t size, const std::string &eol, const size_t max_lines) override;
+    virtual bool wait_readable() override {return (m_rx_pos < m_rx.size());}
+
+    virtual void flush_input() override;
+    virtual void flush_output() override {}
+
+    DeviceModel &model() {return *m_model;}
+
+  private:
+    std::shared_ptr<DeviceModel> m_model;
+    bool m_open;
+    uint32_t m_timeout_ms;
+    std::string m_rx;
+    size_t m_rx_pos;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_TRANSPORT_HH_ */
@@ -0,0 +1,90 @@
+/*
+ * WriteShadow.hh
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ *
+ *      Last settings written to a device, to skip the writes that change nothing.
+ */
+
+#ifndef INCLUDE_WRITESHADOW_HH_
+#define INCLUDE_WRITESHADOW_HH_
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <mutex>
+
+namespace device
+{
+
+  /**
+   * Write-through copy of the device settings.
+   *
+   * Each device declares once, when it is built, which of its setters are
+   * plain settings (track) and which commands bring the settings back to
+   * whatever the controller starts with (resync_on). Commands are matched
+   * by their mnemonic (up to the first space), so that "PD 005" and
+   * "PD 010" are the same setting.
+   *
+   * Device::write_cmd asks redundant() before a command goes out. If the
+   * last command of that setting that was fully written has the same text,
+   * the write (and its pacing) is skipped. Commands that go out any other
+   * way are reported with sent(), so that the copy never gets ahead of the
+   * device. A reconnection forgets everything.
+   *
+   * Off by default: it assumes nobody else changes the settings (e.g., from
+   * the front panel) behind our back.
+   *
+   * Thread safe.
+   */
+  class WriteShadow
+  {
+  public:
+    WriteShadow ();
+    virtual ~WriteShadow () {}
+
+    // rules
+    void track(const std::string &cmd);
+    void resync_on(const std::string &cmd);
+
+    /// true if cmd is a tracked setting and the device already has it
+    bool redundant(const std::string &cmd);
+    /**
+     * cmd went out to the device
+     * @param written true if it was fully written. If not, the setting is
+     *        forgotten (its state is unknown)
+     */
+    void sent(const std::string &cmd, const bool written);
+    /// forget the setting of cmd, so that its next write goes out whatever it is
+    void forget(const std::string &cmd);
+    /// forget all the settings (the rules stay)
+    void clear();
+
+    void set_enabled(const bool e);
+    bool get_enabled() const;
+
+    /// writes skipped so far
+    uint64_t skipped() const;
+
+  private:
+    WriteShadow (const WriteShadow &other) = delete;
+    WriteShadow (WriteShadow &&other) = delete;
+    WriteShadow& operator= (const WriteShadow &other) = delete;
+    WriteShadow& operator= (WriteShadow &&other) = delete;
+
+    static std::string mnemonic(const std::string &cmd);
+
+    bool m_enabled;
+    std::unordered_set<std::string> m_tracked;
+    std::unordered_set<std::string> m_resyncs;
+    // last command written, by mnemonic
+    std::unordered_map<std::string,std::string> m_last;
+    uint64_t m_skipped;
+    mutable std::mutex m_mutex;
+  };
+
+} /* namespace device */
+
+#endif /* INCLUDE_WRITESHADOW_HH_ */
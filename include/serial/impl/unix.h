@@ -43,6 +43,7 @@
 #include "serial/serial.h"
 
 #include <pthread.h>
+#include <atomic>
 
 namespace serial {
 
@@ -140,6 +141,15 @@ public:
   string
   getPort () const;
 
+  int
+  getFd () const;
+
+  void
+  setTap (std::shared_ptr<Tap> tap);
+
+  std::shared_ptr<Tap>
+  getTap () const;
+
   void
   setTimeout (Timeout &timeout);
 
@@ -212,6 +222,10 @@ private:
   pthread_mutex_t read_mutex;
   // Mutex used to lock the write functions
   pthread_mutex_t write_mutex;
+
+  // Observer of the traffic (empty: none). Only accessed through
+  // std::atomic_load/atomic_store
+  std::shared_ptr<Tap> tap_;
 };
 
 }
@@ -43,6 +43,7 @@
 #include <sstream>
 #include <exception>
 #include <stdexcept>
+#include <memory>
 #include <serial/v8stdint.h>
 
 #define THROW(exceptionClass, message) throw exceptionClass(__FILE__, \
@@ -141,6 +142,21 @@ struct Timeout {
   {}
 };
 
+/*!
+ * Observer of the bytes that go through a port: called right after each
+ * read or write that moved data, from the thread that did it.
+ */
+class Tap {
+public:
+  virtual ~Tap () {}
+
+  virtual void
+  onRead (const uint8_t *data, size_t length) = 0;
+
+  virtual void
+  onWrite (const uint8_t *data, size_t length) = 0;
+};
+
 /*!
  * Class that provides a portable serial port interface.
  */
@@ -309,6 +325,10 @@ public:
    *
    * Reads from the serial port until a single line has been read.
    *
+   * Bytes are pulled from the port in bulk and kept in a per-port receive
+   * buffer, so any data received past the end of the line is returned by
+   * the next read call rather than being lost.
+   *
    * \param buffer A std::string reference used to store the data.
    * \param size A maximum length of a line, defaults to 65536 (2^16)
    * \param eol A string to match against for the EOL.
@@ -341,17 +361,24 @@ public:
    * This requires a timeout > 0 before it can be run. It will read until a
    * timeout occurs and return a list of strings.
    *
+   * If max_lines is not zero, the read also completes as soon as that many
+   * complete lines have been received, so callers that know the shape of
+   * the answer do not have to wait for the timeout.
+   *
    * \param size A maximum length of combined lines, defaults to 65536 (2^16)
    *
    * \param eol A string to match against for the EOL.
    *
+   * \param max_lines Number of lines after which to return, 0 for no limit.
+   *
    * \return A vector<string> containing the lines.
    *
    * \throw serial::PortNotOpenedException
    * \throw serial::SerialException
    */
   std::vector<std::string>
-  readlines (size_t size = 65536, std::string eol = "\n");
+  readlines (size_t size = 65536, std::string eol = "\n",
+             size_t max_lines = 0);
 
   /*! Write a string to the serial port.
    *
@@ -421,6 +448,33 @@ public:
   std::string
   getPort () const;
 
+#if !defined(_WIN32)
+  /*! Gets the file descriptor of the open port, or -1 if it is closed.
+   *
+   * Meant for event loops that multiplex several ports (epoll, select).
+   * Data read directly from the descriptor bypasses the receive buffer
+   * used by readline/readlines, so the port should not be read through
+   * both at the same time.
+   */
+  int
+  getFd () const;
+
+  /*! Sets an observer of every byte read from and written to the port, or
+   * none. It can be changed at any time: a read or write in progress keeps
+   * its own reference to the tap it started with, so the old tap can be
+   * released right away (it is destroyed once that call returns).
+   */
+  void
+  setTap (std::shared_ptr<Tap> tap);
+
+  /*! Gets the tap of the port (empty if there is none). Code that uses
+   * getFd() directly should call it with the bytes it moves, holding the
+   * returned reference for the duration of the call.
+   */
+  std::shared_ptr<Tap>
+  getTap () const;
+#endif
+
   /*! Sets the timeout for reads and writes using the Timeout struct.
    *
    * There are two timeout conditions described here:
@@ -656,6 +710,10 @@ private:
   class SerialImpl;
   SerialImpl *pimpl_;
 
+  // Receive buffer used to frame lines out of bulk reads
+  class LineFramer;
+  LineFramer *framer_;
+
   // Scoped Lock Classes
   class ScopedReadLock;
   class ScopedWriteLock;
@@ -15,8 +15,8 @@
 
 namespace device
 {
-Attenuator::Attenuator (const char* port, const uint32_t baud_rate)
-: Device(port,baud_rate),
+Attenuator::Attenuator (const char* port, const uint32_t baud_rate, Transport *transport)
+: Device(port,baud_rate,transport),
   m_offset(0),
   m_max_speed(59000), // whatever was in the python code
   m_op_mode(Command),
@@ -37,18 +37,28 @@ Attenuator::Attenuator (const char* port, const uint32_t baud_rate)
   // -- the attenuator is weird, as the termination of the
   // answers/reads is not the same as the
   // termination of the writes. Had to overload the functions
+  // (the read suffix is still recorded, for framing outside read_cmd)
+  m_read_sfx = "\n\r";
 
-  // open the serial port with a 1s timeout by default
-  m_serial.setBaudrate(m_baud);
-  m_serial.setPort(m_comport);
-  m_serial.setBytesize(serial::eightbits);
-  m_serial.setParity(serial::parity_none);
-  m_timeout_ms = 50;
-  serial::Timeout t = serial::Timeout::simpleTimeout(m_timeout_ms);
-  m_serial.setTimeout(t);
-  m_serial.setStopbits(serial::stopbits_one);
-  m_serial.open();
-  if (!m_serial.isOpen())
+  // attenuator instruction on page 31 say that we need to
+  // add an interval of 50ms between commands
+  m_cmd_interval_ms = 50;
+  // the answer used to be read 50 ms after the write, with a 50 ms timeout.
+  // Now the read starts right away, so keep the same window for the answer
+  m_timeout_ms = 100;
+  // the name only changes when we set it
+  m_query_cache.cache("n",QueryCache::forever);
+  m_query_cache.invalidate_on("sn",{"n"});
+  m_query_cache.clear_on("j");
+  // settings that can be skipped when unchanged (write_shadow()). The
+  // reset brings the controller back to its saved settings
+  for (const char *cmd : {"r","ws","wm","a","d","s"})
+  {
+    m_write_shadow.track(cmd);
+  }
+  m_write_shadow.resync_on("j");
+  open_transport();
+  if (!is_open())
   {
 #ifdef DEBUG
     std::cerr << "Failed to open the port ["<< m_comport << ":" << m_baud << "]" << std::endl;
@@ -63,10 +73,9 @@ Attenuator::Attenuator (const char* port, const uint32_t baud_rate)
 
 Attenuator::~Attenuator ()
 {
-  if (m_serial.isOpen())
-  {
-    m_serial.close();
-  }
+  // the worker may be running methods of this class
+  stop_worker();
+  close();
 }
 
 
@@ -329,6 +338,11 @@ void Attenuator::set_max_speed(const uint32_t speed)
 
 const std::string Attenuator::get_status_raw()
 {
+  if (off_worker())
+  {
+    return run_on_worker([this]() {return get_status_raw();});
+  }
+  IOLock io(*this);
   std::string msg = "p";
   bool st = write_cmd(msg);
   if (!st)
@@ -351,6 +365,11 @@ const std::string Attenuator::get_status_raw()
 /// This command returns a string finished with 0x0A followed by 0x0D (\r\n)
 void Attenuator::refresh_status()
 {
+  if (off_worker())
+  {
+    return run_on_worker([this]() {refresh_status();});
+  }
+  IOLock io(*this);
   std::string msg= "pc";
   bool st = write_cmd(msg);
   if (!st)
@@ -427,6 +446,11 @@ void Attenuator::refresh_status()
 
 void Attenuator::get_position(int32_t &position, uint16_t &status, bool wait)
 {
+  if (off_worker())
+  {
+    return run_on_worker([&]() {get_position(position,status,wait);});
+  }
+  IOLock io(*this);
   // query status and position of the attenuator motor
   std::string msg("o");
   bool st = write_cmd(msg);
@@ -490,6 +514,17 @@ void Attenuator::get_position(int32_t &position, enum MotorState &status, bool w
 }
 
 
+std::future<std::pair<int32_t,uint16_t> > Attenuator::async_get_position()
+{
+  return run_async([this]() -> std::pair<int32_t,uint16_t>
+  {
+    int32_t position;
+    uint16_t status;
+    get_position(position,status,false);
+    return std::make_pair(position,status);
+  });
+}
+
 void Attenuator::set_transmission(const double trans, bool &success,bool wait)
 {
   // first convert transmission range [0.0] to steps
@@ -571,16 +606,36 @@ void Attenuator::set_serial_number(const std::string sn)
 void Attenuator::get_serial_number(std::string &sn)
 {
   std::string cmd = "n";
+  if (off_worker())
+  {
+    return run_on_worker([&]() {get_serial_number(sn);});
+  }
+  IOLock io(*this);
+  // in turn with the commands queued before (a "sn" makes it stale)
+  if (m_query_cache.lookup(cmd,sn))
+  {
+    // m_serial_number was set when it was read
+    sn = sn.substr(1);
+    return;
+  }
   bool st = write_cmd(cmd);
   if (!st)
   {
     throw serial::IOException(__FILE__,__LINE__,"Failed to send command to get serial number");
   }
+  // the read appends
+  sn.clear();
   st = read_cmd(sn);
   if (!st)
   {
     throw serial::IOException(__FILE__,__LINE__,"Failed to read serial number");
   }
+  // an answer that does not start with the echo is an error or garbage
+  if (sn.empty() || sn.at(0) != 'n')
+  {
+    throw serial::IOException(__FILE__,__LINE__,"Unexpected answer to get serial number");
+  }
+  m_query_cache.store(cmd,sn);
   //std::string resp = m_serial.readline(0xFFFF, std::string("\r"));
   //#ifdef DEBUG
   //  std::cout << "Attenuator::get_serial_number : Resp ["<< resp << "]" << std::endl;
@@ -658,6 +713,12 @@ const float Attenuator::convert_current(uint16_t val)
 
 bool Attenuator::write_cmd(const std::string cmd, bool repeat)
 {
+  // queries (command + answer) are handed to the worker as a whole by the callers
+  if (off_worker())
+  {
+    return run_on_worker([&]() {return write_cmd(cmd,repeat);});
+  }
+  IOLock io(*this);
   bool st = Device::write_cmd(cmd);
   if (!st)
   {
@@ -672,9 +733,6 @@ bool Attenuator::write_cmd(const std::string cmd, bool repeat)
       return false;
     }
   }
-  // attenuator instruction on page 31 say that we need to
-  // add an interval of 50ms between commands
-  std::this_thread::sleep_for(std::chrono::milliseconds(50));
   return true;
 }
 
@@ -683,7 +741,7 @@ bool Attenuator::read_cmd(std::string &answer, bool repeat)
   // wait for the port to be ready
   size_t nbytes = 0;
   // only do this wait if the timeout is not 0
-   nbytes = m_serial.readline(answer,0xFFFF,"\n\r");
+   nbytes = transport().readline(answer,0xFFFF,"\n\r");
   if (nbytes == 0)
   {
     if (repeat)
@@ -0,0 +1,491 @@
+/*
+ * Capture.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <Capture.hh>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  struct CaptureHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t start_realtime_ns;
+    uint64_t start_monotonic_ns;
+  };
+
+  static const uint32_t capture_magic = 0x3150434c; // "LCP1"
+  static const uint32_t capture_version = 1;
+
+  static uint64_t clock_ns(const clockid_t clock)
+  {
+    struct timespec ts;
+    clock_gettime(clock,&ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  static void put_varint(std::vector<uint8_t> &out, uint64_t v)
+  {
+    while (v >= 0x80)
+    {
+      out.push_back(static_cast<uint8_t>(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+  }
+
+  /// @return false if the data ends before the varint does
+  static bool get_varint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+  {
+    v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+      if (p == end)
+      {
+        return false;
+      }
+      const uint8_t b = *p++;
+      v |= static_cast<uint64_t>(b & 0x7f) << shift;
+      if ((b & 0x80) == 0)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  ///
+  /// TrafficRecorder
+  ///
+
+  TrafficRecorder::TrafficRecorder (const std::string &path, const size_t flush_bytes)
+    : m_path(path),
+      m_fd(-1),
+      m_flush_bytes(std::max<size_t>(flush_bytes,1)),
+      m_last_ns(0),
+      m_records(0),
+      m_bytes(0)
+  {
+    m_fd = ::open(m_path.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+    if (m_fd == -1)
+    {
+      throw std::runtime_error("TrafficRecorder : failed to create [" + m_path + "] : " + std::strerror(errno));
+    }
+    // room for a full chunk and the record that tips it over
+    m_buffer.reserve(m_flush_bytes + 4096);
+    CaptureHeader h;
+    h.magic = capture_magic;
+    h.version = capture_version;
+    h.start_realtime_ns = clock_ns(CLOCK_REALTIME);
+    h.start_monotonic_ns = clock_ns(CLOCK_MONOTONIC);
+    m_last_ns = h.start_monotonic_ns;
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(&h);
+    m_buffer.insert(m_buffer.end(),p,p + sizeof(h));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write_out();
+    if (m_fd == -1)
+    {
+      throw std::runtime_error("TrafficRecorder : failed to write [" + m_path + "]");
+    }
+  }
+
+  TrafficRecorder::~TrafficRecorder ()
+  {
+    close();
+  }
+
+  void TrafficRecorder::onRead(const uint8_t *data, size_t length)
+  {
+    record(false,data,length);
+  }
+
+  void TrafficRecorder::onWrite(const uint8_t *data, size_t length)
+  {
+    record(true,data,length);
+  }
+
+  void TrafficRecorder::record(const bool outbound, const uint8_t *data, const size_t length)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_fd == -1)
+    {
+      return;
+    }
+    // the time is taken under the lock, so that the records of the reader
+    // and writer threads stay in order
+    const uint64_t now = clock_ns(CLOCK_MONOTONIC);
+    put_varint(m_buffer,now - m_last_ns);
+    put_varint(m_buffer,(static_cast<uint64_t>(length) << 1) | (outbound ? 1 : 0));
+    m_buffer.insert(m_buffer.end(),data,data + length);
+    m_last_ns = now;
+    m_records++;
+    m_bytes += length;
+    if (m_buffer.size() >= m_flush_bytes)
+    {
+      write_out();
+    }
+  }
+
+  void TrafficRecorder::flush()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    write_out();
+  }
+
+  void TrafficRecorder::close()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_fd == -1)
+    {
+      return;
+    }
+    write_out();
+    if (m_fd != -1)
+    {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+#ifdef DEBUG
+    std::cout << "TrafficRecorder::close : " << m_records << " records, " << m_bytes
+        << " bytes of traffic in [" << m_path << "]" << std::endl;
+#endif
+  }
+
+  uint64_t TrafficRecorder::records() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_records;
+  }
+
+  uint64_t TrafficRecorder::bytes() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+  }
+
+  void TrafficRecorder::write_out()
+  {
+    if (m_fd == -1 || m_buffer.empty())
+    {
+      return;
+    }
+    const uint8_t *p = m_buffer.data();
+    size_t left = m_buffer.size();
+    while (left > 0)
+    {
+      const ssize_t w = ::write(m_fd,p,left);
+      if (w == -1)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        // called from the reads and writes of the port: a full disk must not
+        // break the link, so the capture stops here instead
+#ifdef DEBUG
+        std::cout << "TrafficRecorder::write_out : failed to write [" << m_path << "] : "
+            << std::strerror(errno) << ". Capture stopped." << std::endl;
+#endif
+        ::close(m_fd);
+        m_fd = -1;
+        break;
+      }
+      p += w;
+      left -= static_cast<size_t>(w);
+    }
+    m_buffer.clear();
+  }
+
+  ///
+  /// read_capture
+  ///
+
+  std::vector<CaptureRecord> read_capture(const std::string &path)
+  {
+    const int fd = ::open(path.c_str(),O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+      throw std::runtime_error("read_capture : failed to open [" + path + "] : " + std::strerror(errno));
+    }
+    std::vector<uint8_t> raw;
+    struct stat st;
+    if (fstat(fd,&st) == 0 && st.st_size > 0)
+    {
+      raw.reserve(static_cast<size_t>(st.st_size));
+    }
+    uint8_t buf[65536];
+    while (true)
+    {
+      const ssize_t n = ::read(fd,buf,sizeof(buf));
+      if (n == -1)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        const int err = errno;
+        ::close(fd);
+        throw std::runtime_error("read_capture : failed to read [" + path + "] : " + std::strerror(err));
+      }
+      if (n == 0)
+      {
+        break;
+      }
+      raw.insert(raw.end(),buf,buf + n);
+    }
+    ::close(fd);
+
+    CaptureHeader h;
+    if (raw.size() < sizeof(h))
+    {
+      throw std::runtime_error("read_capture : not a capture [" + path + "]");
+    }
+    std::memcpy(&h,raw.data(),sizeof(h));
+    if (h.magic != capture_magic || h.version != capture_version)
+    {
+      throw std::runtime_error("read_capture : not a capture [" + path + "]");
+    }
+    std::vector<CaptureRecord> records;
+    const uint8_t *p = raw.data() + sizeof(h);
+    const uint8_t *end = raw.data() + raw.size();
+    uint64_t ts = h.start_monotonic_ns;
+    while (p < end)
+    {
+      uint64_t dt, tag;
+      if (!get_varint(p,end,dt) || !get_varint(p,end,tag))
+      {
+        break;
+      }
+      const uint64_t len = tag >> 1;
+      if (len > static_cast<uint64_t>(end - p))
+      {
+        break;
+      }
+      ts += dt;
+      CaptureRecord r;
+      r.timestamp_ns = ts;
+      r.outbound = ((tag & 1) != 0);
+      r.data.assign(reinterpret_cast<const char*>(p),static_cast<size_t>(len));
+      p += len;
+      records.push_back(std::move(r));
+    }
+#ifdef DEBUG
+    if (p < end)
+    {
+      std::cout << "read_capture : " << (end - p) << " bytes of a truncated record left out of ["
+          << path << "]" << std::endl;
+    }
+#endif
+    return records;
+  }
+
+  ///
+  /// ReplayTransport
+  ///
+
+  ReplayTransport::ReplayTransport (const std::string &path, const double speed)
+    : ReplayTransport(read_capture(path),speed)
+  {
+  }
+
+  ReplayTransport::ReplayTransport (const std::vector<CaptureRecord> &records, const double speed)
+    : m_records(records),
+      m_speed(speed),
+      m_open(false),
+      m_timeout_ms(0),
+      m_next(0),
+      m_next_offset(0),
+      m_anchor_ns(0),
+      m_rx_pos(0),
+      m_mismatches(0)
+  {
+    rewind();
+  }
+
+  void ReplayTransport::rewind()
+  {
+    m_next = 0;
+    m_next_offset = 0;
+    m_anchor_ns = m_records.empty() ? 0 : m_records.front().timestamp_ns;
+    m_anchor = Clock::now();
+    m_rx.clear();
+    m_rx_pos = 0;
+    m_mismatches = 0;
+  }
+
+  ReplayTransport::Clock::time_point ReplayTransport::due() const
+  {
+    if (m_speed <= 0.0)
+    {
+      return m_anchor;
+    }
+    const uint64_t ts = m_records[m_next].timestamp_ns;
+    const double dt = static_cast<double>((ts > m_anchor_ns) ? (ts - m_anchor_ns) : 0) / m_speed;
+    return m_anchor + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double,std::nano>(dt));
+  }
+
+  void ReplayTransport::release(const Clock::time_point now)
+  {
+    if (m_rx_pos == m_rx.size())
+    {
+      m_rx.clear();
+      m_rx_pos = 0;
+    }
+    while (pending() && due() <= now)
+    {
+      m_rx += m_records[m_next].data;
+      m_next++;
+    }
+  }
+
+  void ReplayTransport::wait_next(const Clock::time_point deadline) const
+  {
+    std::this_thread::sleep_until(std::min(due(),deadline));
+  }
+
+  size_t ReplayTransport::write(const std::string &data)
+  {
+    if (!m_open)
+    {
+      throw serial::PortNotOpenedException("ReplayTransport::write");
+    }
+    size_t i = 0;
+    while (i < data.size())
+    {
+      if (m_next == m_records.size())
+      {
+        m_mismatches += data.size() - i;
+        break;
+      }
+      const CaptureRecord &r = m_records[m_next];
+      if (!r.outbound)
+      {
+        // read before this write in the capture: it had arrived already
+        m_rx += r.data;
+        m_next++;
+        continue;
+      }
+      const size_t n = std::min(r.data.size() - m_next_offset,data.size() - i);
+      for (size_t k = 0; k < n; k++)
+      {
+        if (r.data[m_next_offset + k] != data[i + k])
+        {
+          m_mismatches++;
+        }
+      }
+      i += n;
+      m_next_offset += n;
+      m_anchor_ns = r.timestamp_ns;
+      if (m_next_offset == r.data.size())
+      {
+        m_next++;
+        m_next_offset = 0;
+      }
+    }
+    m_anchor = Clock::now();
+#ifdef DEBUG
+    if (m_mismatches > 0)
+    {
+      std::cout << "ReplayTransport::write : " << m_mismatches << " bytes off the capture so far" << std::endl;
+    }
+#endif
+    return data.size();
+  }
+
+  size_t ReplayTransport::readline(std::string &line, const size_t size, const std::string &eol)
+  {
+    if (!m_open)
+    {
+      throw serial::PortNotOpenedException("ReplayTransport::readline");
+    }
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(m_timeout_ms);
+    while (true)
+    {
+      const Clock::time_point now = Clock::now();
+      release(now);
+      const size_t avail = m_rx.size() - m_rx_pos;
+      const size_t pos = m_rx.find(eol,m_rx_pos);
+      size_t len = 0;
+      if (pos != std::string::npos)
+      {
+        len = pos - m_rx_pos + eol.size();
+      }
+      else if (avail >= size || !pending() || now >= deadline)
+      {
+        len = avail;
+      }
+      if (len > 0 || !pending() || now >= deadline)
+      {
+        len = std::min(len,size);
+        line.append(m_rx,m_rx_pos,len);
+        m_rx_pos += len;
+        return len;
+      }
+      wait_next(deadline);
+    }
+  }
+
+  std::vector<std::string> ReplayTransport::readlines(const size_t size, const std::string &eol, const size_t max_lines)
+  {
+    std::vector<std::string> lines;
+    size_t read_so_far = 0;
+    while (read_so_far < size && (max_lines == 0 || lines.size() < max_lines))
+    {
+      std::string line;
+      const size_t n = readline(line,size - read_so_far,eol);
+      if (n == 0)
+      {
+        break;
+      }
+      read_so_far += n;
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  bool ReplayTransport::wait_readable()
+  {
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(m_timeout_ms);
+    while (true)
+    {
+      const Clock::time_point now = Clock::now();
+      release(now);
+      if (m_rx_pos < m_rx.size())
+      {
+        return true;
+      }
+      if (!pending() || now >= deadline)
+      {
+        return false;
+      }
+      wait_next(deadline);
+    }
+  }
+
+  void ReplayTransport::flush_input()
+  {
+    release(Clock::now());
+    m_rx.clear();
+    m_rx_pos = 0;
+  }
+
+} /* namespace device */
@@ -9,6 +9,10 @@
 #include <thread>
 #include <chrono>
 #include <utilities.hh>
+#include <stdexcept>
+#include <memory>
+#include <cerrno>
+#include <algorithm>
 //#define DEBUG 1
 
 #ifdef DEBUG
@@ -18,41 +22,53 @@
 namespace device
 {
 
-  Device::Device (const char* port, const uint32_t baud_rate)
+  Device::Device (const char* port, const uint32_t baud_rate, Transport *transport)
       : m_comport(port),
         m_baud(baud_rate),
         m_com_pre(""),
         m_com_sfx("\r"),
-        m_timeout_ms(500)
+        m_timeout_ms(500),
+        m_transport(transport),
+        m_cmd_interval_ms(0),
+        m_next_cmd({0,0}),
+        m_reactor(nullptr),
+        m_reactor_port(-1),
+        m_io_depth(0),
+        m_worker_run(false),
+        m_producers(0),
+        m_worker_stop(false)
   {
-
-//    // initialize the serial connection
-//    m_serial.setPort(m_comport);
-//    m_serial.setBaudrate(m_baud);
-//    m_serial.setBytesize(serial::eightbits);
-//    m_serial.setParity(serial::parity_none);
-//    serial::Timeout t = serial::Timeout::simpleTimeout(m_timeout_ms);
-//    m_serial.setTimeout(t);
-//    m_serial.setStopbits(serial::stopbits_one);
+    // the derived classes open the transport, once they have set the timeout
   }
 
   Device::~Device ()
   {
-    if (m_serial.isOpen())
+    stop_worker();
+    detach();
+    stop_capture();
+    if (is_open())
     {
-      m_serial.close();
+      m_transport->close();
     }
   }
 
   bool Device::write_cmd(const std::string cmd)
   {
-    if (!m_serial.isOpen())
+    // a setting the device already has
+    if (m_write_shadow.redundant(cmd))
+    {
+      return true;
+    }
+    if (!transport().is_open())
     {
-      m_serial.open();
+      m_transport->open();
     }
+    // wait out the command interval first: flushing the output earlier
+    // would drop whatever of the previous command is still on its way
+    pace();
     // drop any input that may be pending
-    m_serial.flushInput();
-    m_serial.flushOutput();
+    m_transport->flush_input();
+    m_transport->flush_output();
     // first flush any pending buffers
     // m_serial.flush();
 
@@ -60,7 +76,11 @@ namespace device
 #ifdef DEBUG
     std::cout << "Device::write_cmd : Sending command [" << util::escape(msg.c_str()) << "]" << std::endl;
 #endif
-    size_t written_bytes = m_serial.write(msg);
+    // whatever it changes is stale from now on, even if the write fails
+    m_query_cache.sent(cmd);
+    size_t written_bytes = m_transport->write(msg);
+    mark_cmd_sent();
+    m_write_shadow.sent(cmd,(written_bytes == msg.size()));
     if (written_bytes != msg.size())
     {
       return false;
@@ -73,10 +93,36 @@ namespace device
 
 
 
+  bool Device::write_batch(const std::vector<std::string> &cmds)
+  {
+    if (!transport().is_open())
+    {
+      m_transport->open();
+    }
+    pace();
+    m_transport->flush_input();
+    m_transport->flush_output();
+    std::string msg;
+    for (const std::string &cmd : cmds)
+    {
+      m_query_cache.sent(cmd);
+      msg += m_com_pre + cmd + m_com_sfx;
+    }
+#ifdef DEBUG
+    std::cout << "Device::write_batch : Sending [" << cmds.size() << "] commands [" << util::escape(msg.c_str()) << "]" << std::endl;
+#endif
+    size_t written_bytes = m_transport->write(msg);
+    mark_cmd_sent();
+    for (const std::string &cmd : cmds)
+    {
+      m_write_shadow.sent(cmd,(written_bytes == msg.size()));
+    }
+    return (written_bytes == msg.size());
+  }
+
   void Device::set_timeout_ms(uint32_t t)
   {
-    serial::Timeout to = serial::Timeout::simpleTimeout(t);
-  m_serial.setTimeout(to);
+    transport().set_timeout_ms(t);
 
   #ifdef DEBUG
     std::cout << "Device::set_timeout_ms : Setting timeout to [" << t << "] ms" << std::endl;
@@ -88,7 +134,7 @@ namespace device
   {
 
     // m_serial.waitReadable()
-    size_t nbytes = m_serial.readline(answer, 0xFFFF, m_read_sfx);
+    size_t nbytes = transport().readline(answer, 0xFFFF, m_read_sfx);
     // one should remove the chars
 #ifdef DEBUG
     std::cout << "Device::read_cmd : Received " << nbytes << " bytes answer [" << util::escape(answer.c_str()) << "]" << std::endl;
@@ -103,6 +149,11 @@ namespace device
   {
     return false;
   }
+  // cut short by the timeout: not an answer
+  if (answer.compare(answer.size() - m_read_sfx.size(),m_read_sfx.size(),m_read_sfx) != 0)
+  {
+    return false;
+  }
   // careful with the trim
   // if for some reason the answer is not valid, we can hit an exception here
   if (answer.size() < m_read_sfx.size())
@@ -122,11 +173,11 @@ namespace device
     return true;
   }
 
-  bool Device::read_lines(std::vector<std::string> &lines)
+  bool Device::read_lines(std::vector<std::string> &lines, const size_t expected_lines)
   {
     // wait for the port to be ready
     //size_t nbytes = 0;
-    lines = m_serial.readlines(0xFFFF,m_read_sfx);
+    lines = transport().readlines(0xFFFF,m_read_sfx,expected_lines);
   #ifdef DEBUG
     std::cout << "Device::read_lines : Received " << lines.size() << " strings" << std::endl;
     for (auto entry: lines)
@@ -134,13 +185,314 @@ namespace device
       std::cout << "[" << util::escape(entry.c_str()) << "]" << std::endl;
     }
   #endif
-  return true;
+    size_t complete = lines.size();
+    if (complete && ((lines.back().size() < m_read_sfx.size()) ||
+        (lines.back().compare(lines.back().size() - m_read_sfx.size(),m_read_sfx.size(),m_read_sfx) != 0)))
+    {
+      // cut short by the timeout
+      complete--;
+    }
+    return (complete >= expected_lines);
+  }
+
+  void Device::attach(Reactor &r, const uint32_t min_interval_ms)
+  {
+    detach();
+    if (!transport().is_open())
+    {
+      m_transport->open();
+    }
+    serial::Serial *port = m_transport->serial_port();
+    if (port == nullptr)
+    {
+      throw std::runtime_error("Device::attach : the transport is not a serial port");
+    }
+    m_reactor_port = r.add_port(*port,std::max(min_interval_ms,m_cmd_interval_ms));
+    m_reactor = &r;
+  }
+
+  void Device::detach()
+  {
+    if (m_reactor != nullptr)
+    {
+      m_reactor->remove_port(m_reactor_port);
+      m_reactor = nullptr;
+      m_reactor_port = -1;
+    }
+  }
+
+  void Device::start_capture(const std::string &path)
+  {
+    serial::Serial *port = transport().serial_port();
+    if (port == nullptr)
+    {
+      throw std::runtime_error("Device::start_capture : the transport is not a serial port");
+    }
+    std::shared_ptr<TrafficRecorder> capture = std::make_shared<TrafficRecorder>(path);
+    stop_capture();
+    port->setTap(capture);
+    m_capture = capture;
+  }
+
+  void Device::stop_capture()
+  {
+    if (!m_capture)
+    {
+      return;
+    }
+    serial::Serial *port = m_transport->serial_port();
+    if (port != nullptr)
+    {
+      port->setTap(nullptr);
+    }
+    // a read or write still running may hold the recorder: it goes when they
+    // are done, but the file is complete now
+    m_capture->close();
+    m_capture.reset();
+  }
+
+  void Device::post_cmd(const std::string cmd, const size_t lines, Reactor::Callback cb)
+  {
+    if (m_reactor == nullptr)
+    {
+      throw std::runtime_error("Device is not attached to a reactor");
+    }
+    std::string msg = m_com_pre + cmd + m_com_sfx;
+#ifdef DEBUG
+    std::cout << "Device::post_cmd : Posting command [" << util::escape(msg.c_str()) << "]" << std::endl;
+#endif
+    m_query_cache.sent(cmd);
+    // whether it gets through is only known later: forget the setting
+    m_write_shadow.sent(cmd,false);
+    m_reactor->submit(m_reactor_port,Reactor::Command(msg,m_read_sfx,lines,m_timeout_ms,cb));
+  }
+
+  std::future<Device::Response> Device::submit(const std::string cmd, const size_t lines)
+  {
+    if (m_reactor != nullptr)
+    {
+      std::shared_ptr<std::promise<Response> > p = std::make_shared<std::promise<Response> >();
+      std::future<Response> f = p->get_future();
+      post_cmd(cmd,lines,[p](bool success, std::vector<std::string> &answer)
+      {
+        Response r;
+        r.success = success;
+        r.lines.swap(answer);
+        p->set_value(r);
+      });
+      return f;
+    }
+    return run_async([this,cmd,lines]() -> Response
+    {
+      return execute(cmd,lines);
+    });
+  }
+
+  void Device::submit(const std::string cmd, const size_t lines, std::function<void(const Response &)> cb)
+  {
+    if (m_reactor != nullptr)
+    {
+      post_cmd(cmd,lines,[cb](bool success, std::vector<std::string> &answer)
+      {
+        Response r;
+        r.success = success;
+        r.lines.swap(answer);
+        cb(r);
+      });
+      return;
+    }
+    start_worker();
+    enqueue([this,cmd,lines,cb]()
+    {
+      Response r;
+      try
+      {
+        r = execute(cmd,lines);
+      }
+      catch(std::exception &e)
+      {
+#ifdef DEBUG
+        std::cout << "Device::submit : Command failed : " << e.what() << std::endl;
+#endif
+        r.success = false;
+      }
+      cb(r);
+    });
+  }
+
+  Device::Response Device::execute(const std::string cmd, const size_t lines)
+  {
+    Response r;
+    r.success = write_cmd(cmd);
+    if (!r.success || lines == 0)
+    {
+      return r;
+    }
+    r.success = (read_lines(r.lines,lines) && (r.lines.size() == lines));
+    return r;
+  }
+
+  void Device::start_worker()
+  {
+    // a job of a worker being stopped: it must not wait for stop_worker
+    if (has_worker() || std::this_thread::get_id() == m_worker_id.load())
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_worker_ctl);
+    if (has_worker())
+    {
+      return;
+    }
+    if (sem_init(&m_worker_sem,0,0) == -1)
+    {
+      throw serial::IOException(__FILE__,__LINE__,errno);
+    }
+    m_worker_stop = false;
+    m_worker = std::thread(&Device::worker_loop,this);
+    // the id is in place before anyone can see the worker running
+    m_worker_id.store(m_worker.get_id());
+    m_worker_run.store(true);
+  }
+
+  void Device::stop_worker()
+  {
+    if (std::this_thread::get_id() == m_worker_id.load())
+    {
+      throw std::logic_error("Device::stop_worker called from the worker thread");
+    }
+    std::lock_guard<std::mutex> lock(m_worker_ctl);
+    if (!has_worker())
+    {
+      return;
+    }
+    // from now on enqueue runs the jobs itself; wait for the producers that
+    // got in before, so that all their jobs are queued ahead of the stop request
+    m_worker_run.store(false);
+    while (m_producers.load() != 0)
+    {
+      std::this_thread::yield();
+    }
+    m_jobs.push([this]() {m_worker_stop = true;});
+    sem_post(&m_worker_sem);
+    m_worker.join();
+    // nobody can post anymore
+    sem_destroy(&m_worker_sem);
+    m_worker_id.store(std::thread::id());
+  }
+
+  void Device::enqueue(std::function<void()> job)
+  {
+    m_producers.fetch_add(1);
+    if (!m_worker_run.load())
+    {
+      // the worker is stopping (or gone): serve the job here
+      m_producers.fetch_sub(1);
+      IOLock io(*this);
+      job();
+      return;
+    }
+    m_jobs.push(job);
+    sem_post(&m_worker_sem);
+    m_producers.fetch_sub(1);
+  }
+
+  void Device::worker_loop()
+  {
+#ifdef DEBUG
+    std::cout << "Device::worker_loop : Starting I/O worker for [" << m_comport << "]" << std::endl;
+#endif
+    while (true)
+    {
+      while (sem_wait(&m_worker_sem) == -1 && errno == EINTR)
+      {
+      }
+      std::function<void()> job;
+      // a producer may be halfway through the push
+      while (!m_jobs.pop(job))
+      {
+        std::this_thread::yield();
+      }
+      {
+        IOLock lock(*this);
+        job();
+      }
+      if (m_worker_stop)
+      {
+        break;
+      }
+    }
+#ifdef DEBUG
+    std::cout << "Device::worker_loop : Stopped I/O worker for [" << m_comport << "]" << std::endl;
+#endif
+  }
+
+  Device::IOLock::IOLock (Device &d)
+    : m_device(d)
+  {
+    m_device.m_io_mutex.lock();
+    if (m_device.m_io_depth++ == 0)
+    {
+      m_device.m_io_owner.store(std::this_thread::get_id());
+    }
+  }
+
+  Device::IOLock::~IOLock ()
+  {
+    if (--m_device.m_io_depth == 0)
+    {
+      m_device.m_io_owner.store(std::thread::id());
+    }
+    m_device.m_io_mutex.unlock();
+  }
+
+  void Device::pace()
+  {
+    if (m_cmd_interval_ms == 0)
+    {
+      return;
+    }
+    // absolute deadline: returns immediately if it is already in the past
+    int rc;
+    while ((rc = clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&m_next_cmd,nullptr)) == EINTR)
+    {
+    }
+  }
+
+  void Device::mark_cmd_sent()
+  {
+    if (m_cmd_interval_ms == 0)
+    {
+      return;
+    }
+    clock_gettime(CLOCK_MONOTONIC,&m_next_cmd);
+    m_next_cmd.tv_sec += m_cmd_interval_ms / 1000;
+    m_next_cmd.tv_nsec += static_cast<long>(m_cmd_interval_ms % 1000) * 1000000L;
+    if (m_next_cmd.tv_nsec >= 1000000000L)
+    {
+      m_next_cmd.tv_sec += 1;
+      m_next_cmd.tv_nsec -= 1000000000L;
+    }
   }
 
   void Device::reset_connection()
   {
-    m_serial.close();
-    m_serial.open();
+    IOLock lock(*this);
+    // it may not be the same instrument when it comes back
+    m_query_cache.clear();
+    m_write_shadow.clear();
+    transport().close();
+    m_transport->open();
+  }
+
+  void Device::open_transport()
+  {
+    if (!m_transport)
+    {
+      m_transport.reset(new SerialTransport(m_comport,m_baud));
+    }
+    m_transport->set_timeout_ms(m_timeout_ms);
+    m_transport->open();
   }
 
 } /* namespace device */
@@ -0,0 +1,210 @@
+/*
+ * DeviceProbe.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <DeviceProbe.hh>
+#include <Reactor.hh>
+#include <PortIndex.hh>
+#include <utilities.hh>
+#include <serial/serial.h>
+#include <chrono>
+#include <memory>
+#include <cctype>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  const char *ProbeResult::kind_name(const Kind k)
+  {
+    switch (k)
+    {
+      case Ophir:
+        return "power_meter";
+      case Surelite:
+        return "laser";
+      case Attenuator:
+        return "attenuator";
+      default:
+        return "unknown";
+    }
+  }
+
+  namespace
+  {
+    typedef std::chrono::steady_clock Clock;
+
+    // one port being probed
+    struct Session
+    {
+      std::unique_ptr<serial::Serial> serial;
+      int id;
+      ProbeResult result;
+    };
+
+    // "* VEGA 654321 VEGA" -> "VEGA 654321 VEGA"
+    std::string ophir_payload(const std::string &line)
+    {
+      return util::trim(util::trim(line).substr(1));
+    }
+
+    bool is_code(const std::string &s)
+    {
+      return (s.size() == 2 && std::isdigit(static_cast<unsigned char>(s[0])) &&
+              std::isdigit(static_cast<unsigned char>(s[1])));
+    }
+  }
+
+  std::map<std::string,ProbeResult> DeviceProbe::probe(const std::vector<std::string> &ports)
+  {
+    std::map<std::string,ProbeResult> results;
+    std::vector<std::shared_ptr<Session> > sessions;
+    const Clock::time_point t0 = Clock::now();
+    for (const std::string &port : ports)
+    {
+      std::shared_ptr<Session> s = std::make_shared<Session>();
+      s->id = -1;
+      s->result.port = port;
+      serial::PortInfo pi;
+      if (util::PortIndex::instance().find(port,pi) && pi.port == port)
+      {
+        s->result.adapter_serial = util::serial_number(pi.hardware_id);
+      }
+      try
+      {
+        s->serial.reset(new serial::Serial());
+        s->serial->setPort(port);
+        s->serial->setBaudrate(9600);
+        s->serial->open();
+        sessions.push_back(s);
+      }
+      catch(std::exception &e)
+      {
+        s->result.error = e.what();
+        results[port] = s->result;
+      }
+    }
+    if (sessions.empty())
+    {
+      return results;
+    }
+
+    // the reactor goes before the ports
+    Reactor r;
+    size_t remaining = sessions.size();
+    const uint32_t deadline = m_deadline_ms;
+    std::function<void(Session&)> finish = [&r,&remaining,t0](Session &s)
+    {
+      s.result.elapsed_ms = std::chrono::duration<double,std::milli>(Clock::now() - t0).count();
+#ifdef DEBUG
+      std::cout << "DeviceProbe::probe : [" << s.result.port << "] is "
+          << ProbeResult::kind_name(s.result.kind) << " after " << s.result.elapsed_ms << " ms" << std::endl;
+#endif
+      if (--remaining == 0)
+      {
+        r.stop();
+      }
+    };
+
+    for (std::shared_ptr<Session> &sp : sessions)
+    {
+      Session *s = sp.get();
+      s->id = r.add_port(*s->serial,m_gap_ms);
+      // the attenuator, at its own rate
+      Reactor::Callback on_n = [s,finish](bool ok, std::vector<std::string> &lines)
+      {
+        if (ok && !lines.empty() && lines[0].size() > 1 && lines[0][0] == 'n')
+        {
+          s->result.kind = ProbeResult::Attenuator;
+          s->result.serial_number = util::trim(lines[0].substr(1));
+          s->result.info = "n " + s->result.serial_number;
+        }
+        finish(*s);
+      };
+      // the Surelite echoes the command, then sends the code
+      Reactor::Callback on_se = [s,&r,deadline,finish,on_n](bool ok, std::vector<std::string> &lines)
+      {
+        if (ok && lines.size() == 2 && util::trim(lines[0]) == "SE" && is_code(util::trim(lines[1])))
+        {
+          s->result.kind = ProbeResult::Surelite;
+          s->result.info = "SE " + util::trim(lines[1]);
+          finish(*s);
+          return;
+        }
+        try
+        {
+          // the port is idle here (the reactor calls back between commands)
+          s->serial->setBaudrate(38400);
+        }
+        catch(std::exception &e)
+        {
+          s->result.error = e.what();
+          finish(*s);
+          return;
+        }
+        r.submit(s->id,Reactor::Command("\r","",0,deadline,nullptr));
+        r.submit(s->id,Reactor::Command("n\r","\n\r",1,deadline,on_n));
+      };
+      Reactor::Callback on_hi = [s,finish](bool ok, std::vector<std::string> &lines)
+      {
+        if (ok && !lines.empty() && util::trim(lines[0]).compare(0,1,"*") == 0)
+        {
+          s->result.info += "; head " + ophir_payload(lines[0]);
+        }
+        finish(*s);
+      };
+      Reactor::Callback on_ii = [s,&r,deadline,on_hi,on_se](bool ok, std::vector<std::string> &lines)
+      {
+        if (ok && !lines.empty() && util::trim(lines[0]).compare(0,1,"*") == 0)
+        {
+          // id, serial number, name
+          s->result.kind = ProbeResult::Ophir;
+          std::string payload = ophir_payload(lines[0]);
+          s->result.info = payload;
+          std::vector<std::string> tokens;
+          util::tokenize_string(payload,tokens," ");
+          if (tokens.size() > 1)
+          {
+            s->result.serial_number = tokens[1];
+          }
+          r.submit(s->id,Reactor::Command("$HI\r\n","\r\n",1,deadline,on_hi));
+          return;
+        }
+        r.submit(s->id,Reactor::Command("\r","",0,deadline,nullptr));
+        r.submit(s->id,Reactor::Command("SE\r","\r",2,deadline,on_se));
+      };
+      r.submit(s->id,Reactor::Command("$II\r\n","\r\n",1,deadline,on_ii));
+    }
+    r.run();
+
+    for (std::shared_ptr<Session> &s : sessions)
+    {
+      r.remove_port(s->id);
+    }
+    r.run_once(0);
+    for (std::shared_ptr<Session> &s : sessions)
+    {
+      s->serial->close();
+      results[s->result.port] = s->result;
+    }
+    return results;
+  }
+
+  std::map<std::string,ProbeResult> DeviceProbe::probe_all()
+  {
+    std::vector<std::string> ports;
+    for (const serial::PortInfo &p : util::PortIndex::instance().ports())
+    {
+      ports.push_back(p.port);
+    }
+    return probe(ports);
+  }
+
+} /* namespace device */
@@ -0,0 +1,731 @@
+/*
+ * Emulators.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <Emulators.hh>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  static uint64_t now_ns()
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+
+  // command letters and the argument that follows them
+  static void split_command(const std::string &cmd, std::string &key, std::string &arg)
+  {
+    const size_t sp = cmd.find(' ');
+    key = cmd.substr(0,sp);
+    arg = (sp == std::string::npos) ? "" : cmd.substr(sp + 1);
+  }
+
+  static bool parse_long(const std::string &arg, long &value)
+  {
+    char *end = nullptr;
+    value = std::strtol(arg.c_str(),&end,10);
+    return (end != arg.c_str());
+  }
+
+  ///
+  /// SureliteModel
+  ///
+
+  SureliteModel::SureliteModel ()
+    : ScriptedModel("\r"),
+      m_security("00"),
+      m_firing(false),
+      m_shutter(false),
+      m_prescale(0),
+      m_hv(1.1),
+      m_rate(10.0),
+      m_qswitch(170),
+      m_shots(0.0),
+      m_last_ns(now_ns())
+  {
+    set_echo(true);
+  }
+
+  uint64_t SureliteModel::shot_count()
+  {
+    count_shots();
+    return static_cast<uint64_t>(m_shots);
+  }
+
+  void SureliteModel::count_shots()
+  {
+    const uint64_t now = now_ns();
+    if (m_firing)
+    {
+      m_shots += m_rate * static_cast<double>(now - m_last_ns) * 1e-9;
+    }
+    m_last_ns = now;
+  }
+
+  void SureliteModel::answer(const std::string &cmd, std::string &reply)
+  {
+    count_shots();
+    std::string key, arg;
+    split_command(cmd,key,arg);
+    long v;
+    if (key == "SE")
+    {
+      reply += m_security + "\r";
+    }
+    else if (key == "SC")
+    {
+      // 9 digits, wraps around
+      char buf[16];
+      std::snprintf(buf,sizeof(buf),"%09llu\r",static_cast<unsigned long long>(m_shots) % 1000000000ULL);
+      reply += buf;
+    }
+    else if (key == "SH" && parse_long(arg,v))
+    {
+      m_shutter = (v != 0);
+    }
+    else if (key == "ST" && parse_long(arg,v))
+    {
+      m_firing = (v != 0);
+    }
+    else if (key == "PD" && parse_long(arg,v))
+    {
+      m_prescale = static_cast<uint32_t>(v);
+    }
+    else if (key == "QS" && parse_long(arg,v))
+    {
+      m_qswitch = static_cast<uint32_t>(v);
+    }
+    else if (key == "VA" && !arg.empty())
+    {
+      m_hv = std::strtod(arg.c_str(),nullptr);
+    }
+    else if (key == "RR" && !arg.empty())
+    {
+      m_rate = std::strtod(arg.c_str(),nullptr);
+    }
+    else if (key == "SS")
+    {
+      m_prescale = 0;
+      if (!m_firing)
+      {
+        m_shots += 1.0;
+      }
+    }
+    else
+    {
+      ScriptedModel::answer(cmd,reply);
+    }
+#ifdef DEBUG
+    std::cout << "SureliteModel::answer : [" << cmd << "]" << std::endl;
+#endif
+  }
+
+  ///
+  /// VegaModel
+  ///
+
+  // full scale of the ranges, as listed by AR
+  static const char *vega_ranges = "10.0J 2.00J 200mJ 20.0mJ 2.00mJ ";
+  static const double vega_full_scale[] = {10.0, 2.0, 0.2, 0.02, 0.002};
+  static const int32_t vega_n_ranges = 5;
+
+  VegaModel::VegaModel ()
+    : ScriptedModel("\r\n"),
+      m_range(4),
+      m_wavelength(1),
+      m_average(1),
+      m_bc20(2),
+      m_mains(1),
+      m_mode(3),
+      m_pulse_length(1),
+      m_threshold(1),
+      m_e_threshold(1),
+      m_wavelengths({"266","355","532","1064","2100","2940"}),
+      m_rate(0.0),
+      m_energy(0.0),
+      m_spread(0.0),
+      m_rng(0x5eed),
+      m_next_ns(0),
+      m_pulses(0),
+      m_last(0.0),
+      m_new(false),
+      m_exposure(0.0),
+      m_exposure_pulses(0),
+      m_exposure_start_ns(now_ns())
+  {
+    set_default("?UNKNOWN COMMAND\r\n");
+  }
+
+  void VegaModel::set_pulses(const double rate_hz, const double energy_j, const double spread)
+  {
+    take_pulses();
+    m_rate = rate_hz;
+    m_energy = energy_j;
+    m_spread = spread;
+    m_next_ns = now_ns();
+    if (m_rate > 0.0)
+    {
+      m_next_ns += static_cast<uint64_t>(1e9 / m_rate);
+    }
+  }
+
+  void VegaModel::take_pulses()
+  {
+    if (m_rate <= 0.0)
+    {
+      return;
+    }
+    const uint64_t now = now_ns();
+    if (now < m_next_ns)
+    {
+      return;
+    }
+    const uint64_t period = static_cast<uint64_t>(1e9 / m_rate);
+    const uint64_t n = (now - m_next_ns) / period + 1;
+    m_next_ns += n * period;
+    // only the last pulse can be read out, the others just add up
+    std::normal_distribution<double> e(m_energy,m_energy * m_spread);
+    m_last = std::max(0.0,e(m_rng));
+    m_pulses += n;
+    m_exposure += m_last + static_cast<double>(n - 1) * m_energy;
+    m_exposure_pulses += n;
+    m_new = true;
+  }
+
+  void VegaModel::ok(std::string &reply, const std::string &data)
+  {
+    reply += "*" + data + "\r\n";
+  }
+
+  void VegaModel::error(std::string &reply, const std::string &what)
+  {
+    reply += "?" + what + "\r\n";
+  }
+
+  void VegaModel::answer(const std::string &cmd, std::string &reply)
+  {
+    take_pulses();
+    std::string key, arg;
+    split_command((!cmd.empty() && cmd[0] == '$') ? cmd.substr(1) : cmd,key,arg);
+    long v = 0;
+    const bool has_arg = parse_long(arg,v);
+    char buf[128];
+    if (key == "EF")
+    {
+      ok(reply,m_new ? "1" : "0");
+    }
+    else if (key == "ER")
+    {
+      ok(reply,(m_pulses > 0) ? "1" : "0");
+    }
+    else if (key == "SE")
+    {
+      std::snprintf(buf,sizeof(buf),"%.3E",m_last);
+      m_new = false;
+      ok(reply,buf);
+    }
+    else if (key == "SG")
+    {
+      std::snprintf(buf,sizeof(buf),"%.3E",m_last);
+      ok(reply,buf);
+    }
+    else if (key == "SP")
+    {
+      std::snprintf(buf,sizeof(buf),"%.3E",m_energy * m_rate);
+      ok(reply,buf);
+    }
+    else if (key == "SF")
+    {
+      if (m_rate < 1.0)
+      {
+        error(reply,"FREQ TOO LOW");
+      }
+      else
+      {
+        std::snprintf(buf,sizeof(buf),"%.2f",m_rate);
+        ok(reply,buf);
+      }
+    }
+    else if (key == "SI")
+    {
+      ok(reply,(m_mode == 2) ? "W" : "J");
+    }
+    else if (key == "SX")
+    {
+      if (m_range < 0)
+      {
+        ok(reply,"AUTO");
+      }
+      else
+      {
+        std::snprintf(buf,sizeof(buf),"%.2E",vega_full_scale[m_range]);
+        ok(reply,buf);
+      }
+    }
+    else if (key == "EE")
+    {
+      std::snprintf(buf,sizeof(buf)," %.3E %llu %llu",m_exposure,
+                    static_cast<unsigned long long>(m_exposure_pulses),
+                    static_cast<unsigned long long>((now_ns() - m_exposure_start_ns) / 1000000000ULL));
+      ok(reply,buf);
+    }
+    else if (key == "AF")
+    {
+      ok(reply,(m_average > 1) ? "1" : "0");
+    }
+    else if (key == "AQ")
+    {
+      if (has_arg && v > 0)
+      {
+        if (v > 6)
+        {
+          error(reply,"BAD PARAMETER");
+          return;
+        }
+        m_average = static_cast<uint32_t>(v);
+      }
+      std::snprintf(buf,sizeof(buf)," %u      NONE 0.5sec   1sec   3sec  10sec  30sec ",m_average);
+      ok(reply,buf);
+    }
+    else if (key == "AR")
+    {
+      std::snprintf(buf,sizeof(buf),"%d %s",m_range,vega_ranges);
+      ok(reply,buf);
+    }
+    else if (key == "WN")
+    {
+      if (!has_arg || v < -1 || v >= vega_n_ranges)
+      {
+        error(reply,"BAD PARAMETER");
+        return;
+      }
+      m_range = static_cast<int32_t>(v);
+      ok(reply);
+    }
+    else if (key == "RN")
+    {
+      ok(reply,std::to_string(m_range));
+    }
+    else if (key == "AW")
+    {
+      std::ostringstream s;
+      s << "CONTINUOUS 190 3000 " << m_wavelength << " ";
+      for (const std::string &w : m_wavelengths)
+      {
+        s << w << " ";
+      }
+      ok(reply,s.str());
+    }
+    else if (key == "WI")
+    {
+      if (!has_arg || v < 1 || v > static_cast<long>(m_wavelengths.size()))
+      {
+        error(reply,"BAD PARAMETER");
+        return;
+      }
+      m_wavelength = static_cast<uint32_t>(v);
+      ok(reply);
+    }
+    else if (key == "WL")
+    {
+      if (!has_arg || v < 190 || v > 3000)
+      {
+        error(reply,"WAVELENGTH OUT OF RANGE");
+        return;
+      }
+      ok(reply);
+    }
+    else if (key == "BQ")
+    {
+      if (has_arg && v > 0)
+      {
+        if (v > 2)
+        {
+          error(reply,"BAD PARAMETER");
+          return;
+        }
+        m_bc20 = static_cast<uint32_t>(v);
+      }
+      ok(reply," " + std::to_string(m_bc20) + " HOLD CONTINUOUS");
+    }
+    else if (key == "DQ" || key == "FQ")
+    {
+      // a pyroelectric head has neither diffuser nor filter
+      ok(reply," N/A");
+    }
+    else if (key == "MA")
+    {
+      if (has_arg && v > 0)
+      {
+        if (v > 2)
+        {
+          error(reply,"BAD PARAMETER");
+          return;
+        }
+        m_mains = static_cast<uint32_t>(v);
+      }
+      ok(reply," " + std::to_string(m_mains) + " 50Hz 60Hz");
+    }
+    else if (key == "MM")
+    {
+      if (!has_arg || v == 0)
+      {
+        ok(reply,std::to_string(m_mode));
+        return;
+      }
+      // the head does no power
+      if (v < 1 || v > 4 || v == 2)
+      {
+        error(reply,"BAD PARAMETER");
+        return;
+      }
+      m_mode = static_cast<uint32_t>(v);
+      ok(reply);
+    }
+    else if (key == "FE" || key == "FP" || key == "FX")
+    {
+      m_mode = (key == "FE") ? 3 : (key == "FX") ? 4 : 2;
+      if (key == "FX")
+      {
+        m_exposure = 0.0;
+        m_exposure_pulses = 0;
+        m_exposure_start_ns = now_ns();
+      }
+      ok(reply);
+    }
+    else if (key == "PL")
+    {
+      if (!has_arg || v == 0)
+      {
+        ok(reply,std::to_string(m_pulse_length) + " 1.0ms 2.0ms 5.0ms 10ms 20ms ");
+        return;
+      }
+      if (v < 1 || v > 5)
+      {
+        error(reply,"BAD PARAMETER");
+        return;
+      }
+      m_pulse_length = static_cast<uint32_t>(v);
+      ok(reply);
+    }
+    else if (key == "ET")
+    {
+      if (has_arg && v > 0)
+      {
+        if (v > 3)
+        {
+          error(reply,"BAD PARAMETER");
+          return;
+        }
+        m_e_threshold = static_cast<uint32_t>(v);
+      }
+      ok(reply,std::to_string(m_e_threshold));
+    }
+    else if (key == "UT")
+    {
+      if (!has_arg || v == 0)
+      {
+        ok(reply,std::to_string(m_threshold) + " 1 99");
+        return;
+      }
+      if (v < 1 || v > 99)
+      {
+        error(reply,"BAD PARAMETER");
+        return;
+      }
+      m_threshold = static_cast<uint32_t>(v);
+      ok(reply);
+    }
+    else if (key == "MF")
+    {
+      ok(reply,"100");
+    }
+    else if (key == "HI")
+    {
+      ok(reply," PE 123456 PE25-C 80000001");
+    }
+    else if (key == "HT")
+    {
+      ok(reply,"PE");
+    }
+    else if (key == "II")
+    {
+      ok(reply," VEGA 654321 VEGA");
+    }
+    else if (key == "VE")
+    {
+      ok(reply,"VEGA V1.21");
+    }
+    else if (key == "IC" || key == "RE")
+    {
+      ok(reply);
+    }
+    else
+    {
+      ScriptedModel::answer(cmd,reply);
+    }
+  }
+
+  ///
+  /// AttenuatorModel
+  ///
+
+  AttenuatorModel::AttenuatorModel ()
+    : ScriptedModel("\r"),
+      m_from(0),
+      m_target(0),
+      m_move_start_ns(0),
+      m_max_speed(59000),
+      m_acceleration(0),
+      m_deceleration(0),
+      m_current_move(100),
+      m_current_idle(10),
+      m_resolution(2),
+      m_enabled(true),
+      m_name("            ATTEN001")
+  {
+  }
+
+  int32_t AttenuatorModel::position()
+  {
+    if (m_from == m_target)
+    {
+      return static_cast<int32_t>(m_target);
+    }
+    const double dt = static_cast<double>(now_ns() - m_move_start_ns) * 1e-9;
+    const int64_t done = static_cast<int64_t>(dt * m_max_speed);
+    const int64_t dist = m_target - m_from;
+    if (done >= std::llabs(dist))
+    {
+      m_from = m_target;
+      return static_cast<int32_t>(m_target);
+    }
+    return static_cast<int32_t>(m_from + ((dist > 0) ? done : -done));
+  }
+
+  bool AttenuatorModel::moving()
+  {
+    position();
+    return (m_from != m_target);
+  }
+
+  void AttenuatorModel::move_to(const int64_t target)
+  {
+    m_from = position();
+    m_target = target;
+    m_move_start_ns = now_ns();
+  }
+
+  void AttenuatorModel::stop_here()
+  {
+    m_from = position();
+    m_target = m_from;
+  }
+
+  void AttenuatorModel::answer(const std::string &cmd, std::string &reply)
+  {
+    std::string key, arg;
+    split_command(cmd,key,arg);
+    long v = 0;
+    const bool has_arg = parse_long(arg,v);
+    if (key == "o")
+    {
+      const int32_t pos = position();
+      // 0 stopped, 3 running
+      reply += "o" + std::to_string(moving() ? 3 : 0) + ";" + std::to_string(pos) + "\n\r";
+    }
+    else if (key == "p")
+    {
+      reply += std::string("p") + (moving() ? "3" : "0") + "\n\r";
+    }
+    else if (key == "pc")
+    {
+      std::ostringstream s;
+      s << "pc" << 1 << ";" << (moving() ? 3 : 0) << ";" << m_acceleration << ";" << m_deceleration
+        << ";" << m_max_speed << ";" << m_current_move << ";" << m_current_idle << ";" << 0
+        << ";" << m_resolution << ";" << (m_enabled ? 1 : 0);
+      // reserved, reset and report on zero, step-dir settings
+      for (size_t i = 10; i < 24; i++)
+      {
+        s << ";0";
+      }
+      s << ";\n\r";
+      reply += s.str();
+    }
+    else if (key == "n")
+    {
+      reply += "n" + m_name + "\n\r";
+    }
+    else if (key == "m" && has_arg)
+    {
+      move_to(position() + v);
+    }
+    else if (key == "g" && has_arg)
+    {
+      move_to(v);
+    }
+    else if (key == "zp")
+    {
+      move_to(0);
+    }
+    else if ((key == "i" && has_arg) || key == "h")
+    {
+      stop_here();
+      m_from = m_target = (key == "h") ? 0 : v;
+    }
+    else if (key == "st" || key == "b")
+    {
+      stop_here();
+    }
+    else if (key == "s" && has_arg)
+    {
+      m_max_speed = static_cast<uint32_t>(v);
+    }
+    else if (key == "a" && has_arg)
+    {
+      m_acceleration = static_cast<uint32_t>(v) & 0xFF;
+    }
+    else if (key == "d" && has_arg)
+    {
+      m_deceleration = static_cast<uint32_t>(v) & 0xFF;
+    }
+    else if (key == "wm" && has_arg)
+    {
+      m_current_move = static_cast<uint32_t>(v) & 0xFF;
+    }
+    else if (key == "ws" && has_arg)
+    {
+      m_current_idle = static_cast<uint32_t>(v) & 0xFF;
+    }
+    else if (key == "r" && has_arg)
+    {
+      m_resolution = static_cast<uint32_t>(v);
+    }
+    else if (key == "sn")
+    {
+      m_name = arg;
+    }
+    else if (key == "j")
+    {
+      stop_here();
+    }
+    else if (key == "ss")
+    {
+      // settings are kept anyway
+    }
+    else
+    {
+      ScriptedModel::answer(cmd,reply);
+    }
+  }
+
+  ///
+  /// FaultyModel
+  ///
+
+  FaultyModel::FaultyModel (std::shared_ptr<DeviceModel> model, const FaultProfile &profile, const uint64_t seed)
+    : m_model(model),
+      m_profile(profile),
+      m_counts(),
+      m_rng(seed),
+      m_dead_until_ns(0),
+      m_delay_ns(0)
+  {
+  }
+
+  void FaultyModel::set_profile(const FaultProfile &profile)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_profile = profile;
+  }
+
+  FaultCounts FaultyModel::counts() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counts;
+  }
+
+  void FaultyModel::reset_counts()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counts = FaultCounts();
+  }
+
+  void FaultyModel::receive(const char *data, const size_t len, std::string &reply)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_delay_ns = 0;
+    const uint64_t now = now_ns();
+    if (now < m_dead_until_ns)
+    {
+      m_counts.lost_input += len;
+      return;
+    }
+    const size_t before = reply.size();
+    m_model->receive(data,len,reply);
+    if (reply.size() == before)
+    {
+      return;
+    }
+    m_counts.replies++;
+    std::uniform_real_distribution<double> u(0.0,1.0);
+    double x = u(m_rng);
+    const size_t n = reply.size() - before;
+    // one draw, walked through the faults in order
+    if ((x -= m_profile.drop) < 0.0)
+    {
+      reply.erase(before);
+      m_counts.dropped++;
+    }
+    else if ((x -= m_profile.garble) < 0.0)
+    {
+      std::uniform_int_distribution<size_t> pos(before,reply.size() - 1);
+      std::uniform_int_distribution<int> byte(0x20,0x7E);
+      const size_t hits = std::min<size_t>(n,3);
+      for (size_t i = 0; i < hits; i++)
+      {
+        reply[pos(m_rng)] = static_cast<char>(byte(m_rng));
+      }
+      m_counts.garbled++;
+    }
+    else if ((x -= m_profile.partial) < 0.0)
+    {
+      // keep at least a byte, lose at least the last
+      std::uniform_int_distribution<size_t> keep(1,(n > 1) ? n - 1 : 1);
+      reply.erase(before + ((n > 1) ? keep(m_rng) : 0));
+      m_counts.partial++;
+    }
+    else if ((x -= m_profile.delay) < 0.0)
+    {
+      m_delay_ns = static_cast<uint64_t>(m_profile.delay_ms) * 1000000ULL;
+      m_counts.delayed++;
+    }
+    else if ((x -= m_profile.error) < 0.0)
+    {
+      reply.replace(before,n,m_profile.error_reply);
+      m_counts.errors++;
+    }
+    else if ((x -= m_profile.disconnect) < 0.0)
+    {
+      reply.erase(before);
+      m_dead_until_ns = now + static_cast<uint64_t>(m_profile.disconnect_ms) * 1000000ULL;
+      m_counts.disconnects++;
+    }
+  }
+
+} /* namespace device */
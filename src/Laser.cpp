@@ -19,8 +19,8 @@
 
 namespace device {
 
-Laser::Laser (const char* port, const uint32_t baud_rate)
-: Device(port,baud_rate),
+Laser::Laser (const char* port, const uint32_t baud_rate, Transport *transport)
+: Device(port,baud_rate,transport),
   m_is_firing(false),
   m_prescale(0),
   m_pump_hv(1.1),
@@ -31,6 +31,13 @@ Laser::Laser (const char* port, const uint32_t baud_rate)
 
   // this is the really messed up truth...the real termination char is the \n
   m_read_sfx = m_com_sfx;
+  // the controller needs 50 ms between commands
+  m_cmd_interval_ms = 50;
+  // settings that can be skipped when unchanged (write_shadow())
+  for (const char *cmd : {"PD","VA","RR","QS"})
+  {
+    m_write_shadow.track(cmd);
+  }
   // -- change the timeout to something smaller
   // 50 ms?
   // by default leave timeout to max
@@ -57,15 +64,8 @@ Laser::Laser (const char* port, const uint32_t baud_rate)
   // 8 bit byte
   // no parity
   // 1 stop bit
-  m_serial.setPort(m_comport);
-  m_serial.setBaudrate(m_baud);
-  m_serial.setBytesize(serial::eightbits);
-  m_serial.setParity(serial::parity_none);
-  m_serial.setStopbits(serial::stopbits_one);
-  serial::Timeout t = serial::Timeout::simpleTimeout(m_timeout_ms);
-  m_serial.setTimeout(t);
-  m_serial.open();
-  if (!m_serial.isOpen())
+  open_transport();
+  if (!is_open())
   {
     std::ostringstream msg;
     msg << "Failed to open the port ["<< m_comport << ":" << m_baud << "]";
@@ -84,7 +84,8 @@ Laser::Laser (const char* port, const uint32_t baud_rate)
 
 Laser::~Laser ()
 {
-
+  // the worker may be running methods of this class
+  stop_worker();
 }
 
 void Laser::shutter(enum Shutter s)
@@ -215,6 +216,8 @@ void Laser::set_pump_voltage(float hv)
 void Laser::single_shot()
 {
   // set the prescale to 0 first, regardless of the previous value
+  // (and of what the write shadow believes it is)
+  m_write_shadow.forget("PD");
   set_prescale(0);
 
   std::string cmd = "SS";
@@ -236,6 +239,11 @@ void Laser::single_shot()
 
 void Laser::get_shot_count(uint32_t &count)
 {
+  if (off_worker())
+  {
+    return run_on_worker([&]() {get_shot_count(count);});
+  }
+  IOLock io(*this);
   std::string cmd = "SC";
 
    write_cmd(cmd);
@@ -243,7 +251,7 @@ void Laser::get_shot_count(uint32_t &count)
    //read_cmd(resp);
 
    std::vector<std::string> lines;
-   read_lines(lines);
+   read_lines(lines,m_query_answer_lines);
 
 #ifdef DEBUG
   std::cout << "Laser::security : Received [" << lines.size() << "] answer tokens" << std::endl;
@@ -251,7 +259,7 @@ void Laser::get_shot_count(uint32_t &count)
   if (lines.size() == 0)
   {
     reset_connection();
-    read_lines(lines);
+    read_lines(lines,m_query_answer_lines);
     if (lines.size() == 0)
     {
       throw serial::IOException(__FILE__,__LINE__,"Failed to read shot count");
@@ -326,6 +334,11 @@ void Laser::security(Security &code,std::string &msg)
 
 void Laser::security(std::string &code)
 {
+  if (off_worker())
+  {
+    return run_on_worker([&]() {security(code);});
+  }
+  IOLock io(*this);
   /* pp. 42 of manual
    * The response to SE is a 2 digit ASCII code, terminated by a Carriage Return
 character. This response gives the status of the system. The possible values returned are listed in
@@ -356,12 +369,12 @@ Table 6 below.
     }  
   }
   std::vector<std::string> lines;
-  read_lines(lines);
+  read_lines(lines,m_query_answer_lines);
   if (lines.size() == 0)
   {
     // failed to read. We already set the connection once. Just throw or try again?
     reset_connection();
-    read_lines(lines);
+    read_lines(lines,m_query_answer_lines);
     if (lines.size() == 0)
     {
       throw serial::IOException(__FILE__,__LINE__,std::string("Failed to read security code").c_str());
@@ -452,14 +465,41 @@ void Laser::set_qswitch(uint32_t qs)
 }
 
 
+float Laser::get_output_rate() const
+{
+  return (m_prescale > 1) ? (m_rate / m_prescale) : m_rate;
+}
+
+std::future<std::string> Laser::async_security()
+{
+  return run_async([this]() -> std::string
+  {
+    std::string code;
+    security(code);
+    return code;
+  });
+}
+
+std::future<uint32_t> Laser::async_get_shot_count()
+{
+  return run_async([this]() -> uint32_t
+  {
+    uint32_t count;
+    get_shot_count(count);
+    return count;
+  });
+}
+
 bool Laser::write_cmd(const std::string cmd)
 {
+  // queries (command + answer) are handed to the worker as a whole by the callers
+  if (off_worker())
+  {
+    return run_on_worker([&]() {return write_cmd(cmd);});
+  }
+  IOLock io(*this);
+  // the 50 ms gap between commands is enforced by Device::write_cmd
   bool ret = Device::write_cmd(cmd);
-//  printf("Exit from write_cmd. Going to sleep for a bit\n");
-
-  // attenuator instruction on page 31 say that we need to
-  // add an interval of 50ms between commands
-  std::this_thread::sleep_for(std::chrono::milliseconds(50));
 #ifdef DEBUG
     printf("Passed here\n");
     std::cout << "Laser::write_cmd : Command submitted (" << util::escape(cmd.c_str()) << ")." << std::endl;
@@ -474,7 +514,7 @@ bool Laser::read_cmd(std::string &answer)
   // only do this wait if the timeout is not 0
   if (m_wait_read)
   {
-    if(!m_serial.waitReadable())
+    if(!transport().wait_readable())
     {
   #ifdef DEBUG
     std::cout << "Laser::read_cmd : Timed out waiting for a readable state. Attempting to read anyway." << std::endl;
@@ -482,7 +522,7 @@ bool Laser::read_cmd(std::string &answer)
     }
   }
   // Need to read it twice...the first to get the echo command, and the second to get the answer
-  nbytes = m_serial.readline(answer,0xFFFF,m_read_sfx);
+  nbytes = transport().readline(answer,0xFFFF,m_read_sfx);
 #ifdef DEBUG
   std::cout << "Laser::read_cmd : Received " << nbytes << " bytes with answer [" << util::escape(answer.c_str()) << "]" << std::endl;
 #endif
@@ -490,7 +530,7 @@ bool Laser::read_cmd(std::string &answer)
   {
     // retry
     reset_connection();
-    nbytes = m_serial.readline(answer,0xFFFF,m_read_sfx);
+    nbytes = transport().readline(answer,0xFFFF,m_read_sfx);
     if (nbytes == 0)
     {
       return false;
@@ -184,6 +184,11 @@ namespace device
       m_qswitch = qs;
   }
 
+  float LaserSim::get_output_rate() const
+  {
+    return (m_prescale > 1) ? (m_rate / m_prescale) : m_rate;
+  }
+
 
 
 
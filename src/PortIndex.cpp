@@ -0,0 +1,251 @@
+/*
+ * PortIndex.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <PortIndex.hh>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace util
+{
+
+  // the device nodes serial::list_ports() looks for
+  static bool is_serial_node(const char *name)
+  {
+    static const char *prefixes[] = {"ttyACM","ttyS","ttyUSB","tty.","cu.","rfcomm"};
+    for (const char *p : prefixes)
+    {
+      if (std::strncmp(name,p,std::strlen(p)) == 0)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::string serial_number(const std::string &hardware_id)
+  {
+    const size_t pos = hardware_id.find("SNR=");
+    if (pos == std::string::npos)
+    {
+      return "";
+    }
+    const size_t start = pos + 4;
+    const size_t end = hardware_id.find_first_of(" \t",start);
+    return hardware_id.substr(start,(end == std::string::npos) ? std::string::npos : end - start);
+  }
+
+  PortIndex &PortIndex::instance()
+  {
+    static PortIndex index;
+    return index;
+  }
+
+  PortIndex::PortIndex ()
+    : m_inotify(-1),
+      m_valid(false),
+      m_scans(0)
+  {
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify != -1 &&
+        inotify_add_watch(m_inotify,"/dev",IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) == -1)
+    {
+      ::close(m_inotify);
+      m_inotify = -1;
+    }
+#ifdef DEBUG
+    if (m_inotify == -1)
+    {
+      std::cout << "PortIndex::PortIndex : cannot watch /dev (" << std::strerror(errno)
+          << "). Ports are listed on every lookup." << std::endl;
+    }
+#endif
+  }
+
+  PortIndex::~PortIndex ()
+  {
+    if (m_inotify != -1)
+    {
+      ::close(m_inotify);
+    }
+  }
+
+  bool PortIndex::find(const std::string &key, serial::PortInfo &info)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    refresh();
+    // exact hits first. If the key names different ports in different
+    // fields, the first one listed wins (as in the scan below)
+    size_t best = m_ports.size();
+    for (const Map *m : {&m_by_serial,&m_by_port,&m_by_description,&m_by_hardware_id})
+    {
+      Map::const_iterator it = m->find(key);
+      if (it != m->end() && it->second < best)
+      {
+        best = it->second;
+      }
+    }
+    if (best == m_ports.size())
+    {
+      for (size_t i = 0; i < m_ports.size(); i++)
+      {
+        const serial::PortInfo &p = m_ports[i];
+        if (p.description.find(key) != std::string::npos ||
+            p.port.find(key) != std::string::npos ||
+            p.hardware_id.find(key) != std::string::npos)
+        {
+          best = i;
+          break;
+        }
+      }
+    }
+    if (best == m_ports.size())
+    {
+      return false;
+    }
+    info = m_ports[best];
+    return true;
+  }
+
+  std::vector<serial::PortInfo> PortIndex::ports()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    refresh();
+    return m_ports;
+  }
+
+  void PortIndex::invalidate()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_valid = false;
+  }
+
+  bool PortIndex::wait_change(const uint32_t timeout_ms)
+  {
+    if (m_inotify == -1)
+    {
+      return false;
+    }
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true)
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        drain();
+        if (!m_valid)
+        {
+          return true;
+        }
+      }
+      // other nodes of /dev come and go too: wait for the next event. Not
+      // under the lock, so that lookups go on meanwhile
+      const int64_t left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now()).count();
+      if (left <= 0)
+      {
+        return false;
+      }
+      struct pollfd pfd;
+      pfd.fd = m_inotify;
+      pfd.events = POLLIN;
+      if (poll(&pfd,1,static_cast<int>(left)) == 0)
+      {
+        return false;
+      }
+    }
+  }
+
+  uint64_t PortIndex::scans() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_scans;
+  }
+
+  void PortIndex::drain()
+  {
+    if (m_inotify == -1)
+    {
+      m_valid = false;
+      return;
+    }
+    alignas(struct inotify_event) char buf[4096];
+    while (true)
+    {
+      const ssize_t n = ::read(m_inotify,buf,sizeof(buf));
+      if (n <= 0)
+      {
+        // EAGAIN: nothing (more) pending
+        break;
+      }
+      for (ssize_t off = 0; off < n; )
+      {
+        const struct inotify_event *ev = reinterpret_cast<const struct inotify_event*>(buf + off);
+        if ((ev->mask & IN_Q_OVERFLOW) != 0 || (ev->len > 0 && is_serial_node(ev->name)))
+        {
+#ifdef DEBUG
+          std::cout << "PortIndex::drain : /dev changed (" << ((ev->len > 0) ? ev->name : "overflow")
+              << "). Rescanning on the next lookup." << std::endl;
+#endif
+          m_valid = false;
+        }
+        off += static_cast<ssize_t>(sizeof(struct inotify_event) + ev->len);
+      }
+    }
+  }
+
+  void PortIndex::refresh()
+  {
+    // events that come while scanning are left for the next lookup, which
+    // then scans again
+    drain();
+    if (m_valid)
+    {
+      return;
+    }
+    m_ports = serial::list_ports();
+    m_by_port.clear();
+    m_by_description.clear();
+    m_by_hardware_id.clear();
+    m_by_serial.clear();
+    for (size_t i = 0; i < m_ports.size(); i++)
+    {
+      const serial::PortInfo &p = m_ports[i];
+      add_key(m_by_port,p.port,i);
+      add_key(m_by_description,p.description,i);
+      if (p.hardware_id != "n/a")
+      {
+        add_key(m_by_hardware_id,p.hardware_id,i);
+      }
+      add_key(m_by_serial,serial_number(p.hardware_id),i);
+    }
+    m_valid = true;
+    m_scans++;
+#ifdef DEBUG
+    std::cout << "PortIndex::refresh : " << m_ports.size() << " ports (scan " << m_scans << ")" << std::endl;
+#endif
+  }
+
+  void PortIndex::add_key(Map &m, const std::string &key, const size_t idx)
+  {
+    if (!key.empty())
+    {
+      // the first port listed keeps a key
+      m.insert(std::make_pair(key,idx));
+    }
+  }
+
+} /* namespace util */
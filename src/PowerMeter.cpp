@@ -11,20 +11,29 @@
 #include <sstream>
 #include <thread>
 #include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <cerrno>
+#include <cctype>
+
+#include <sys/stat.h>
+#include <sys/types.h>
 
 //#define DEBUG 1
 
 namespace device {
 
-  PowerMeter::PowerMeter (const char* port, const uint32_t baud_rate)
-    : Device(port,baud_rate),
+  PowerMeter::PowerMeter (const char* port, const uint32_t baud_rate, Transport *transport)
+    : Device(port,baud_rate,transport),
       m_mmode(mmEnergy),
       m_range(2),
       m_wavelength(266),
       m_e_threshold(1),
       m_ave_query_state(aNone),
       m_pulse_length(0),
-      m_interval_between_cmds_ms(1)
+      m_pipelined(false),
+      m_have_last_energy(false),
+      m_last_energy(0.0)
 
       {
     // override the prefix
@@ -35,18 +44,12 @@ namespace device {
     m_threshold_ranges = {0xFFFF,0xFFFF};
     // this timeout is insane...
     m_timeout_ms = 1000;
+    // minimum interval between commands
+    m_cmd_interval_ms = 1;
 
-    // initialize the serial connection
-    m_serial.setPort(m_comport);
-    m_serial.setBaudrate(m_baud);
-    m_serial.setBytesize(serial::eightbits);
-    m_serial.setParity(serial::parity_none);
-    serial::Timeout t = serial::Timeout::simpleTimeout(m_timeout_ms);
-    m_serial.setTimeout(t);
-    m_serial.setStopbits(serial::stopbits_one);
-
-    m_serial.open();
-    if (!m_serial.isOpen())
+    // open the connection (the serial port unless a transport was given)
+    open_transport();
+    if (!is_open())
     {
       std::ostringstream msg;
       msg << "Failed to open the port ["<< m_comport << ":" << m_baud << "]";
@@ -74,10 +77,31 @@ namespace device {
     m_measurement_units.insert({'W',"Watts"});
     m_measurement_units.insert({'X',"No measurement"});
 
+    // answers worth keeping, and what makes them stale
+    m_query_cache.cache("VE",QueryCache::forever);
+    m_query_cache.cache("II",QueryCache::forever);
+    // a head can be swapped with the instrument on
+    m_query_cache.cache("HI",60000);
+    m_query_cache.cache("HT",60000);
+    m_query_cache.cache("SI",QueryCache::forever);
+    m_query_cache.cache("MF",QueryCache::forever);
+    // the active range moves by itself when autoranging
+    m_query_cache.cache("RN",1000);
+    m_query_cache.cache("SX",1000);
+    m_query_cache.invalidate_on("WN",{"RN","SX"});
+    m_query_cache.invalidate_on("PL",{"MF"});
+    for (const char *mode : {"MM","FE","FP","FX"})
+    {
+      m_query_cache.invalidate_on(mode,{"SI","MF","RN","SX"});
+    }
+    m_query_cache.clear_on("RE");
+
       }
 
   PowerMeter::~PowerMeter ()
   {
+    // the worker may be running methods of this class
+    stop_worker();
 
   }
 
@@ -610,6 +634,37 @@ namespace device {
   }
 
 
+  // typical answer
+  // [* PE 123456 PE25-C 80000001\r\n]
+  static void parse_head_info(std::string rr, std::string &type, std::string &sn, std::string &name, uint32_t &word)
+  {
+    // get rid of trailing and leading whitespace
+    rr = util::trim(rr);
+    // tokenize it and get rid of first entry
+    std::vector<std::string> tokens;
+    util::tokenize_string(rr, tokens, " ");
+    tokens.erase(tokens.begin());
+    type = tokens.at(0);
+    sn = tokens.at(1);
+    name = tokens.at(2);
+    word = std::stoul(tokens.at(3),0, 16);
+  }
+
+  // typical answer
+  // [* VEGA 654321 VEGA\r\n]
+  static void parse_inst_info(std::string rr, std::string &id, std::string &sn, std::string &name)
+  {
+    rr = util::trim(rr);
+    // tokenize it and get rid of first entry
+    std::vector<std::string> tokens;
+    util::tokenize_string(rr, tokens, " ");
+    // drop the first token
+    tokens.erase(tokens.begin());
+    id = tokens.at(0);
+    sn = tokens.at(1);
+    name = tokens.at(2);
+  }
+
   void PowerMeter::head_info_raw(std::string &answer)
   {
     std::string cmd = "HI";
@@ -631,16 +686,8 @@ namespace device {
   {
     std::string rr;
     head_info_raw(rr);
-    // get rid of trailing and leading whitespace
-    rr = util::trim(rr);
-    // tokenize it and get rid of first entry
-    std::vector<std::string> tokens;
-    util::tokenize_string(rr, tokens, " ");
-    tokens.erase(tokens.begin());
-    type = tokens.at(0);
-    sn = tokens.at(1);
-    name = tokens.at(2);
-    uint32_t word = std::stoul(tokens.at(3),0, 16);
+    uint32_t word;
+    parse_head_info(rr,type,sn,name,word);
 
     // power is bit 0
     power = word & (1 << 0);
@@ -700,18 +747,10 @@ namespace device {
     {
       throw serial::IOException(__FILE__, __LINE__, "Failed to query instrument info");
     }
-    rr = util::trim(rr);
 #ifdef DEBUG
     std::cout << "PowerMeter::inst_info : Got answer [" << util::escape(rr.c_str()) << "]" << std::endl;
 #endif
-    // tokenize it and get rid of first entry
-    std::vector<std::string> tokens;
-    util::tokenize_string(rr, tokens, " ");
-    // drop the first token
-    tokens.erase(tokens.begin());
-    id = tokens.at(0);
-    sn = tokens.at(1);
-    name = tokens.at(2);
+    parse_inst_info(rr,id,sn,name);
 #ifdef DEBUG
     std::cout << "PowerMeter::inst_info : \n"
         << "ID      : " << id
@@ -938,16 +977,69 @@ namespace device {
 
   bool PowerMeter::read_energy(double &energy)
   {
+    // EF and SE must go back to back
+    if (off_worker())
+    {
+      return run_on_worker([&]() {return read_energy(energy);});
+    }
+    IOLock io(*this);
     bool status;
+    if (m_pipelined)
+    {
+      // ask for both in one go
+      std::vector<std::string> resps;
+      if (!send_cmds({"EF","SE"},resps))
+      {
+        throw serial::IOException(__FILE__, __LINE__, "Failed to query energy");
+      }
+#ifdef DEBUG
+      std::cout << "PowerMeter::read_energy : got answers [" << util::escape(resps.at(0).c_str()) << "] [" << util::escape(resps.at(1).c_str()) << "]" << std::endl;
+#endif
+      // anything but an acknowledgement ('?' on an error) is a failed query
+      for (const std::string &r : resps)
+      {
+        if (r.size() < 2 || r.at(0) != '*')
+        {
+          throw serial::IOException(__FILE__, __LINE__, "Unexpected answer querying energy");
+        }
+      }
+      status = (std::stol(resps.at(0).substr(1)) == 0)?false:true;
+      const double se = std::stod(resps.at(1).substr(1));
+      // EF said no, but a pulse came before SE: SE has it, and the flag is gone
+      if (!status && m_have_last_energy && se != m_last_energy)
+      {
+        status = true;
+      }
+      if (status)
+      {
+        energy = se;
+      }
+      // with nothing returned yet, an SE answer is just the meter's last reading
+      m_have_last_energy = true;
+      m_last_energy = se;
+      return status;
+    }
     energy_flag(status);
     if (status)
     {
       // printf("Energy is ready, sending SE command\n");
       send_energy(energy);
+      m_have_last_energy = true;
+      m_last_energy = energy;
     }
     return status;
   }
 
+  std::future<std::pair<bool,double> > PowerMeter::async_read_energy()
+  {
+    return run_async([this]() -> std::pair<bool,double>
+    {
+      double energy = 0.0;
+      bool status = read_energy(energy);
+      return std::make_pair(status,energy);
+    });
+  }
+
   void PowerMeter::send_frequency(double &value)
   {
     std::string rr;
@@ -1215,6 +1307,93 @@ namespace device {
     value = rr.substr(1);
   }
 
+  // serial numbers go in file names
+  static std::string file_key(const std::string &sn)
+  {
+    std::string k = sn;
+    for (char &c : k)
+    {
+      if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+      {
+        c = '_';
+      }
+    }
+    return k;
+  }
+
+  bool PowerMeter::load_capabilities(const std::string &cache_dir)
+  {
+    // who are we talking to, in a single round trip
+    std::vector<std::string> resps;
+    if (!send_cmds({"VE","II","HI"},resps))
+    {
+      throw serial::IOException(__FILE__, __LINE__, "Failed to identify the instrument");
+    }
+#ifdef DEBUG
+    std::cout << "PowerMeter::load_capabilities : got answers [" << util::escape(resps.at(0).c_str())
+        << "] [" << util::escape(resps.at(1).c_str()) << "] [" << util::escape(resps.at(2).c_str()) << "]" << std::endl;
+#endif
+    for (const std::string &r : resps)
+    {
+      if (r.size() == 0 || r.at(0) != '*')
+      {
+        throw serial::IOException(__FILE__, __LINE__, "Unexpected answer identifying the instrument");
+      }
+    }
+    m_query_cache.store("VE",resps.at(0));
+    m_query_cache.store("II",resps.at(1));
+    m_query_cache.store("HI",resps.at(2));
+    Capabilities caps;
+    caps.firmware = util::trim(resps.at(0).substr(1));
+    parse_inst_info(resps.at(1),caps.inst_id,caps.inst_sn,caps.inst_name);
+    parse_head_info(resps.at(2),caps.head_type,caps.head_sn,caps.head_name,caps.head_word);
+
+    std::string path;
+    if (cache_dir.size())
+    {
+      path = cache_dir + "/ophir_" + file_key(caps.inst_sn) + "_" + file_key(caps.head_sn) + ".cap";
+      if (read_capabilities(path,caps))
+      {
+#ifdef DEBUG
+        std::cout << "PowerMeter::load_capabilities : using [" << path << "]" << std::endl;
+#endif
+        m_ranges = caps.ranges;
+        m_pulse_lengths = caps.pulse_lengths;
+        m_ave_windows = caps.ave_windows;
+        m_threshold_ranges = caps.threshold_ranges;
+        m_caps = caps;
+        return true;
+      }
+    }
+
+    // ask for everything. PL and AQ only fill their maps if empty
+    m_pulse_lengths.clear();
+    m_ave_windows.clear();
+    int16_t range;
+    uint16_t u16, tmin, tmax;
+    get_all_ranges(range);
+    pulse_length(0,u16);
+    average_query(0,u16);
+    query_user_threshold(u16,tmin,tmax);
+    get_all_wavelengths(caps.wavelengths);
+    caps.wavelengths = util::trim(caps.wavelengths);
+    caps.ranges = m_ranges;
+    caps.pulse_lengths = m_pulse_lengths;
+    caps.ave_windows = m_ave_windows;
+    caps.threshold_ranges = m_threshold_ranges;
+    m_caps = caps;
+    if (path.size())
+    {
+      bool st = write_capabilities(path,caps);
+#ifdef DEBUG
+      std::cout << "PowerMeter::load_capabilities : " << (st ? "wrote [" : "failed to write [") << path << "]" << std::endl;
+#else
+      (void)st;
+#endif
+    }
+    return false;
+  }
+
   void PowerMeter::wavelength_index(const uint16_t index, bool &success)
   {
     std::ostringstream cmd;
@@ -1285,7 +1464,17 @@ namespace device {
 
   bool PowerMeter::send_cmd(const std::string cmd, std::string &resp, bool repeat)
   {
-    const std::lock_guard<std::mutex> lock(m_cmd_mutex);
+    if (off_worker())
+    {
+      return run_on_worker([&]() {return send_cmd(cmd,resp,repeat);});
+    }
+    IOLock io(*this);
+    // no need to bother the port if the answer is known. Looked up here, in
+    // turn with the commands queued before, which may have made it stale
+    if (m_query_cache.lookup(cmd,resp))
+    {
+      return true;
+    }
 #ifdef DEBUG
     std::cout << "PowerMeter::send_cmd : Sending query [" << cmd << "]" << std::endl;
 #endif
@@ -1294,9 +1483,7 @@ namespace device {
     {
       if (repeat)
       {
-        std::this_thread::sleep_for(std::chrono::milliseconds(m_interval_between_cmds_ms));
         reset_connection();
-        std::this_thread::sleep_for(std::chrono::milliseconds(m_interval_between_cmds_ms));
         st = write_cmd(cmd);
         if (!st)
         {
@@ -1308,15 +1495,13 @@ namespace device {
         return false;
       }
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(m_interval_between_cmds_ms));
+    // the gap between commands is enforced by Device::write_cmd
     st = read_cmd(resp);
     if (!st )
     {
       if (repeat)
       {
-        std::this_thread::sleep_for(std::chrono::milliseconds(m_interval_between_cmds_ms));
         reset_connection();
-        std::this_thread::sleep_for(std::chrono::milliseconds(m_interval_between_cmds_ms));
         return read_cmd(resp);
       }
       else
@@ -1327,6 +1512,177 @@ namespace device {
 #ifdef DEBUG
     std::cout << "PowerMeter::send_cmd : got answer [" << util::escape(resp.c_str()) << "]" << std::endl;
 #endif
+    // still in the transaction: no command can make it stale before it is in
+    if (resp.size() && resp.at(0) == '*')
+    {
+      m_query_cache.store(cmd,resp);
+    }
+    return true;
+  }
+
+  bool PowerMeter::send_cmds(const std::vector<std::string> &cmds, std::vector<std::string> &resps, bool repeat)
+  {
+    if (off_worker())
+    {
+      return run_on_worker([&]() {return send_cmds(cmds,resps,repeat);});
+    }
+    IOLock io(*this);
+    resps.clear();
+    if (cmds.size() == 0)
+    {
+      return true;
+    }
+    bool st = write_batch(cmds) && read_lines(resps,cmds.size());
+    if (!st || (resps.size() != cmds.size()))
+    {
+      if (!repeat)
+      {
+        return false;
+      }
+      // start over with the whole batch
+      reset_connection();
+      resps.clear();
+      if (!write_batch(cmds) || !read_lines(resps,cmds.size()))
+      {
+        return false;
+      }
+      if (resps.size() != cmds.size())
+      {
+        return false;
+      }
+    }
+    for (std::string &r : resps)
+    {
+      if (r.size() >= m_read_sfx.size())
+      {
+        r.erase(r.size() - m_read_sfx.size());
+      }
+    }
+    return true;
+  }
+
+  // the cache file is plain text, one entry per line:
+  //   format 1
+  //   firmware VEGA V1.21
+  //   range -1 AUTO          (one line per entry, as are pulse and average)
+  //   threshold 1 99
+  //   wavelengths CONTINUOUS 190 3000 1 266 355 532 1064
+  bool PowerMeter::read_capabilities(const std::string &path, Capabilities &caps)
+  {
+    std::ifstream ifs(path);
+    if (!ifs.is_open())
+    {
+      return false;
+    }
+    Capabilities c;
+    bool format = false;
+    try
+    {
+      std::string line;
+      while (std::getline(ifs,line))
+      {
+        if (line.size() == 0 || line.at(0) == '#')
+        {
+          continue;
+        }
+        const size_t sp = line.find(' ');
+        const std::string key = line.substr(0,sp);
+        const std::string value = (sp == std::string::npos) ? "" : line.substr(sp + 1);
+        const size_t vsp = value.find(' ');
+        if (key == "format")
+        {
+          format = (value == "1");
+        }
+        else if (key == "firmware")
+        {
+          c.firmware = value;
+        }
+        else if (key == "range")
+        {
+          c.ranges.insert({static_cast<int16_t>(std::stol(value)),value.substr(vsp + 1)});
+        }
+        else if (key == "pulse")
+        {
+          c.pulse_lengths.insert({static_cast<uint16_t>(std::stoul(value)),value.substr(vsp + 1)});
+        }
+        else if (key == "average")
+        {
+          c.ave_windows.insert({static_cast<uint16_t>(std::stoul(value)),value.substr(vsp + 1)});
+        }
+        else if (key == "threshold")
+        {
+          c.threshold_ranges.first = std::stoul(value) & 0xFFFF;
+          c.threshold_ranges.second = std::stoul(value.substr(vsp + 1)) & 0xFFFF;
+        }
+        else if (key == "wavelengths")
+        {
+          c.wavelengths = value;
+        }
+      }
+    }
+    catch(std::exception &e)
+    {
+#ifdef DEBUG
+      std::cout << "PowerMeter::read_capabilities : bad entry in [" << path << "] : " << e.what() << std::endl;
+#endif
+      return false;
+    }
+    if (!format || c.firmware != caps.firmware || c.ranges.size() == 0)
+    {
+#ifdef DEBUG
+      std::cout << "PowerMeter::read_capabilities : [" << path << "] is for firmware [" << c.firmware
+          << "], the instrument has [" << caps.firmware << "]" << std::endl;
+#endif
+      return false;
+    }
+    caps.ranges = c.ranges;
+    caps.pulse_lengths = c.pulse_lengths;
+    caps.ave_windows = c.ave_windows;
+    caps.threshold_ranges = c.threshold_ranges;
+    caps.wavelengths = c.wavelengths;
+    return true;
+  }
+
+  bool PowerMeter::write_capabilities(const std::string &path, const Capabilities &caps)
+  {
+    // the directory and whatever is missing above it
+    for (size_t slash = path.find('/',1); slash != std::string::npos; slash = path.find('/',slash + 1))
+    {
+      if (mkdir(path.substr(0,slash).c_str(),0755) == -1 && errno != EEXIST)
+      {
+        return false;
+      }
+    }
+    // written aside and renamed, so that a reader never sees half a file
+    const std::string tmp = path + ".tmp";
+    std::ofstream ofs(tmp,std::ios::trunc);
+    if (!ofs.is_open())
+    {
+      return false;
+    }
+    ofs << "# " << caps.inst_name << " " << caps.inst_sn << ", head " << caps.head_name << " " << caps.head_sn << "\n";
+    ofs << "format 1\n";
+    ofs << "firmware " << caps.firmware << "\n";
+    for (auto &r : caps.ranges)
+    {
+      ofs << "range " << r.first << " " << r.second << "\n";
+    }
+    for (auto &p : caps.pulse_lengths)
+    {
+      ofs << "pulse " << p.first << " " << p.second << "\n";
+    }
+    for (auto &a : caps.ave_windows)
+    {
+      ofs << "average " << a.first << " " << a.second << "\n";
+    }
+    ofs << "threshold " << caps.threshold_ranges.first << " " << caps.threshold_ranges.second << "\n";
+    ofs << "wavelengths " << caps.wavelengths << "\n";
+    ofs.close();
+    if (!ofs || std::rename(tmp.c_str(),path.c_str()) != 0)
+    {
+      std::remove(tmp.c_str());
+      return false;
+    }
     return true;
   }
 
@@ -0,0 +1,341 @@
+/*
+ * QuantileSketch.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <QuantileSketch.hh>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace device
+{
+
+  // shrink factor of the capacities from one level to the one below
+  static const double level_shrink = 2.0/3.0;
+  // smallest capacity of any level
+  static const uint32_t min_capacity = 8;
+  // serialization tag
+  static const uint32_t sketch_magic = 0x4B4C4C31; // "KLL1"
+
+  QuantileSketch::QuantileSketch (const uint32_t k)
+    : m_k(std::max(k,min_capacity)),
+      m_rng(0x9E3779B97F4A7C15ULL)
+  {
+    reset();
+  }
+
+  void QuantileSketch::reset()
+  {
+    m_n = 0;
+    m_size = 0;
+    m_min = std::numeric_limits<double>::quiet_NaN();
+    m_max = std::numeric_limits<double>::quiet_NaN();
+    m_levels.clear();
+    m_levels.resize(1);
+    m_levels[0].reserve(m_k);
+    update_capacities();
+  }
+
+  void QuantileSketch::add(const double x)
+  {
+    if (std::isnan(x))
+    {
+      return;
+    }
+    if (m_n == 0)
+    {
+      m_min = x;
+      m_max = x;
+    }
+    else
+    {
+      m_min = std::min(m_min,x);
+      m_max = std::max(m_max,x);
+    }
+    m_n++;
+    m_levels[0].push_back(x);
+    m_size++;
+    if (m_levels[0].size() >= capacity(0))
+    {
+      compress();
+    }
+  }
+
+  void QuantileSketch::merge(const QuantileSketch &other)
+  {
+    if (other.m_n == 0)
+    {
+      return;
+    }
+    if (m_n == 0)
+    {
+      m_min = other.m_min;
+      m_max = other.m_max;
+    }
+    else
+    {
+      m_min = std::min(m_min,other.m_min);
+      m_max = std::max(m_max,other.m_max);
+    }
+    if (other.m_levels.size() > m_levels.size())
+    {
+      m_levels.resize(other.m_levels.size());
+      update_capacities();
+    }
+    for (size_t h = 0; h < other.m_levels.size(); h++)
+    {
+      m_levels[h].insert(m_levels[h].end(),other.m_levels[h].begin(),other.m_levels[h].end());
+      m_size += other.m_levels[h].size();
+    }
+    m_n += other.m_n;
+    compress();
+  }
+
+  void QuantileSketch::update_capacities()
+  {
+    // the top level gets k, each one below 2/3 of the one above
+    m_capacities.resize(m_levels.size());
+    for (size_t h = 0; h < m_levels.size(); h++)
+    {
+      const size_t depth = m_levels.size() - h - 1;
+      const double c = std::ceil(m_k * std::pow(level_shrink,static_cast<double>(depth)));
+      m_capacities[h] = std::max(min_capacity,static_cast<uint32_t>(c));
+    }
+  }
+
+  void QuantileSketch::compress()
+  {
+    // compact the lowest full levels until everything fits
+    bool done = false;
+    while (!done)
+    {
+      done = true;
+      for (size_t h = 0; h < m_levels.size(); h++)
+      {
+        if (m_levels[h].size() >= capacity(h))
+        {
+          compact(h);
+          done = false;
+          break;
+        }
+      }
+    }
+  }
+
+  void QuantileSketch::compact(const size_t level)
+  {
+    if (level + 1 == m_levels.size())
+    {
+      m_levels.resize(m_levels.size() + 1);
+      update_capacities();
+    }
+    std::vector<double> &items = m_levels[level];
+    std::sort(items.begin(),items.end());
+    // an odd item out stays behind
+    double leftover = 0.0;
+    const bool odd = (items.size() % 2) != 0;
+    if (odd)
+    {
+      leftover = items.back();
+      items.pop_back();
+    }
+    std::vector<double> &up = m_levels[level + 1];
+    const size_t offset = coin() ? 1 : 0;
+    for (size_t i = offset; i < items.size(); i += 2)
+    {
+      up.push_back(items[i]);
+    }
+    m_size -= items.size() / 2;
+    items.clear();
+    if (odd)
+    {
+      items.push_back(leftover);
+    }
+  }
+
+  bool QuantileSketch::coin()
+  {
+    // xorshift64
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 7;
+    m_rng ^= m_rng << 17;
+    return (m_rng & 1ULL) != 0;
+  }
+
+  size_t QuantileSketch::retained() const
+  {
+    return m_size;
+  }
+
+  std::vector<double> QuantileSketch::quantiles(const std::vector<double> &qs) const
+  {
+    std::vector<double> res(qs.size(),std::numeric_limits<double>::quiet_NaN());
+    if (m_n == 0)
+    {
+      return res;
+    }
+    // weighted, sorted view of the retained items
+    std::vector<std::pair<double,uint64_t> > items;
+    items.reserve(m_size);
+    for (size_t h = 0; h < m_levels.size(); h++)
+    {
+      const uint64_t w = 1ULL << h;
+      for (double x : m_levels[h])
+      {
+        items.push_back(std::make_pair(x,w));
+      }
+    }
+    std::sort(items.begin(),items.end());
+    uint64_t total = 0;
+    for (auto &it : items)
+    {
+      total += it.second;
+    }
+    for (size_t i = 0; i < qs.size(); i++)
+    {
+      const double q = qs[i];
+      if (q <= 0.0)
+      {
+        res[i] = m_min;
+        continue;
+      }
+      if (q >= 1.0)
+      {
+        res[i] = m_max;
+        continue;
+      }
+      const double target = q * static_cast<double>(total);
+      uint64_t cum = 0;
+      res[i] = m_max;
+      for (auto &it : items)
+      {
+        cum += it.second;
+        if (static_cast<double>(cum) >= target)
+        {
+          res[i] = it.first;
+          break;
+        }
+      }
+    }
+    return res;
+  }
+
+  double QuantileSketch::quantile(const double q) const
+  {
+    return quantiles(std::vector<double>(1,q)).at(0);
+  }
+
+  double QuantileSketch::rank(const double x) const
+  {
+    if (m_n == 0)
+    {
+      return 0.0;
+    }
+    uint64_t below = 0;
+    uint64_t total = 0;
+    for (size_t h = 0; h < m_levels.size(); h++)
+    {
+      const uint64_t w = 1ULL << h;
+      for (double v : m_levels[h])
+      {
+        total += w;
+        if (v <= x)
+        {
+          below += w;
+        }
+      }
+    }
+    return static_cast<double>(below) / static_cast<double>(total);
+  }
+
+  ///
+  /// serialization : magic, k, n, min, max, number of levels, then per level
+  /// the number of items and the items
+  ///
+
+  template <typename T>
+  static void put(std::string &out, const T &v)
+  {
+    out.append(reinterpret_cast<const char*>(&v),sizeof(T));
+  }
+
+  template <typename T>
+  static void get(const std::string &in, size_t &pos, T &v)
+  {
+    if (pos + sizeof(T) > in.size())
+    {
+      throw std::runtime_error("QuantileSketch::deserialize : truncated data");
+    }
+    std::memcpy(&v,in.data() + pos,sizeof(T));
+    pos += sizeof(T);
+  }
+
+  void QuantileSketch::serialize(std::string &out) const
+  {
+    out.clear();
+    put(out,sketch_magic);
+    put(out,m_k);
+    put(out,m_n);
+    put(out,m_min);
+    put(out,m_max);
+    put(out,static_cast<uint32_t>(m_levels.size()));
+    for (const std::vector<double> &l : m_levels)
+    {
+      put(out,static_cast<uint32_t>(l.size()));
+      out.append(reinterpret_cast<const char*>(l.data()),l.size()*sizeof(double));
+    }
+  }
+
+  void QuantileSketch::deserialize(const std::string &in)
+  {
+    size_t pos = 0;
+    uint32_t magic;
+    get(in,pos,magic);
+    if (magic != sketch_magic)
+    {
+      throw std::runtime_error("QuantileSketch::deserialize : not a sketch");
+    }
+    uint32_t k;
+    uint64_t n;
+    double mn, mx;
+    uint32_t nlevels;
+    get(in,pos,k);
+    get(in,pos,n);
+    get(in,pos,mn);
+    get(in,pos,mx);
+    get(in,pos,nlevels);
+    if (nlevels == 0 || nlevels > 64)
+    {
+      throw std::runtime_error("QuantileSketch::deserialize : bad number of levels");
+    }
+    std::vector<std::vector<double> > levels(nlevels);
+    size_t size = 0;
+    for (uint32_t h = 0; h < nlevels; h++)
+    {
+      uint32_t count;
+      get(in,pos,count);
+      if (pos + count*sizeof(double) > in.size())
+      {
+        throw std::runtime_error("QuantileSketch::deserialize : truncated data");
+      }
+      levels[h].resize(count);
+      std::memcpy(levels[h].data(),in.data() + pos,count*sizeof(double));
+      pos += count*sizeof(double);
+      size += count;
+    }
+    m_k = std::max(k,min_capacity);
+    m_n = n;
+    m_min = mn;
+    m_max = mx;
+    m_levels.swap(levels);
+    m_size = size;
+    update_capacities();
+  }
+
+} /* namespace device */
@@ -0,0 +1,174 @@
+/*
+ * QueryCache.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <QueryCache.hh>
+#include <chrono>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  const uint32_t QueryCache::forever;
+
+  static int64_t now_ns()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  QueryCache::QueryCache ()
+    : m_enabled(true),
+      m_hits(0)
+  {
+  }
+
+  void QueryCache::cache(const std::string &query, const uint32_t ttl_ms)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry &e = m_entries[query];
+    e.ttl_ms = ttl_ms;
+    e.valid = false;
+  }
+
+  void QueryCache::invalidate_on(const std::string &cmd, const std::vector<std::string> &queries)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> &v = m_invalidates[mnemonic(cmd)];
+    v.insert(v.end(),queries.begin(),queries.end());
+  }
+
+  void QueryCache::clear_on(const std::string &cmd)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_clears.insert(mnemonic(cmd));
+  }
+
+  bool QueryCache::lookup(const std::string &query, std::string &answer)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled)
+    {
+      return false;
+    }
+    std::unordered_map<std::string,Entry>::iterator it = m_entries.find(query);
+    if (it == m_entries.end())
+    {
+      return false;
+    }
+    Entry &e = it->second;
+    if (e.valid && (e.ttl_ms == forever || now_ns() < e.expires_ns))
+    {
+      answer = e.answer;
+      m_hits++;
+      return true;
+    }
+    e.valid = false;
+    return false;
+  }
+
+  void QueryCache::store(const std::string &query, const std::string &answer)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled)
+    {
+      return;
+    }
+    std::unordered_map<std::string,Entry>::iterator it = m_entries.find(query);
+    if (it == m_entries.end() || it->second.ttl_ms == 0)
+    {
+      return;
+    }
+    Entry &e = it->second;
+    e.answer = answer;
+    e.valid = true;
+    if (e.ttl_ms != forever)
+    {
+      e.expires_ns = now_ns() + static_cast<int64_t>(e.ttl_ms) * 1000000;
+    }
+  }
+
+  void QueryCache::sent(const std::string &cmd)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_invalidates.empty() && m_clears.empty())
+    {
+      return;
+    }
+    const std::string m = mnemonic(cmd);
+    if (m_clears.count(m))
+    {
+#ifdef DEBUG
+      std::cout << "QueryCache::sent : [" << cmd << "] clears the cache" << std::endl;
+#endif
+      for (auto &e : m_entries)
+      {
+        e.second.valid = false;
+      }
+      return;
+    }
+    std::unordered_map<std::string,std::vector<std::string> >::const_iterator it = m_invalidates.find(m);
+    if (it == m_invalidates.end())
+    {
+      return;
+    }
+    for (const std::string &q : it->second)
+    {
+      std::unordered_map<std::string,Entry>::iterator e = m_entries.find(q);
+      if (e != m_entries.end())
+      {
+#ifdef DEBUG
+        std::cout << "QueryCache::sent : [" << cmd << "] invalidates [" << q << "]" << std::endl;
+#endif
+        e->second.valid = false;
+      }
+    }
+  }
+
+  void QueryCache::clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &e : m_entries)
+    {
+      e.second.valid = false;
+    }
+  }
+
+  void QueryCache::set_enabled(const bool e)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = e;
+    if (!m_enabled)
+    {
+      for (auto &entry : m_entries)
+      {
+        entry.second.valid = false;
+      }
+    }
+  }
+
+  bool QueryCache::get_enabled() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_enabled;
+  }
+
+  uint64_t QueryCache::hits() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+  }
+
+  std::string QueryCache::mnemonic(const std::string &cmd)
+  {
+    return cmd.substr(0,cmd.find(' '));
+  }
+
+} /* namespace device */
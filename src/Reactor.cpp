@@ -0,0 +1,549 @@
+/*
+ * Reactor.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <Reactor.hh>
+#include <utilities.hh>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+#include <cerrno>
+#include <algorithm>
+#include <future>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+  // epoll tag of the wake-up descriptor. Port ids are always >= 0
+  static const uint64_t wake_tag = 0xFFFFFFFFFFFFFFFFULL;
+
+  Reactor::Reactor ()
+    : m_epoll_fd(-1),
+      m_wake_fd(-1),
+      m_running(false),
+      m_stop(false),
+      m_next_id(0),
+      m_loop_thread(std::thread::id())
+  {
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1)
+    {
+      throw serial::IOException(__FILE__,__LINE__,errno);
+    }
+    m_wake_fd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wake_fd == -1)
+    {
+      int err = errno;
+      ::close(m_epoll_fd);
+      throw serial::IOException(__FILE__,__LINE__,err);
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = wake_tag;
+    if (epoll_ctl(m_epoll_fd,EPOLL_CTL_ADD,m_wake_fd,&ev) == -1)
+    {
+      int err = errno;
+      ::close(m_wake_fd);
+      ::close(m_epoll_fd);
+      throw serial::IOException(__FILE__,__LINE__,err);
+    }
+  }
+
+  Reactor::~Reactor ()
+  {
+    stop();
+    // fail whatever is still pending, so that no caller waits forever
+    run_posted();
+    std::vector<int> ids;
+    for (auto &entry : m_ports)
+    {
+      ids.push_back(entry.first);
+    }
+    for (int id : ids)
+    {
+      remove_port(id);
+    }
+    run_posted();
+    ::close(m_wake_fd);
+    ::close(m_epoll_fd);
+  }
+
+  int Reactor::add_port(serial::Serial &port, const uint32_t min_interval_ms)
+  {
+    if (!port.isOpen())
+    {
+      throw serial::PortNotOpenedException("Reactor::add_port");
+    }
+    // drop anything stale (including what may sit in the line buffer)
+    port.flushInput();
+    int id = m_next_id++;
+    serial::Serial *sp = &port;
+    const int fd = sp->getFd();
+    // here, so that the caller gets the error. epoll is thread safe, and the
+    // loop ignores the events of a port it does not know yet (level triggered:
+    // they come again once it is in)
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = static_cast<uint64_t>(id);
+    if (epoll_ctl(m_epoll_fd,EPOLL_CTL_ADD,fd,&ev) == -1)
+    {
+      throw serial::IOException(__FILE__,__LINE__,errno);
+    }
+    post([this,id,sp,fd,min_interval_ms]()
+    {
+      Port p;
+      p.id = id;
+      p.serial = sp;
+      p.fd = fd;
+      p.min_interval = std::chrono::milliseconds(min_interval_ms);
+      p.next_write = clock::now();
+      p.busy = false;
+      p.tx_offset = 0;
+      p.want_write = false;
+      p.closed = false;
+      m_ports.insert({id,p});
+    });
+    return id;
+  }
+
+  void Reactor::remove_port(const int id)
+  {
+    if (std::this_thread::get_id() == m_loop_thread.load())
+    {
+      // from a callback: the loop may be holding the port, erase it afterwards
+      auto it = m_ports.find(id);
+      if (it != m_ports.end())
+      {
+        unregister(it->second);
+        post([this,id]() {m_ports.erase(id);});
+      }
+      return;
+    }
+    std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+    std::future<void> f = done->get_future();
+    post([this,id,done]()
+    {
+      auto it = m_ports.find(id);
+      if (it != m_ports.end())
+      {
+        unregister(it->second);
+        m_ports.erase(it);
+      }
+      done->set_value();
+    });
+    while (f.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+    {
+      // nobody is running the loop: do it here
+      std::unique_lock<std::mutex> lock(m_loop_mutex,std::try_to_lock);
+      if (lock.owns_lock())
+      {
+        m_loop_thread.store(std::this_thread::get_id());
+        run_posted();
+        m_loop_thread.store(std::thread::id());
+      }
+    }
+  }
+
+  void Reactor::submit(const int id, const Command &cmd)
+  {
+    post([this,id,cmd]()
+    {
+      auto it = m_ports.find(id);
+      if (it == m_ports.end())
+      {
+        std::vector<std::string> none;
+        if (cmd.done)
+        {
+          cmd.done(false,none);
+        }
+        return;
+      }
+      it->second.queue.push_back(cmd);
+      if (!it->second.busy)
+      {
+        start_next(it->second);
+      }
+    });
+  }
+
+  void Reactor::run()
+  {
+    while (run_once(-1))
+    {
+    }
+  }
+
+  bool Reactor::run_once(const int timeout_ms)
+  {
+    if (m_stop.load())
+    {
+      m_stop = false;
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(m_loop_mutex);
+    m_loop_thread.store(std::this_thread::get_id());
+    m_running = true;
+    run_posted();
+    check_timers();
+
+    const int max_events = 16;
+    struct epoll_event events[max_events];
+    int n = epoll_wait(m_epoll_fd,events,max_events,next_timeout_ms(timeout_ms));
+    if (n == -1 && errno != EINTR)
+    {
+      m_running = false;
+      m_loop_thread.store(std::thread::id());
+      throw serial::IOException(__FILE__,__LINE__,errno);
+    }
+    for (int i = 0; i < n; i++)
+    {
+      if (events[i].data.u64 == wake_tag)
+      {
+        uint64_t count;
+        while (::read(m_wake_fd,&count,sizeof(count)) > 0)
+        {
+        }
+        continue;
+      }
+      int id = static_cast<int>(events[i].data.u64);
+      auto it = m_ports.find(id);
+      if (it == m_ports.end())
+      {
+        continue;
+      }
+      Port &p = it->second;
+      if (p.closed)
+      {
+        continue;
+      }
+      if (events[i].events & (EPOLLERR | EPOLLHUP))
+      {
+#ifdef DEBUG
+        std::cout << "Reactor::run_once : port [" << p.serial->getPort() << "] reported an error. Dropping it." << std::endl;
+#endif
+        remove_port(id);
+        continue;
+      }
+      if (events[i].events & EPOLLOUT)
+      {
+        handle_write(p);
+      }
+      if (events[i].events & EPOLLIN)
+      {
+        handle_read(p);
+      }
+    }
+    run_posted();
+    check_timers();
+    m_running = false;
+    m_loop_thread.store(std::thread::id());
+    return true;
+  }
+
+  void Reactor::stop()
+  {
+    m_stop = true;
+    wake();
+  }
+
+  ///
+  /// private methods
+  ///
+
+  void Reactor::post(std::function<void()> op)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_post_mutex);
+      m_posted.push_back(op);
+    }
+    wake();
+  }
+
+  void Reactor::run_posted()
+  {
+    std::vector<std::function<void()> > ops;
+    {
+      std::lock_guard<std::mutex> lock(m_post_mutex);
+      ops.swap(m_posted);
+    }
+    for (auto &op : ops)
+    {
+      op();
+    }
+  }
+
+  void Reactor::wake()
+  {
+    uint64_t one = 1;
+    ssize_t r = ::write(m_wake_fd,&one,sizeof(one));
+    (void)r;
+  }
+
+  void Reactor::unregister(Port &p)
+  {
+    if (p.closed)
+    {
+      return;
+    }
+    epoll_ctl(m_epoll_fd,EPOLL_CTL_DEL,p.fd,nullptr);
+    p.closed = true;
+    std::deque<Command> pending;
+    pending.swap(p.queue);
+    if (p.busy)
+    {
+      complete(p,false);
+    }
+    for (Command &cmd : pending)
+    {
+      std::vector<std::string> none;
+      if (cmd.done)
+      {
+        cmd.done(false,none);
+      }
+    }
+  }
+
+  void Reactor::start_next(Port &p)
+  {
+    if (p.closed || p.busy || p.queue.empty())
+    {
+      return;
+    }
+    // respect the interval mandated by the device. The timer check retries later
+    if (clock::now() < p.next_write)
+    {
+      return;
+    }
+    p.current = p.queue.front();
+    p.queue.pop_front();
+    p.busy = true;
+    p.tx_offset = 0;
+    p.rx.clear();
+    p.lines.clear();
+    // same as Device::write_cmd : drop any input that may be pending
+    tcflush(p.fd,TCIFLUSH);
+    p.next_write = clock::now() + p.min_interval;
+    p.deadline = clock::now() + std::chrono::milliseconds(p.current.timeout_ms);
+#ifdef DEBUG
+    std::cout << "Reactor::start_next : [" << p.serial->getPort() << "] sending [" << util::escape(p.current.data) << "]" << std::endl;
+#endif
+    handle_write(p);
+  }
+
+  void Reactor::handle_write(Port &p)
+  {
+    if (p.closed)
+    {
+      return;
+    }
+    if (!p.busy)
+    {
+      update_events(p,false);
+      return;
+    }
+    const std::string &data = p.current.data;
+    while (p.tx_offset < data.size())
+    {
+      ssize_t n = ::write(p.fd,data.data() + p.tx_offset,data.size() - p.tx_offset);
+      if (n > 0)
+      {
+        std::shared_ptr<serial::Tap> tap = p.serial->getTap();
+        if (tap != nullptr)
+        {
+          tap->onWrite(reinterpret_cast<const uint8_t*>(data.data() + p.tx_offset),static_cast<size_t>(n));
+        }
+        p.tx_offset += static_cast<size_t>(n);
+        continue;
+      }
+      if (n == -1 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      {
+        // wait for the port to drain
+        update_events(p,true);
+        return;
+      }
+      // write failure (device disconnected?)
+      update_events(p,false);
+      complete(p,false);
+      return;
+    }
+    update_events(p,false);
+    p.deadline = clock::now() + std::chrono::milliseconds(p.current.timeout_ms);
+    if (p.current.lines == 0)
+    {
+      complete(p,true);
+    }
+  }
+
+  void Reactor::handle_read(Port &p)
+  {
+    if (p.closed)
+    {
+      return;
+    }
+    char buffer[1024];
+    while (true)
+    {
+      ssize_t n = ::read(p.fd,buffer,sizeof(buffer));
+      if (n > 0)
+      {
+        std::shared_ptr<serial::Tap> tap = p.serial->getTap();
+        if (tap != nullptr)
+        {
+          tap->onRead(reinterpret_cast<const uint8_t*>(buffer),static_cast<size_t>(n));
+        }
+        // bytes arriving while idle (or before the write is done) are stale
+        if (p.busy && p.tx_offset == p.current.data.size())
+        {
+          p.rx.append(buffer,static_cast<size_t>(n));
+        }
+        continue;
+      }
+      if (n == -1 && errno == EINTR)
+      {
+        continue;
+      }
+      break;
+    }
+    if (p.busy)
+    {
+      frame_lines(p);
+    }
+  }
+
+  void Reactor::frame_lines(Port &p)
+  {
+    const std::string &eol = p.current.eol;
+    if (eol.empty())
+    {
+      // no terminator to frame on: every chunk counts as a line
+      if (p.rx.size() > 0)
+      {
+        p.lines.push_back(p.rx);
+        p.rx.clear();
+      }
+    }
+    size_t pos;
+    while (!eol.empty() && p.lines.size() < p.current.lines &&
+        (pos = p.rx.find(eol)) != std::string::npos)
+    {
+      p.lines.push_back(p.rx.substr(0,pos + eol.size()));
+      p.rx.erase(0,pos + eol.size());
+    }
+    if (p.lines.size() >= p.current.lines)
+    {
+      complete(p,true);
+    }
+  }
+
+  void Reactor::complete(Port &p, bool success)
+  {
+    Command cmd = p.current;
+    std::vector<std::string> lines;
+    lines.swap(p.lines);
+    if (!success && p.rx.size() > 0)
+    {
+      // hand back the partial line, as Serial::readlines does on timeout
+      lines.push_back(p.rx);
+    }
+    p.rx.clear();
+    p.busy = false;
+    p.current = Command();
+    if (cmd.done)
+    {
+      cmd.done(success,lines);
+    }
+    start_next(p);
+  }
+
+  void Reactor::update_events(Port &p, bool want_write)
+  {
+    if (p.want_write == want_write)
+    {
+      return;
+    }
+    struct epoll_event ev;
+    ev.events = static_cast<uint32_t>(EPOLLIN) | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    ev.data.u64 = static_cast<uint64_t>(p.id);
+    epoll_ctl(m_epoll_fd,EPOLL_CTL_MOD,p.fd,&ev);
+    p.want_write = want_write;
+  }
+
+  int Reactor::next_timeout_ms(const int limit_ms)
+  {
+    clock::time_point now = clock::now();
+    bool have_timer = false;
+    clock::time_point next = now;
+    for (auto &entry : m_ports)
+    {
+      Port &p = entry.second;
+      clock::time_point t;
+      if (p.busy)
+      {
+        t = p.deadline;
+      }
+      else if (!p.busy && !p.queue.empty())
+      {
+        t = p.next_write;
+      }
+      else
+      {
+        continue;
+      }
+      if (!have_timer || t < next)
+      {
+        next = t;
+        have_timer = true;
+      }
+    }
+    if (!have_timer)
+    {
+      return limit_ms;
+    }
+    // round up, so that the timer has expired by the time we wake up
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - now) + std::chrono::milliseconds(1);
+    int wait_ms = (next <= now) ? 0 : static_cast<int>(wait.count());
+    if (limit_ms >= 0 && limit_ms < wait_ms)
+    {
+      return limit_ms;
+    }
+    return wait_ms;
+  }
+
+  void Reactor::check_timers()
+  {
+    clock::time_point now = clock::now();
+    for (auto &entry : m_ports)
+    {
+      Port &p = entry.second;
+      if (p.closed)
+      {
+        continue;
+      }
+      if (p.busy && now >= p.deadline)
+      {
+#ifdef DEBUG
+        std::cout << "Reactor::check_timers : [" << p.serial->getPort() << "] timed out waiting for answer" << std::endl;
+#endif
+        complete(p,false);
+      }
+      else if (!p.busy)
+      {
+        start_next(p);
+      }
+    }
+  }
+
+} /* namespace device */
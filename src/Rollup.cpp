@@ -0,0 +1,471 @@
+/*
+ * Rollup.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <Rollup.hh>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <ctime>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  struct RollupHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t width_ns;
+  };
+
+  static_assert(sizeof(RollupHeader) == 16, "unexpected rollup header size");
+  static_assert(sizeof(RollupBucket) == 56, "unexpected rollup bucket size");
+
+  static const uint32_t rollup_magic = 0x314C4F52; // "ROL1"
+  static const uint32_t rollup_version = 2;   // 2: wall clock timestamps
+  // closed buckets queued before they are written without a flush()
+  static const size_t max_closed = 1024;
+  // buckets read from the file at once by the queries
+  static const size_t read_chunk = 256;
+
+  const uint32_t Rollups::any_series;
+  const uint64_t Rollups::second_ns;
+
+  static RollupBucket new_bucket(const uint64_t start_ns, const uint32_t series)
+  {
+    RollupBucket b;
+    b.start_ns = start_ns;
+    b.series = series;
+    b.reserved = 0;
+    b.count = 0;
+    b.min = std::numeric_limits<double>::infinity();
+    b.max = -std::numeric_limits<double>::infinity();
+    b.sum = 0.0;
+    b.sum2 = 0.0;
+    return b;
+  }
+
+  static int64_t clock_ns(const clockid_t id)
+  {
+    struct timespec ts;
+    clock_gettime(id,&ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+  }
+
+  static std::string io_error(const std::string &what, const std::string &path, const int err)
+  {
+    return "Rollups : " + what + " [" + path + "] : " + std::strerror(err);
+  }
+
+  ///
+  /// RollupBucket
+  ///
+
+  void RollupBucket::add(const double x)
+  {
+    count++;
+    min = std::min(min,x);
+    max = std::max(max,x);
+    sum += x;
+    sum2 += x * x;
+  }
+
+  void RollupBucket::merge(const RollupBucket &other)
+  {
+    count += other.count;
+    min = std::min(min,other.min);
+    max = std::max(max,other.max);
+    sum += other.sum;
+    sum2 += other.sum2;
+  }
+
+  double RollupBucket::variance() const
+  {
+    if (count < 2)
+    {
+      return 0.0;
+    }
+    const double n = static_cast<double>(count);
+    const double v = (sum2 - sum * sum / n) / (n - 1.0);
+    return (v > 0.0) ? v : 0.0;
+  }
+
+  ///
+  /// Rollups
+  ///
+
+  Rollups::Rollups (const std::string &dir, const std::vector<uint64_t> &widths_ns)
+    : m_dir(dir),
+      m_widths(widths_ns),
+      m_last_ts(0),
+      m_mono_to_real_ns(clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC))
+  {
+    if (mkdir(m_dir.c_str(),0755) == -1 && errno != EEXIST)
+    {
+      throw std::runtime_error(io_error("failed to create directory",m_dir,errno));
+    }
+    m_levels.resize(m_widths.size());
+    for (size_t i = 0; i < m_widths.size(); i++)
+    {
+      if (m_widths[i] == 0 || (m_widths[i] % second_ns) != 0)
+      {
+        throw std::runtime_error("Rollups : bucket widths must be whole seconds");
+      }
+      Level &l = m_levels[i];
+      l.width = m_widths[i];
+      l.fd = -1;
+      l.stored = 0;
+      l.open_start = 0;
+      open_level(l);
+    }
+  }
+
+  Rollups::~Rollups ()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Level &l : m_levels)
+    {
+      // the open buckets are partial, but they are all there is
+      close_buckets(l);
+      try
+      {
+        write_closed(l);
+      }
+      catch(std::exception &e)
+      {
+#ifdef DEBUG
+        std::cout << "Rollups::~Rollups : " << e.what() << std::endl;
+#endif
+      }
+      fdatasync(l.fd);
+      ::close(l.fd);
+    }
+  }
+
+  bool Rollups::add(const uint32_t series, const uint64_t timestamp_ns, const double x)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (timestamp_ns < m_last_ts)
+    {
+      return false;
+    }
+    m_last_ts = timestamp_ns;
+    for (Level &l : m_levels)
+    {
+      const uint64_t start = timestamp_ns - (timestamp_ns % l.width);
+      if (start != l.open_start)
+      {
+        close_buckets(l);
+        l.open_start = start;
+        if (l.closed.size() >= max_closed)
+        {
+          write_closed(l);
+        }
+      }
+      auto it = l.open.find(series);
+      if (it == l.open.end())
+      {
+        it = l.open.insert(std::make_pair(series,new_bucket(start,series))).first;
+      }
+      it->second.add(x);
+    }
+    return true;
+  }
+
+  void Rollups::update(const uint32_t device, const EnergySample &s)
+  {
+    if (s.pulses == 0)
+    {
+      return;
+    }
+    const uint64_t ts = static_cast<uint64_t>(static_cast<int64_t>(s.timestamp_ns) + m_mono_to_real_ns);
+    add(rollup_series(device,MetricEnergy),ts,s.energy / static_cast<double>(s.pulses));
+    auto it = m_last_sample.find(device);
+    if (it != m_last_sample.end())
+    {
+      if (s.timestamp_ns > it->second)
+      {
+        const double dt = static_cast<double>(s.timestamp_ns - it->second) / static_cast<double>(second_ns);
+        add(rollup_series(device,MetricFrequency),ts,static_cast<double>(s.pulses) / dt);
+      }
+      it->second = s.timestamp_ns;
+    }
+    else
+    {
+      m_last_sample[device] = s.timestamp_ns;
+    }
+  }
+
+  size_t Rollups::query(const uint64_t width_ns, const uint64_t t0, const uint64_t t1,
+                        std::vector<RollupBucket> &out, const uint32_t series) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const Level *lp = nullptr;
+    for (const Level &l : m_levels)
+    {
+      if (l.width == width_ns)
+      {
+        lp = &l;
+      }
+    }
+    if (lp == nullptr)
+    {
+      throw std::runtime_error("Rollups : no rollup of that width");
+    }
+    const Level &l = *lp;
+    if (t1 < t0)
+    {
+      return 0;
+    }
+    std::vector<RollupBucket> res;
+    auto take = [&](const RollupBucket &b) -> bool
+    {
+      if (b.start_ns > t1)
+      {
+        return false;
+      }
+      if (b.start_ns >= t0 && (series == any_series || b.series == series))
+      {
+        res.push_back(b);
+      }
+      return true;
+    };
+
+    // the file: first bucket that starts at or after t0, then read on
+    uint64_t lo = 0;
+    uint64_t hi = l.stored;
+    while (lo < hi)
+    {
+      const uint64_t mid = (lo + hi) / 2;
+      uint64_t start;
+      if (pread(l.fd,&start,sizeof(start),sizeof(RollupHeader) + mid * sizeof(RollupBucket)) != sizeof(start))
+      {
+        throw std::runtime_error(io_error("failed to read",l.path,errno));
+      }
+      if (start < t0)
+      {
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid;
+      }
+    }
+    RollupBucket buf[read_chunk];
+    bool more = true;
+    for (uint64_t i = lo; more && i < l.stored; i += read_chunk)
+    {
+      const size_t n = static_cast<size_t>(std::min<uint64_t>(read_chunk,l.stored - i));
+      const ssize_t len = static_cast<ssize_t>(n * sizeof(RollupBucket));
+      if (pread(l.fd,buf,len,sizeof(RollupHeader) + i * sizeof(RollupBucket)) != len)
+      {
+        throw std::runtime_error(io_error("failed to read",l.path,errno));
+      }
+      for (size_t j = 0; more && j < n; j++)
+      {
+        more = take(buf[j]);
+      }
+    }
+    // then what is still in memory
+    for (size_t j = 0; more && j < l.closed.size(); j++)
+    {
+      more = take(l.closed[j]);
+    }
+    if (more)
+    {
+      std::vector<RollupBucket> open;
+      for (auto &it : l.open)
+      {
+        open.push_back(it.second);
+      }
+      std::sort(open.begin(),open.end(),[](const RollupBucket &a, const RollupBucket &b) {return a.series < b.series;});
+      for (const RollupBucket &b : open)
+      {
+        take(b);
+      }
+    }
+    // a bucket a restart went through has a record from each run: merge them
+    size_t found = 0;
+    size_t i = 0;
+    while (i < res.size())
+    {
+      size_t j = i;
+      while (j < res.size() && res[j].start_ns == res[i].start_ns)
+      {
+        j++;
+      }
+      std::stable_sort(res.begin() + i,res.begin() + j,
+                       [](const RollupBucket &a, const RollupBucket &b) {return a.series < b.series;});
+      for (size_t k = i; k < j; k++)
+      {
+        if (k > i && res[k].series == out.back().series)
+        {
+          out.back().merge(res[k]);
+        }
+        else
+        {
+          out.push_back(res[k]);
+          found++;
+        }
+      }
+      i = j;
+    }
+    return found;
+  }
+
+  uint64_t Rollups::pick_width(const uint64_t t0, const uint64_t t1, const size_t min_buckets) const
+  {
+    if (m_widths.empty())
+    {
+      return 0;
+    }
+    const uint64_t span = (t1 > t0) ? (t1 - t0) : 0;
+    uint64_t best = *std::min_element(m_widths.begin(),m_widths.end());
+    for (const uint64_t w : m_widths)
+    {
+      if (w > best && (span / w + 1) >= min_buckets)
+      {
+        best = w;
+      }
+    }
+    return best;
+  }
+
+  void Rollups::flush()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (Level &l : m_levels)
+    {
+      write_closed(l);
+      fdatasync(l.fd);
+    }
+  }
+
+  ///
+  /// private methods
+  ///
+
+  void Rollups::open_level(Level &l)
+  {
+    char name[64];
+    std::snprintf(name,sizeof(name),"/rollup_%llus.dat",static_cast<unsigned long long>(l.width / second_ns));
+    l.path = m_dir + name;
+    l.fd = ::open(l.path.c_str(),O_RDWR | O_CREAT | O_CLOEXEC,0644);
+    if (l.fd == -1)
+    {
+      throw std::runtime_error(io_error("failed to open",l.path,errno));
+    }
+    struct stat st;
+    if (fstat(l.fd,&st) == -1)
+    {
+      const int err = errno;
+      ::close(l.fd);
+      throw std::runtime_error(io_error("failed to stat",l.path,err));
+    }
+    RollupHeader h;
+    if (st.st_size == 0)
+    {
+      h.magic = rollup_magic;
+      h.version = rollup_version;
+      h.width_ns = l.width;
+      if (pwrite(l.fd,&h,sizeof(h),0) != sizeof(h))
+      {
+        const int err = errno;
+        ::close(l.fd);
+        throw std::runtime_error(io_error("failed to write",l.path,err));
+      }
+      return;
+    }
+    if (pread(l.fd,&h,sizeof(h),0) != sizeof(h) || h.magic != rollup_magic ||
+        h.version != rollup_version || h.width_ns != l.width)
+    {
+      ::close(l.fd);
+      throw std::runtime_error("Rollups : invalid rollup file [" + l.path + "]");
+    }
+    l.stored = (static_cast<uint64_t>(st.st_size) - sizeof(h)) / sizeof(RollupBucket);
+    // a bucket cut short by a crash is dropped
+    const off_t end = static_cast<off_t>(sizeof(h) + l.stored * sizeof(RollupBucket));
+    if (end != st.st_size && ftruncate(l.fd,end) == -1)
+    {
+      const int err = errno;
+      ::close(l.fd);
+      throw std::runtime_error(io_error("failed to truncate",l.path,err));
+    }
+    if (l.stored > 0)
+    {
+      RollupBucket last;
+      if (pread(l.fd,&last,sizeof(last),end - static_cast<off_t>(sizeof(last))) == sizeof(last))
+      {
+        // samples resume after what is on disk. A restart within a bucket
+        // leaves two records for it, which query merges
+        m_last_ts = std::max(m_last_ts,last.start_ns);
+        l.open_start = last.start_ns;
+      }
+    }
+#ifdef DEBUG
+    std::cout << "Rollups::open_level : [" << l.path << "] has " << l.stored << " buckets" << std::endl;
+#endif
+  }
+
+  void Rollups::close_buckets(Level &l)
+  {
+    if (l.open.empty())
+    {
+      return;
+    }
+    const size_t first = l.closed.size();
+    for (auto &it : l.open)
+    {
+      l.closed.push_back(it.second);
+    }
+    // same start for all: order them by series, for stable files
+    std::sort(l.closed.begin() + first,l.closed.end(),
+              [](const RollupBucket &a, const RollupBucket &b) {return a.series < b.series;});
+    l.open.clear();
+  }
+
+  void Rollups::write_closed(Level &l)
+  {
+    if (l.closed.empty())
+    {
+      return;
+    }
+    const char *p = reinterpret_cast<const char*>(l.closed.data());
+    size_t left = l.closed.size() * sizeof(RollupBucket);
+    off_t off = static_cast<off_t>(sizeof(RollupHeader) + l.stored * sizeof(RollupBucket));
+    while (left > 0)
+    {
+      const ssize_t w = pwrite(l.fd,p,left,off);
+      if (w == -1)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        throw std::runtime_error(io_error("failed to write",l.path,errno));
+      }
+      p += w;
+      left -= static_cast<size_t>(w);
+      off += w;
+    }
+    l.stored += l.closed.size();
+    l.closed.clear();
+  }
+
+} /* namespace device */
@@ -0,0 +1,390 @@
+/*
+ * Statistics.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <Statistics.hh>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace device
+{
+
+  ///
+  /// RunningStats
+  ///
+
+  void RunningStats::reset()
+  {
+    m_n = 0;
+    m_mean = 0.0;
+    m_m2 = 0.0;
+    m_min = std::numeric_limits<double>::infinity();
+    m_max = -std::numeric_limits<double>::infinity();
+  }
+
+  void RunningStats::add(const double x)
+  {
+    m_n++;
+    const double delta = x - m_mean;
+    m_mean += delta / static_cast<double>(m_n);
+    m_m2 += delta * (x - m_mean);
+    m_min = std::min(m_min,x);
+    m_max = std::max(m_max,x);
+  }
+
+  void RunningStats::add(const double *values, const size_t n)
+  {
+    if (n == 0)
+    {
+      return;
+    }
+    // reduce the block on its own (two passes: sum, then squared deviations)
+    // and merge it in. Stable, and the passes vectorize
+    size_t i = 0;
+    double sum = 0.0;
+    double lo = values[0];
+    double hi = values[0];
+#if defined(__SSE2__)
+    __m128d vsum = _mm_setzero_pd();
+    __m128d vlo = _mm_set1_pd(values[0]);
+    __m128d vhi = vlo;
+    for (; i + 2 <= n; i += 2)
+    {
+      __m128d v = _mm_loadu_pd(values + i);
+      vsum = _mm_add_pd(vsum,v);
+      vlo = _mm_min_pd(vlo,v);
+      vhi = _mm_max_pd(vhi,v);
+    }
+    double tmp[2];
+    _mm_storeu_pd(tmp,vsum);
+    sum = tmp[0] + tmp[1];
+    _mm_storeu_pd(tmp,vlo);
+    lo = std::min(tmp[0],tmp[1]);
+    _mm_storeu_pd(tmp,vhi);
+    hi = std::max(tmp[0],tmp[1]);
+#endif
+    for (; i < n; i++)
+    {
+      sum += values[i];
+      lo = std::min(lo,values[i]);
+      hi = std::max(hi,values[i]);
+    }
+    const double mean = sum / static_cast<double>(n);
+
+    i = 0;
+    double m2 = 0.0;
+#if defined(__SSE2__)
+    __m128d vmean = _mm_set1_pd(mean);
+    __m128d vm2 = _mm_setzero_pd();
+    for (; i + 2 <= n; i += 2)
+    {
+      __m128d d = _mm_sub_pd(_mm_loadu_pd(values + i),vmean);
+      vm2 = _mm_add_pd(vm2,_mm_mul_pd(d,d));
+    }
+    _mm_storeu_pd(tmp,vm2);
+    m2 = tmp[0] + tmp[1];
+#endif
+    for (; i < n; i++)
+    {
+      const double d = values[i] - mean;
+      m2 += d * d;
+    }
+
+    RunningStats block;
+    block.m_n = n;
+    block.m_mean = mean;
+    block.m_m2 = m2;
+    block.m_min = lo;
+    block.m_max = hi;
+    merge(block);
+  }
+
+  void RunningStats::merge(const RunningStats &other)
+  {
+    if (other.m_n == 0)
+    {
+      return;
+    }
+    if (m_n == 0)
+    {
+      *this = other;
+      return;
+    }
+    const double na = static_cast<double>(m_n);
+    const double nb = static_cast<double>(other.m_n);
+    const double n = na + nb;
+    const double delta = other.m_mean - m_mean;
+    m_mean += delta * nb / n;
+    m_m2 += other.m_m2 + delta * delta * na * nb / n;
+    m_n += other.m_n;
+    m_min = std::min(m_min,other.m_min);
+    m_max = std::max(m_max,other.m_max);
+  }
+
+  double RunningStats::variance() const
+  {
+    return (m_n > 1) ? (m_m2 / static_cast<double>(m_n - 1)) : 0.0;
+  }
+
+  double RunningStats::stddev() const
+  {
+    return std::sqrt(variance());
+  }
+
+  double RunningStats::rms() const
+  {
+    if (m_n == 0)
+    {
+      return 0.0;
+    }
+    return std::sqrt(m_mean * m_mean + m_m2 / static_cast<double>(m_n));
+  }
+
+  ///
+  /// WindowStats
+  ///
+
+  // every this many updates the window sums are recomputed from scratch
+  static const uint64_t window_refresh = 4096;
+
+  WindowStats::WindowStats (const uint64_t window_ns, const size_t max_samples)
+    : m_window_ns(window_ns),
+      m_max_samples(max_samples),
+      m_mean(0.0),
+      m_m2(0.0),
+      m_updates(0)
+  {
+  }
+
+  void WindowStats::reset()
+  {
+    m_samples.clear();
+    m_min_q.clear();
+    m_max_q.clear();
+    m_mean = 0.0;
+    m_m2 = 0.0;
+    m_updates = 0;
+  }
+
+  void WindowStats::add(const uint64_t timestamp_ns, const double x)
+  {
+    expire(timestamp_ns);
+    if (m_max_samples > 0 && m_samples.size() >= m_max_samples)
+    {
+      remove_oldest();
+    }
+    Entry e;
+    e.t = timestamp_ns;
+    e.x = x;
+    e.seq = m_updates++;
+    m_samples.push_back(e);
+    const double n = static_cast<double>(m_samples.size());
+    const double delta = x - m_mean;
+    m_mean += delta / n;
+    m_m2 += delta * (x - m_mean);
+    while (!m_min_q.empty() && m_min_q.back().x >= x)
+    {
+      m_min_q.pop_back();
+    }
+    m_min_q.push_back(e);
+    while (!m_max_q.empty() && m_max_q.back().x <= x)
+    {
+      m_max_q.pop_back();
+    }
+    m_max_q.push_back(e);
+
+    if (m_updates % window_refresh == 0)
+    {
+      double mean = 0.0;
+      double m2 = 0.0;
+      uint64_t k = 0;
+      for (const Entry &s : m_samples)
+      {
+        k++;
+        const double d = s.x - mean;
+        mean += d / static_cast<double>(k);
+        m2 += d * (s.x - mean);
+      }
+      m_mean = mean;
+      m_m2 = m2;
+    }
+  }
+
+  void WindowStats::expire(const uint64_t now_ns)
+  {
+    if (m_window_ns == 0)
+    {
+      return;
+    }
+    while (!m_samples.empty() && (now_ns - m_samples.front().t) >= m_window_ns)
+    {
+      remove_oldest();
+    }
+  }
+
+  void WindowStats::remove_oldest()
+  {
+    const Entry e = m_samples.front();
+    m_samples.pop_front();
+    if (m_samples.empty())
+    {
+      m_mean = 0.0;
+      m_m2 = 0.0;
+    }
+    else
+    {
+      // Welford, backwards
+      const double n = static_cast<double>(m_samples.size());
+      const double delta = e.x - m_mean;
+      m_mean -= delta / n;
+      m_m2 -= delta * (e.x - m_mean);
+      if (m_m2 < 0.0)
+      {
+        m_m2 = 0.0;
+      }
+    }
+    // the queues hold a subsequence of the samples: the oldest can only be at the front
+    if (!m_min_q.empty() && m_min_q.front().seq == e.seq)
+    {
+      m_min_q.pop_front();
+    }
+    if (!m_max_q.empty() && m_max_q.front().seq == e.seq)
+    {
+      m_max_q.pop_front();
+    }
+  }
+
+  double WindowStats::variance() const
+  {
+    const size_t n = m_samples.size();
+    return (n > 1) ? (m_m2 / static_cast<double>(n - 1)) : 0.0;
+  }
+
+  double WindowStats::stddev() const
+  {
+    return std::sqrt(variance());
+  }
+
+  double WindowStats::rms() const
+  {
+    const size_t n = m_samples.size();
+    if (n == 0)
+    {
+      return 0.0;
+    }
+    return std::sqrt(m_mean * m_mean + m_m2 / static_cast<double>(n));
+  }
+
+  double WindowStats::min() const
+  {
+    return m_min_q.empty() ? std::numeric_limits<double>::quiet_NaN() : m_min_q.front().x;
+  }
+
+  double WindowStats::max() const
+  {
+    return m_max_q.empty() ? std::numeric_limits<double>::quiet_NaN() : m_max_q.front().x;
+  }
+
+  ///
+  /// EwmaStats
+  ///
+
+  EwmaStats::EwmaStats (const uint64_t tau_ns)
+    : m_tau_ns(tau_ns)
+  {
+    reset();
+  }
+
+  void EwmaStats::reset()
+  {
+    m_init = false;
+    m_last_t = 0;
+    m_mean = 0.0;
+    m_var = 0.0;
+  }
+
+  void EwmaStats::add(const uint64_t timestamp_ns, const double x)
+  {
+    if (!m_init)
+    {
+      m_init = true;
+      m_last_t = timestamp_ns;
+      m_mean = x;
+      m_var = 0.0;
+      return;
+    }
+    const double dt = static_cast<double>(timestamp_ns - m_last_t);
+    m_last_t = timestamp_ns;
+    const double alpha = (m_tau_ns == 0) ? 1.0 : (1.0 - std::exp(-dt / static_cast<double>(m_tau_ns)));
+    // West's incremental form
+    const double delta = x - m_mean;
+    const double incr = alpha * delta;
+    m_mean += incr;
+    m_var = (1.0 - alpha) * (m_var + delta * incr);
+  }
+
+  double EwmaStats::stddev() const
+  {
+    return std::sqrt(m_var);
+  }
+
+  ///
+  /// EnergyStats
+  ///
+
+  size_t EnergyStats::add_window(const uint64_t window_ns, const size_t max_samples)
+  {
+    m_windows.push_back(WindowStats(window_ns,max_samples));
+    return m_windows.size() - 1;
+  }
+
+  size_t EnergyStats::add_ewma(const uint64_t tau_ns)
+  {
+    m_ewma.push_back(EwmaStats(tau_ns));
+    return m_ewma.size() - 1;
+  }
+
+  void EnergyStats::update(const EnergySample &s)
+  {
+    if (s.pulses == 0)
+    {
+      return;
+    }
+    const double x = s.energy / static_cast<double>(s.pulses);
+    m_pulses += s.pulses;
+    m_total.add(x);
+    m_sketch.add(x);
+    for (WindowStats &w : m_windows)
+    {
+      w.add(s.timestamp_ns,x);
+    }
+    for (EwmaStats &e : m_ewma)
+    {
+      e.add(s.timestamp_ns,x);
+    }
+  }
+
+  void EnergyStats::reset()
+  {
+    m_total.reset();
+    m_sketch.reset();
+    for (WindowStats &w : m_windows)
+    {
+      w.reset();
+    }
+    for (EwmaStats &e : m_ewma)
+    {
+      e.reset();
+    }
+    m_pulses = 0;
+  }
+
+} /* namespace device */
@@ -0,0 +1,858 @@
+/*
+ * TimeSeriesArchive.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <TimeSeriesArchive.hh>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  // file layout: header, blocks, index (BlockInfo array), footer
+  struct ArchiveHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_records;
+    uint32_t reserved;
+  };
+
+  struct ArchiveFooter
+  {
+    uint64_t index_offset;
+    uint32_t blocks;
+    uint32_t magic;
+  };
+
+  static_assert(sizeof(ArchiveHeader) == 16, "unexpected archive header size");
+  static_assert(sizeof(ArchiveFooter) == 16, "unexpected archive footer size");
+  static_assert(sizeof(BlockInfo) == 32, "unexpected block info size");
+
+  static const uint32_t archive_magic = 0x31524147; // "GAR1"
+  static const uint32_t archive_version = 1;
+
+  ///
+  /// bit streams, most significant bit first
+  ///
+
+  class BitWriter
+  {
+  public:
+    explicit BitWriter (std::vector<uint8_t> &out) : m_out(out), m_acc(0), m_n(0) {}
+
+    void write(const uint64_t v, const unsigned n)
+    {
+      if (n > 32)
+      {
+        write(v >> 32,n - 32);
+        write(v & 0xFFFFFFFFULL,32);
+        return;
+      }
+      if (n == 0)
+      {
+        return;
+      }
+      m_acc = (m_acc << n) | (v & ((1ULL << n) - 1));
+      m_n += n;
+      while (m_n >= 8)
+      {
+        m_n -= 8;
+        m_out.push_back(static_cast<uint8_t>(m_acc >> m_n));
+      }
+    }
+
+    void bit(const bool b) {write(b ? 1 : 0,1);}
+
+    /// pad the last byte with zeros
+    void finish()
+    {
+      if (m_n > 0)
+      {
+        m_out.push_back(static_cast<uint8_t>(m_acc << (8 - m_n)));
+        m_n = 0;
+      }
+    }
+
+  private:
+    std::vector<uint8_t> &m_out;
+    uint64_t m_acc;
+    unsigned m_n;
+  };
+
+  class BitReader
+  {
+  public:
+    BitReader (const uint8_t *data, const size_t len) : m_p(data), m_end(data + len), m_buf(0), m_n(0) {}
+
+    uint64_t read(const unsigned n)
+    {
+      if (n > 32)
+      {
+        const uint64_t hi = read(n - 32);
+        return (hi << 32) | read(32);
+      }
+      if (n == 0)
+      {
+        return 0;
+      }
+      need(n);
+      const uint64_t v = m_buf >> (64 - n);
+      m_buf <<= n;
+      m_n -= n;
+      return v;
+    }
+
+    bool bit()
+    {
+      need(1);
+      const bool b = (m_buf >> 63) != 0;
+      m_buf <<= 1;
+      m_n--;
+      return b;
+    }
+
+    /// number of 1 bits before the next 0 (consumed), up to max
+    unsigned ones(const unsigned max)
+    {
+      if (m_n < max)
+      {
+        refill();
+      }
+      if (m_n < max)
+      {
+        // end of the block: one bit at a time
+        unsigned k = 0;
+        while (k < max && bit())
+        {
+          k++;
+        }
+        return k;
+      }
+      const unsigned lead = (~m_buf == 0) ? 64 : static_cast<unsigned>(__builtin_clzll(~m_buf));
+      const unsigned k = std::min(lead,max);
+      const unsigned used = (k < max) ? k + 1 : k;
+      m_buf <<= used;
+      m_n -= used;
+      return k;
+    }
+
+  private:
+    void need(const unsigned n)
+    {
+      if (m_n < n)
+      {
+        refill();
+        if (m_n < n)
+        {
+          throw std::runtime_error("BlockCodec::decode : truncated block");
+        }
+      }
+    }
+
+    void refill()
+    {
+      if (m_end - m_p >= 8)
+      {
+        // a whole word at once. The bits past the last full byte are the
+        // next bits of the stream, so loading them twice does no harm
+        uint64_t w;
+        std::memcpy(&w,m_p,sizeof(w));
+        w = __builtin_bswap64(w);
+        m_buf |= w >> m_n;
+        const unsigned bytes = (63 - m_n) >> 3;
+        m_p += bytes;
+        m_n += bytes * 8;
+        return;
+      }
+      while (m_n <= 56 && m_p < m_end)
+      {
+        m_buf |= static_cast<uint64_t>(*m_p++) << (56 - m_n);
+        m_n += 8;
+      }
+    }
+
+    const uint8_t *m_p;
+    const uint8_t *m_end;
+    uint64_t m_buf;
+    unsigned m_n;
+  };
+
+  // signed integers (timestamp delta of deltas, decimal deltas) are written in
+  // classes: control prefix '0', '10', '110', '1110', '1111' and the width of
+  // the value that follows
+  static const unsigned dod_bits[] = {0, 14, 24, 32, 64};
+  static const unsigned int_bits[] = {0, 8, 16, 32, 64};
+
+  // largest decimal exponent tried for the decimal value mode (10^e is exact up to 22)
+  static const unsigned max_decimal_exponent = 18;
+
+  static bool fits(const int64_t v, const unsigned bits)
+  {
+    if (bits == 64)
+    {
+      return true;
+    }
+    const int64_t lim = 1LL << (bits - 1);
+    return (v >= -lim) && (v < lim);
+  }
+
+  static int64_t sign_extend(const uint64_t v, const unsigned bits)
+  {
+    if (bits == 64)
+    {
+      return static_cast<int64_t>(v);
+    }
+    const unsigned s = 64 - bits;
+    return static_cast<int64_t>(v << s) >> s;
+  }
+
+  static void write_classed(BitWriter &w, const uint64_t v, const unsigned *widths)
+  {
+    if (v == 0)
+    {
+      w.bit(false);
+      return;
+    }
+    unsigned c = 1;
+    while (c < 4 && !fits(static_cast<int64_t>(v),widths[c]))
+    {
+      c++;
+    }
+    // c ones, then a zero unless it is the last class
+    w.write((1ULL << c) - 1,c);
+    if (c < 4)
+    {
+      w.bit(false);
+    }
+    w.write(v,widths[c]);
+  }
+
+  static uint64_t read_classed(BitReader &r, const unsigned *widths)
+  {
+    const unsigned c = r.ones(4);
+    if (c == 0)
+    {
+      return 0;
+    }
+    return static_cast<uint64_t>(sign_extend(r.read(widths[c]),widths[c]));
+  }
+
+  static unsigned selector_bits(const size_t n)
+  {
+    unsigned b = 0;
+    while ((static_cast<size_t>(1) << b) < n)
+    {
+      b++;
+    }
+    return b;
+  }
+
+  static uint64_t double_bits(const double d)
+  {
+    uint64_t u;
+    std::memcpy(&u,&d,sizeof(u));
+    return u;
+  }
+
+  static double bits_double(const uint64_t u)
+  {
+    double d;
+    std::memcpy(&d,&u,sizeof(d));
+    return d;
+  }
+
+  static double pow10(const unsigned e)
+  {
+    static const double p[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                               1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    return p[e];
+  }
+
+  // integer m with m / 10^e == x exactly, if there is one
+  static bool to_decimal(const double x, const unsigned e, int64_t &m)
+  {
+    const double s = x * pow10(e);
+    if (!(std::fabs(s) < 9007199254740992.0)) // 2^53, also false for nan
+    {
+      return false;
+    }
+    m = std::llround(s);
+    return double_bits(static_cast<double>(m) / pow10(e)) == double_bits(x);
+  }
+
+  /**
+   * Smallest exponent e such that every value is an integer over 10^e (the
+   * meter prints a few significant digits, so its readings usually are).
+   * @return false if there is none: the block falls back to XORed floats
+   */
+  static bool decimal_exponent(const Record *recs, const size_t n, unsigned &e)
+  {
+    e = 0;
+    int64_t m;
+    for (size_t i = 0; i < n; i++)
+    {
+      while (!to_decimal(recs[i].value,e,m))
+      {
+        if (++e > max_decimal_exponent)
+        {
+          return false;
+        }
+      }
+    }
+    // a larger exponent can still fail (rounding of x * 10^e): check them all
+    for (size_t i = 0; i < n; i++)
+    {
+      if (!to_decimal(recs[i].value,e,m))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // per device state, on both sides of the codec
+  struct DeviceState
+  {
+    uint32_t device;
+    uint32_t flags;
+    uint64_t ts;
+    uint64_t delta;
+    uint64_t value;     ///< last value bits (float mode) or decimal integer
+    unsigned lead;
+    unsigned trail;
+    bool window;
+  };
+
+  static DeviceState new_device(const uint32_t device, const uint64_t ts)
+  {
+    DeviceState d;
+    d.device = device;
+    d.flags = 0;
+    d.ts = ts;
+    d.delta = 0;
+    d.value = 0;
+    d.lead = 0;
+    d.trail = 0;
+    d.window = false;
+    return d;
+  }
+
+  ///
+  /// BlockColumns
+  ///
+
+  void BlockColumns::clear()
+  {
+    timestamps.clear();
+    values.clear();
+    devices.clear();
+    flags.clear();
+  }
+
+  ///
+  /// BlockCodec
+  ///
+  /// Block layout (bits): value mode (0: XORed floats, 1: decimal, followed by
+  /// the exponent in 5 bits), then for every record
+  ///   device  : '0' + index in the block's device table | '1' + 32 bit id
+  ///   flags   : '0' same as the device's last | '1' + 32 bits
+  ///   time    : delta of deltas against the device's last records
+  ///   value   : against the device's last value
+  /// The first record of a device starts from the previous record's timestamp
+  /// and from a zero value.
+  ///
+
+  const size_t BlockCodec::max_devices;
+
+  void BlockCodec::encode(const Record *recs, const size_t n, std::vector<uint8_t> &out)
+  {
+    if (n == 0)
+    {
+      return;
+    }
+    BitWriter w(out);
+    unsigned e = 0;
+    const bool decimal = decimal_exponent(recs,n,e);
+    w.bit(decimal);
+    if (decimal)
+    {
+      w.write(e,5);
+    }
+
+    std::vector<DeviceState> devs;
+    uint64_t last_ts = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      const Record &r = recs[i];
+      size_t k = 0;
+      while (k < devs.size() && devs[k].device != r.device)
+      {
+        k++;
+      }
+      if (k < devs.size())
+      {
+        w.bit(false);
+        w.write(k,selector_bits(devs.size()));
+      }
+      else
+      {
+        if (devs.size() == max_devices)
+        {
+          throw std::runtime_error("BlockCodec::encode : too many devices in one block");
+        }
+        w.bit(true);
+        w.write(r.device,32);
+        devs.push_back(new_device(r.device,last_ts));
+      }
+      DeviceState &d = devs[k];
+
+      if (r.flags == d.flags)
+      {
+        w.bit(false);
+      }
+      else
+      {
+        w.bit(true);
+        w.write(r.flags,32);
+        d.flags = r.flags;
+      }
+
+      // unsigned arithmetic, so that any gap round trips
+      const uint64_t delta = r.timestamp_ns - d.ts;
+      write_classed(w,delta - d.delta,dod_bits);
+      d.ts = r.timestamp_ns;
+      d.delta = delta;
+      last_ts = r.timestamp_ns;
+
+      if (decimal)
+      {
+        int64_t m = 0;
+        to_decimal(r.value,e,m);
+        write_classed(w,static_cast<uint64_t>(m) - d.value,int_bits);
+        d.value = static_cast<uint64_t>(m);
+        continue;
+      }
+      const uint64_t v = double_bits(r.value);
+      const uint64_t x = v ^ d.value;
+      d.value = v;
+      if (x == 0)
+      {
+        w.bit(false);
+        continue;
+      }
+      w.bit(true);
+      const unsigned l = static_cast<unsigned>(__builtin_clzll(x));
+      const unsigned t = static_cast<unsigned>(__builtin_ctzll(x));
+      if (d.window && l >= d.lead && t >= d.trail)
+      {
+        w.bit(false);
+        w.write(x >> d.trail,64 - d.lead - d.trail);
+      }
+      else
+      {
+        const unsigned len = 64 - l - t;
+        w.bit(true);
+        w.write(l,6);
+        w.write(len - 1,6);
+        w.write(x >> t,len);
+        d.lead = l;
+        d.trail = t;
+        d.window = true;
+      }
+    }
+    w.finish();
+  }
+
+  void BlockCodec::decode(const uint8_t *data, const size_t len, const uint32_t count, BlockColumns &out)
+  {
+    out.clear();
+    if (count == 0)
+    {
+      return;
+    }
+    out.timestamps.resize(count);
+    out.values.resize(count);
+    out.devices.resize(count);
+    out.flags.resize(count);
+    uint64_t *ts = out.timestamps.data();
+    double *vals = out.values.data();
+    uint32_t *devices = out.devices.data();
+    uint32_t *flags = out.flags.data();
+
+    BitReader r(data,len);
+    const bool decimal = r.bit();
+    double scale = 1.0;
+    if (decimal)
+    {
+      const unsigned e = static_cast<unsigned>(r.read(5));
+      if (e > max_decimal_exponent)
+      {
+        throw std::runtime_error("BlockCodec::decode : corrupt block");
+      }
+      scale = pow10(e);
+    }
+
+    DeviceState devs[max_devices];
+    size_t ndevs = 0;
+    unsigned sel = 0;
+    uint64_t last_ts = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+      size_t k;
+      if (!r.bit())
+      {
+        k = static_cast<size_t>(r.read(sel));
+        if (k >= ndevs)
+        {
+          throw std::runtime_error("BlockCodec::decode : corrupt block");
+        }
+      }
+      else
+      {
+        if (ndevs == max_devices)
+        {
+          throw std::runtime_error("BlockCodec::decode : corrupt block");
+        }
+        k = ndevs;
+        devs[ndevs++] = new_device(static_cast<uint32_t>(r.read(32)),last_ts);
+        sel = selector_bits(ndevs);
+      }
+      DeviceState &d = devs[k];
+      devices[i] = d.device;
+
+      if (r.bit())
+      {
+        d.flags = static_cast<uint32_t>(r.read(32));
+      }
+      flags[i] = d.flags;
+
+      d.delta += read_classed(r,dod_bits);
+      d.ts += d.delta;
+      ts[i] = d.ts;
+      last_ts = d.ts;
+
+      if (decimal)
+      {
+        d.value += read_classed(r,int_bits);
+        vals[i] = static_cast<double>(static_cast<int64_t>(d.value)) / scale;
+        continue;
+      }
+      if (r.bit())
+      {
+        if (r.bit())
+        {
+          d.lead = static_cast<unsigned>(r.read(6));
+          const unsigned bits = static_cast<unsigned>(r.read(6)) + 1;
+          if (d.lead + bits > 64)
+          {
+            throw std::runtime_error("BlockCodec::decode : corrupt block");
+          }
+          d.trail = 64 - d.lead - bits;
+        }
+        d.value ^= r.read(64 - d.lead - d.trail) << d.trail;
+      }
+      vals[i] = bits_double(d.value);
+    }
+  }
+
+  ///
+  /// ArchiveWriter
+  ///
+
+  ArchiveWriter::ArchiveWriter (const std::string &path, const uint32_t block_records)
+    : m_path(path),
+      m_fd(-1),
+      m_block_records(std::max<uint32_t>(block_records,1)),
+      m_offset(0),
+      m_records(0),
+      m_last_ts(0)
+  {
+    m_fd = ::open(m_path.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+    if (m_fd == -1)
+    {
+      throw std::runtime_error("ArchiveWriter : failed to create [" + m_path + "] : " + std::strerror(errno));
+    }
+    m_pending.reserve(m_block_records);
+    ArchiveHeader h;
+    h.magic = archive_magic;
+    h.version = archive_version;
+    h.block_records = m_block_records;
+    h.reserved = 0;
+    write_all(&h,sizeof(h));
+  }
+
+  ArchiveWriter::~ArchiveWriter ()
+  {
+    try
+    {
+      close();
+    }
+    catch(std::exception &e)
+    {
+#ifdef DEBUG
+      std::cout << "ArchiveWriter::~ArchiveWriter : " << e.what() << std::endl;
+#endif
+    }
+  }
+
+  bool ArchiveWriter::append(const Record &r)
+  {
+    if (m_fd == -1)
+    {
+      throw std::runtime_error("ArchiveWriter : archive is closed");
+    }
+    if (m_records > 0 && r.timestamp_ns < m_last_ts)
+    {
+      return false;
+    }
+    // the codec takes at most max_devices devices per block
+    if (std::find(m_block_devices.begin(),m_block_devices.end(),r.device) == m_block_devices.end())
+    {
+      if (m_block_devices.size() == BlockCodec::max_devices)
+      {
+        write_block();
+      }
+      m_block_devices.push_back(r.device);
+    }
+    m_pending.push_back(r);
+    m_last_ts = r.timestamp_ns;
+    m_records++;
+    if (m_pending.size() >= m_block_records)
+    {
+      write_block();
+    }
+    return true;
+  }
+
+  void ArchiveWriter::close()
+  {
+    if (m_fd == -1)
+    {
+      return;
+    }
+    write_block();
+    ArchiveFooter f;
+    f.index_offset = m_offset;
+    f.blocks = static_cast<uint32_t>(m_index.size());
+    f.magic = archive_magic;
+    if (!m_index.empty())
+    {
+      write_all(m_index.data(),m_index.size()*sizeof(BlockInfo));
+    }
+    write_all(&f,sizeof(f));
+    fdatasync(m_fd);
+    ::close(m_fd);
+    m_fd = -1;
+#ifdef DEBUG
+    std::cout << "ArchiveWriter::close : " << m_records << " records in " << m_index.size()
+        << " blocks, " << m_offset << " bytes" << std::endl;
+#endif
+  }
+
+  void ArchiveWriter::write_block()
+  {
+    if (m_pending.empty())
+    {
+      return;
+    }
+    m_buffer.clear();
+    BlockCodec::encode(m_pending.data(),m_pending.size(),m_buffer);
+    BlockInfo b;
+    b.first_ts = m_pending.front().timestamp_ns;
+    b.last_ts = m_pending.back().timestamp_ns;
+    b.offset = m_offset;
+    b.bytes = static_cast<uint32_t>(m_buffer.size());
+    b.count = static_cast<uint32_t>(m_pending.size());
+    write_all(m_buffer.data(),m_buffer.size());
+    m_index.push_back(b);
+    m_pending.clear();
+    m_block_devices.clear();
+  }
+
+  void ArchiveWriter::write_all(const void *data, const size_t len)
+  {
+    const char *p = static_cast<const char*>(data);
+    size_t left = len;
+    while (left > 0)
+    {
+      const ssize_t w = ::write(m_fd,p,left);
+      if (w == -1)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        throw std::runtime_error("ArchiveWriter : failed to write [" + m_path + "] : " + std::strerror(errno));
+      }
+      p += w;
+      left -= static_cast<size_t>(w);
+    }
+    m_offset += len;
+  }
+
+  ///
+  /// ArchiveReader
+  ///
+
+  ArchiveReader::ArchiveReader (const std::string &path)
+    : m_path(path),
+      m_fd(-1),
+      m_map(nullptr),
+      m_map_len(0)
+  {
+    m_fd = ::open(m_path.c_str(),O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1)
+    {
+      throw std::runtime_error("ArchiveReader : failed to open [" + m_path + "] : " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(m_fd,&st) == -1 || static_cast<size_t>(st.st_size) < sizeof(ArchiveHeader) + sizeof(ArchiveFooter))
+    {
+      ::close(m_fd);
+      throw std::runtime_error("ArchiveReader : not an archive [" + m_path + "]");
+    }
+    m_map_len = static_cast<size_t>(st.st_size);
+    void *m = mmap(nullptr,m_map_len,PROT_READ,MAP_SHARED,m_fd,0);
+    if (m == MAP_FAILED)
+    {
+      const int err = errno;
+      ::close(m_fd);
+      throw std::runtime_error("ArchiveReader : failed to map [" + m_path + "] : " + std::strerror(err));
+    }
+    m_map = static_cast<const uint8_t*>(m);
+    // blocks are decoded front to back
+    madvise(m,m_map_len,MADV_SEQUENTIAL);
+
+    ArchiveHeader h;
+    ArchiveFooter f;
+    std::memcpy(&h,m_map,sizeof(h));
+    std::memcpy(&f,m_map + m_map_len - sizeof(f),sizeof(f));
+    const uint64_t index_end = f.index_offset + static_cast<uint64_t>(f.blocks) * sizeof(BlockInfo);
+    bool valid = (h.magic == archive_magic && h.version == archive_version && f.magic == archive_magic &&
+                  index_end == m_map_len - sizeof(f));
+    if (valid)
+    {
+      m_index.resize(f.blocks);
+      if (f.blocks > 0)
+      {
+        std::memcpy(m_index.data(),m_map + f.index_offset,f.blocks*sizeof(BlockInfo));
+      }
+      for (const BlockInfo &b : m_index)
+      {
+        if (b.offset < sizeof(ArchiveHeader) || b.offset + b.bytes > f.index_offset)
+        {
+          valid = false;
+          break;
+        }
+      }
+    }
+    if (!valid)
+    {
+      munmap(const_cast<uint8_t*>(m_map),m_map_len);
+      ::close(m_fd);
+      throw std::runtime_error("ArchiveReader : invalid or incomplete archive [" + m_path + "]");
+    }
+  }
+
+  ArchiveReader::~ArchiveReader ()
+  {
+    munmap(const_cast<uint8_t*>(m_map),m_map_len);
+    ::close(m_fd);
+  }
+
+  uint64_t ArchiveReader::count() const
+  {
+    uint64_t n = 0;
+    for (const BlockInfo &b : m_index)
+    {
+      n += b.count;
+    }
+    return n;
+  }
+
+  void ArchiveReader::read_block(const size_t i, BlockColumns &out) const
+  {
+    const BlockInfo &b = m_index.at(i);
+    BlockCodec::decode(m_map + b.offset,b.bytes,b.count,out);
+  }
+
+  size_t ArchiveReader::query(const uint64_t t0, const uint64_t t1, std::vector<Record> &out,
+                              const uint32_t device) const
+  {
+    if (t1 < t0)
+    {
+      return 0;
+    }
+    // first block that ends at or after t0 (blocks are in time order)
+    const auto first = std::lower_bound(m_index.begin(),m_index.end(),t0,
+                                        [](const BlockInfo &b, const uint64_t t) {return b.last_ts < t;});
+    size_t found = 0;
+    BlockColumns cols;
+    for (auto it = first; it != m_index.end() && it->first_ts <= t1; ++it)
+    {
+      BlockCodec::decode(m_map + it->offset,it->bytes,it->count,cols);
+      const size_t n = cols.size();
+      const size_t begin = std::lower_bound(cols.timestamps.begin(),cols.timestamps.end(),t0) - cols.timestamps.begin();
+      for (size_t i = begin; i < n && cols.timestamps[i] <= t1; i++)
+      {
+        if (device == TimeSeriesStore::any_device || cols.devices[i] == device)
+        {
+          Record r;
+          r.timestamp_ns = cols.timestamps[i];
+          r.value = cols.values[i];
+          r.device = cols.devices[i];
+          r.flags = cols.flags[i];
+          out.push_back(r);
+          found++;
+        }
+      }
+    }
+    return found;
+  }
+
+  ///
+  /// conversion
+  ///
+
+  uint64_t archive_store(const TimeSeriesStore &store, const std::string &path,
+                         const uint32_t block_records)
+  {
+    ArchiveWriter w(path,block_records);
+    std::vector<Record> buf;
+    uint64_t pos = 0;
+    for (;;)
+    {
+      buf.clear();
+      const size_t n = store.read(pos,65536,buf);
+      if (n == 0)
+      {
+        break;
+      }
+      for (const Record &r : buf)
+      {
+        w.append(r);
+      }
+      pos += n;
+    }
+    w.close();
+    return w.records();
+  }
+
+} /* namespace device */
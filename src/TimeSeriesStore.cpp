@@ -0,0 +1,514 @@
+/*
+ * TimeSeriesStore.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <TimeSeriesStore.hh>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  // on-disk layout of a segment: this header, then the records
+  struct SegmentHeader
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t capacity;    ///< records
+    uint64_t count;       ///< committed records. Written last, on every append
+    uint64_t first_ts;
+    uint64_t last_ts;
+    uint64_t pad[2];
+  };
+
+  static_assert(sizeof(SegmentHeader) == 64, "unexpected segment header size");
+  static_assert(sizeof(Record) == 24, "unexpected record size");
+
+  static const uint32_t segment_magic = 0x31535354; // "TSS1"
+  static const uint32_t segment_version = 1;
+
+  const uint32_t TimeSeriesStore::any_device;
+  const size_t TimeSeriesStore::index_stride;
+
+  struct TimeSeriesStore::Segment
+  {
+    uint32_t seq;
+    std::string path;
+    int fd;
+    bool writable;
+    char *map;
+    size_t map_len;
+    SegmentHeader *hdr;
+    Record *recs;
+    uint64_t capacity;
+    std::atomic<uint64_t> count;          ///< records visible to the queries
+    uint64_t synced;                      ///< records known to be on disk (flusher only)
+    std::unique_ptr<uint64_t[]> index;    ///< timestamp of every index_stride-th record
+  };
+
+  static std::string io_error(const std::string &what, const std::string &path, const int err)
+  {
+    return "TimeSeriesStore : " + what + " [" + path + "] : " + std::strerror(err);
+  }
+
+  TimeSeriesStore::TimeSeriesStore (const std::string &dir, const Mode mode,
+                                    const uint64_t records_per_segment,
+                                    const uint32_t flush_interval_ms)
+    : m_dir(dir),
+      m_mode(mode),
+      m_records_per_segment(std::max<uint64_t>(records_per_segment,index_stride)),
+      m_flush_interval_ms(flush_interval_ms),
+      m_active(nullptr),
+      m_last_ts(0),
+      m_stop(false)
+  {
+    if (m_mode == ReadWrite)
+    {
+      if (mkdir(m_dir.c_str(),0755) == -1 && errno != EEXIST)
+      {
+        throw std::runtime_error(io_error("failed to create directory",m_dir,errno));
+      }
+    }
+    open_segments();
+    if (m_mode == ReadWrite && m_flush_interval_ms > 0)
+    {
+      m_flusher = std::thread(&TimeSeriesStore::flush_loop,this);
+    }
+  }
+
+  TimeSeriesStore::~TimeSeriesStore ()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_flush_mutex);
+      m_stop = true;
+    }
+    m_flush_cv.notify_all();
+    if (m_flusher.joinable())
+    {
+      m_flusher.join();
+    }
+    if (m_mode == ReadWrite)
+    {
+      flush();
+    }
+    for (auto &s : m_segments)
+    {
+      munmap(s->map,s->map_len);
+      ::close(s->fd);
+    }
+  }
+
+  bool TimeSeriesStore::append(const Record &r)
+  {
+    if (m_mode != ReadWrite)
+    {
+      throw std::runtime_error("TimeSeriesStore : store is read only");
+    }
+    if (r.timestamp_ns < m_last_ts)
+    {
+      return false;
+    }
+    Segment *s = m_active;
+    uint64_t n = s->count.load(std::memory_order_relaxed);
+    if (n == s->capacity)
+    {
+      rotate();
+      s = m_active;
+      n = 0;
+    }
+    s->recs[n] = r;
+    if (n % index_stride == 0)
+    {
+      s->index[n / index_stride] = r.timestamp_ns;
+    }
+    if (n == 0)
+    {
+      s->hdr->first_ts = r.timestamp_ns;
+    }
+    s->hdr->last_ts = r.timestamp_ns;
+    // the count goes last: a record is only there once it is counted
+    __atomic_store_n(&s->hdr->count,n + 1,__ATOMIC_RELEASE);
+    s->count.store(n + 1,std::memory_order_release);
+    m_last_ts = r.timestamp_ns;
+    return true;
+  }
+
+  bool TimeSeriesStore::append(const uint64_t timestamp_ns, const double value, const uint32_t device, const uint32_t flags)
+  {
+    Record r;
+    r.timestamp_ns = timestamp_ns;
+    r.value = value;
+    r.device = device;
+    r.flags = flags;
+    return append(r);
+  }
+
+  size_t TimeSeriesStore::query(const uint64_t t0, const uint64_t t1, std::vector<Record> &out,
+                                const uint32_t device) const
+  {
+    if (t1 < t0)
+    {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(m_seg_mutex);
+    // first segment that ends at or after t0 (segments are in time order)
+    size_t lo = 0;
+    size_t hi = m_segments.size();
+    while (lo < hi)
+    {
+      const size_t mid = (lo + hi) / 2;
+      const Segment &s = *m_segments[mid];
+      const uint64_t n = s.count.load(std::memory_order_acquire);
+      if (n > 0 && s.recs[n - 1].timestamp_ns < t0)
+      {
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid;
+      }
+    }
+    size_t found = 0;
+    for (size_t i = lo; i < m_segments.size(); i++)
+    {
+      bool past_end = false;
+      found += scan(*m_segments[i],t0,t1,out,device,past_end);
+      if (past_end)
+      {
+        break;
+      }
+    }
+    return found;
+  }
+
+  size_t TimeSeriesStore::scan(const Segment &s, const uint64_t t0, const uint64_t t1, std::vector<Record> &out, const uint32_t device, bool &past_end) const
+  {
+    const uint64_t n = s.count.load(std::memory_order_acquire);
+    if (n == 0)
+    {
+      return 0;
+    }
+    // sparse index: first indexed record at or after t0, then search the block before it
+    const uint64_t nidx = (n + index_stride - 1) / index_stride;
+    const uint64_t *idx = s.index.get();
+    const uint64_t k = std::lower_bound(idx,idx + nidx,t0) - idx;
+    const uint64_t begin = (k == 0) ? 0 : (k - 1) * index_stride;
+    const uint64_t end = std::min<uint64_t>(n,k * index_stride + 1);
+    const Record *first = std::lower_bound(s.recs + begin,s.recs + end,t0,
+                                           [](const Record &r, const uint64_t t) {return r.timestamp_ns < t;});
+    size_t found = 0;
+    uint64_t i = first - s.recs;
+    for (; i < n; i++)
+    {
+      const Record &r = s.recs[i];
+      if (r.timestamp_ns > t1)
+      {
+        past_end = true;
+        break;
+      }
+      if (device == any_device || r.device == device)
+      {
+        out.push_back(r);
+        found++;
+      }
+    }
+    return found;
+  }
+
+  size_t TimeSeriesStore::read(const uint64_t first, const size_t n, std::vector<Record> &out) const
+  {
+    std::lock_guard<std::mutex> lock(m_seg_mutex);
+    uint64_t pos = first;
+    size_t found = 0;
+    for (auto &s : m_segments)
+    {
+      const uint64_t c = s->count.load(std::memory_order_acquire);
+      if (pos >= c)
+      {
+        pos -= c;
+        continue;
+      }
+      const uint64_t take = std::min<uint64_t>(c - pos,n - found);
+      out.insert(out.end(),s->recs + pos,s->recs + pos + take);
+      found += take;
+      pos = 0;
+      if (found == n)
+      {
+        break;
+      }
+    }
+    return found;
+  }
+
+  uint64_t TimeSeriesStore::count() const
+  {
+    std::lock_guard<std::mutex> lock(m_seg_mutex);
+    uint64_t n = 0;
+    for (auto &s : m_segments)
+    {
+      n += s->count.load(std::memory_order_acquire);
+    }
+    return n;
+  }
+
+  bool TimeSeriesStore::time_range(uint64_t &first, uint64_t &last) const
+  {
+    std::lock_guard<std::mutex> lock(m_seg_mutex);
+    bool have_first = false;
+    for (auto &s : m_segments)
+    {
+      const uint64_t n = s->count.load(std::memory_order_acquire);
+      if (n == 0)
+      {
+        continue;
+      }
+      if (!have_first)
+      {
+        first = s->recs[0].timestamp_ns;
+        have_first = true;
+      }
+      last = s->recs[n - 1].timestamp_ns;
+    }
+    return have_first;
+  }
+
+  void TimeSeriesStore::flush()
+  {
+    if (m_mode != ReadWrite)
+    {
+      return;
+    }
+    // segments are never removed while the store is open: sync outside the lock
+    std::vector<Segment*> segs;
+    {
+      std::lock_guard<std::mutex> lock(m_seg_mutex);
+      for (auto &s : m_segments)
+      {
+        segs.push_back(s.get());
+      }
+    }
+    std::lock_guard<std::mutex> lock(m_flush_mutex);
+    for (Segment *s : segs)
+    {
+      sync_segment(*s);
+    }
+  }
+
+  ///
+  /// private methods
+  ///
+
+  void TimeSeriesStore::open_segments()
+  {
+    std::vector<uint32_t> seqs;
+    DIR *d = opendir(m_dir.c_str());
+    if (d == nullptr)
+    {
+      throw std::runtime_error(io_error("failed to open directory",m_dir,errno));
+    }
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr)
+    {
+      unsigned int seq;
+      char tail;
+      if (std::sscanf(e->d_name,"segment_%8u.ts%c",&seq,&tail) == 2 && tail == 's' &&
+          std::strlen(e->d_name) == std::strlen("segment_00000000.tss"))
+      {
+        seqs.push_back(seq);
+      }
+    }
+    closedir(d);
+    std::sort(seqs.begin(),seqs.end());
+    for (size_t i = 0; i < seqs.size(); i++)
+    {
+      char name[64];
+      std::snprintf(name,sizeof(name),"/segment_%08u.tss",seqs[i]);
+      m_segments.push_back(std::unique_ptr<Segment>(map_segment(m_dir + name,seqs[i],false)));
+    }
+    if (m_mode == ReadWrite)
+    {
+      if (m_segments.empty())
+      {
+        m_segments.push_back(std::unique_ptr<Segment>(create_segment(0)));
+      }
+      // appends continue on the last segment
+      m_active = m_segments.back().get();
+      for (auto &s : m_segments)
+      {
+        const uint64_t c = s->count.load();
+        if (c > 0)
+        {
+          m_last_ts = std::max(m_last_ts,s->recs[c - 1].timestamp_ns);
+        }
+      }
+#ifdef DEBUG
+      std::cout << "TimeSeriesStore::open_segments : " << m_segments.size() << " segments, active has " << m_active->count.load() << " records" << std::endl;
+#endif
+    }
+  }
+
+  TimeSeriesStore::Segment *TimeSeriesStore::create_segment(const uint32_t seq)
+  {
+    char name[64];
+    std::snprintf(name,sizeof(name),"/segment_%08u.tss",seq);
+    return map_segment(m_dir + name,seq,true);
+  }
+
+  TimeSeriesStore::Segment *TimeSeriesStore::map_segment(const std::string &path, const uint32_t seq, const bool create)
+  {
+    std::unique_ptr<Segment> s(new Segment());
+    s->seq = seq;
+    s->path = path;
+    s->writable = (m_mode == ReadWrite);
+    int flags = s->writable ? O_RDWR : O_RDONLY;
+    if (create)
+    {
+      flags |= O_CREAT | O_EXCL;
+    }
+    s->fd = ::open(path.c_str(),flags | O_CLOEXEC,0644);
+    if (s->fd == -1)
+    {
+      throw std::runtime_error(io_error("failed to open segment",path,errno));
+    }
+    uint64_t capacity = m_records_per_segment;
+    if (create)
+    {
+      s->map_len = sizeof(SegmentHeader) + capacity * sizeof(Record);
+      if (ftruncate(s->fd,static_cast<off_t>(s->map_len)) == -1)
+      {
+        int err = errno;
+        ::close(s->fd);
+        throw std::runtime_error(io_error("failed to size segment",path,err));
+      }
+    }
+    else
+    {
+      struct stat st;
+      if (fstat(s->fd,&st) == -1 || static_cast<size_t>(st.st_size) < sizeof(SegmentHeader))
+      {
+        ::close(s->fd);
+        throw std::runtime_error("TimeSeriesStore : segment too short [" + path + "]");
+      }
+      s->map_len = static_cast<size_t>(st.st_size);
+    }
+    int prot = PROT_READ | (s->writable ? PROT_WRITE : 0);
+    void *m = mmap(nullptr,s->map_len,prot,MAP_SHARED,s->fd,0);
+    if (m == MAP_FAILED)
+    {
+      int err = errno;
+      ::close(s->fd);
+      throw std::runtime_error(io_error("failed to map segment",path,err));
+    }
+    s->map = static_cast<char*>(m);
+    s->hdr = reinterpret_cast<SegmentHeader*>(s->map);
+    s->recs = reinterpret_cast<Record*>(s->map + sizeof(SegmentHeader));
+    if (create)
+    {
+      s->hdr->magic = segment_magic;
+      s->hdr->version = segment_version;
+      s->hdr->record_size = sizeof(Record);
+      s->hdr->capacity = capacity;
+      s->hdr->count = 0;
+      s->hdr->first_ts = 0;
+      s->hdr->last_ts = 0;
+    }
+    else
+    {
+      const SegmentHeader &h = *s->hdr;
+      if (h.magic != segment_magic || h.version != segment_version || h.record_size != sizeof(Record) ||
+          h.count > h.capacity || sizeof(SegmentHeader) + h.capacity * sizeof(Record) > s->map_len)
+      {
+        munmap(s->map,s->map_len);
+        ::close(s->fd);
+        throw std::runtime_error("TimeSeriesStore : invalid segment [" + path + "]");
+      }
+      capacity = h.capacity;
+    }
+    s->capacity = capacity;
+    const uint64_t n = __atomic_load_n(&s->hdr->count,__ATOMIC_ACQUIRE);
+    s->count.store(n);
+    s->synced = n;
+    s->index.reset(new uint64_t[capacity / index_stride + 1]);
+    for (uint64_t i = 0; i < n; i += index_stride)
+    {
+      s->index[i / index_stride] = s->recs[i].timestamp_ns;
+    }
+    return s.release();
+  }
+
+  void TimeSeriesStore::rotate()
+  {
+    Segment *s = create_segment(m_active->seq + 1);
+    {
+      std::lock_guard<std::mutex> lock(m_seg_mutex);
+      m_segments.push_back(std::unique_ptr<Segment>(s));
+    }
+    // the full segment is written out by the flusher
+    m_active = s;
+#ifdef DEBUG
+    std::cout << "TimeSeriesStore::rotate : new segment [" << s->path << "]" << std::endl;
+#endif
+  }
+
+  void TimeSeriesStore::sync_segment(Segment &s)
+  {
+    const uint64_t n = s.count.load(std::memory_order_acquire);
+    if (n == s.synced)
+    {
+      return;
+    }
+    // records first, then the header with the count
+    const long page = sysconf(_SC_PAGESIZE);
+    const size_t from = sizeof(SegmentHeader) + s.synced * sizeof(Record);
+    const size_t to = sizeof(SegmentHeader) + n * sizeof(Record);
+    const size_t start = from - (from % page);
+    if (msync(s.map + start,to - start,MS_SYNC) == -1 ||
+        msync(s.map,sizeof(SegmentHeader),MS_SYNC) == -1)
+    {
+#ifdef DEBUG
+      std::cout << "TimeSeriesStore::sync_segment : msync failed : " << std::strerror(errno) << std::endl;
+#endif
+      return;
+    }
+    fdatasync(s.fd);
+    s.synced = n;
+  }
+
+  void TimeSeriesStore::flush_loop()
+  {
+    std::unique_lock<std::mutex> lock(m_flush_mutex);
+    while (!m_stop)
+    {
+      m_flush_cv.wait_for(lock,std::chrono::milliseconds(m_flush_interval_ms));
+      if (m_stop)
+      {
+        break;
+      }
+      lock.unlock();
+      flush();
+      lock.lock();
+    }
+  }
+
+} /* namespace device */
@@ -0,0 +1,388 @@
+/*
+ * Transport.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <Transport.hh>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <deque>
+#include <ctime>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  ///
+  /// ScriptedModel
+  ///
+
+  void ScriptedModel::receive(const char *data, const size_t len, std::string &reply)
+  {
+    m_pending.append(data,len);
+    size_t start = 0;
+    size_t pos;
+    while ((pos = m_pending.find(m_eol,start)) != std::string::npos)
+    {
+      const std::string cmd = m_pending.substr(start,pos - start);
+      start = pos + m_eol.size();
+      m_received++;
+      m_last = cmd;
+      if (m_echo)
+      {
+        reply += cmd + m_eol;
+      }
+      answer(cmd,reply);
+    }
+    m_pending.erase(0,start);
+  }
+
+  void ScriptedModel::answer(const std::string &cmd, std::string &reply)
+  {
+    auto it = m_exact.find(cmd);
+    if (it != m_exact.end())
+    {
+      reply += it->second;
+      return;
+    }
+    // longest prefix: the last map entry that is a prefix of the command
+    for (auto p = m_prefix.rbegin(); p != m_prefix.rend(); ++p)
+    {
+      if (cmd.compare(0,p->first.size(),p->first) == 0)
+      {
+        reply += p->second;
+        return;
+      }
+    }
+    reply += m_default;
+  }
+
+  ///
+  /// SerialTransport
+  ///
+
+  SerialTransport::SerialTransport (const std::string &port, const uint32_t baud_rate)
+  {
+    m_serial.setPort(port);
+    m_serial.setBaudrate(baud_rate);
+    m_serial.setBytesize(serial::eightbits);
+    m_serial.setParity(serial::parity_none);
+    m_serial.setStopbits(serial::stopbits_one);
+  }
+
+  SerialTransport::~SerialTransport ()
+  {
+    if (m_serial.isOpen())
+    {
+      m_serial.close();
+    }
+  }
+
+  void SerialTransport::set_timeout_ms(const uint32_t ms)
+  {
+    serial::Timeout t = serial::Timeout::simpleTimeout(ms);
+    m_serial.setTimeout(t);
+  }
+
+  ///
+  /// PtyServer
+  ///
+
+  static uint64_t monotonic_ns()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  PtyServer::PtyServer (std::shared_ptr<DeviceModel> model)
+    : m_model(model),
+      m_master(-1),
+      m_keep(-1),
+      m_wake{-1,-1},
+      m_latency_ns(0),
+      m_byte_ns(0),
+      m_bytes_in(0),
+      m_bytes_out(0)
+  {
+    m_master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (m_master == -1)
+    {
+      throw serial::IOException(__FILE__,__LINE__,errno);
+    }
+    char name[128];
+    if (grantpt(m_master) == -1 || unlockpt(m_master) == -1 ||
+        ptsname_r(m_master,name,sizeof(name)) != 0)
+    {
+      const int err = errno;
+      ::close(m_master);
+      throw serial::IOException(__FILE__,__LINE__,err);
+    }
+    m_slave = name;
+    if (pipe2(m_wake,O_CLOEXEC) == -1)
+    {
+      const int err = errno;
+      ::close(m_master);
+      throw serial::IOException(__FILE__,__LINE__,err);
+    }
+    // hold the slave open, so that the master does not hang up whenever the
+    // driver closes and reopens the port
+    m_keep = ::open(m_slave.c_str(),O_RDWR | O_NOCTTY | O_CLOEXEC);
+  }
+
+  PtyServer::~PtyServer ()
+  {
+    if (m_server.joinable())
+    {
+      stop();
+      m_server.join();
+    }
+    ::close(m_wake[0]);
+    ::close(m_wake[1]);
+    if (m_keep != -1)
+    {
+      ::close(m_keep);
+    }
+    ::close(m_master);
+  }
+
+  void PtyServer::start()
+  {
+    if (m_model && !m_server.joinable())
+    {
+      m_server = std::thread(&PtyServer::run,this);
+    }
+  }
+
+  void PtyServer::stop()
+  {
+    const char c = 'q';
+    ssize_t rc = ::write(m_wake[1],&c,1);
+    (void)rc;
+  }
+
+  void PtyServer::run()
+  {
+    if (!m_model)
+    {
+      return;
+    }
+    // answers on their way out. Byte i of a chunk leaves the line at
+    // start + (i+1) * byte time
+    struct Chunk
+    {
+      uint64_t start;
+      std::string data;
+      size_t sent;
+    };
+    std::deque<Chunk> out;
+    // when the last byte received, and the last byte queued, would be
+    // through a real line
+    uint64_t rx_done = 0;
+    uint64_t tx_free = 0;
+    char buf[4096];
+    std::string reply;
+    struct pollfd fds[2];
+    fds[0].fd = m_master;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wake[0];
+    fds[1].events = POLLIN;
+    while (true)
+    {
+      const uint64_t byte_ns = m_byte_ns.load();
+      uint64_t now = monotonic_ns();
+      // send whatever is due
+      while (!out.empty())
+      {
+        Chunk &c = out.front();
+        size_t due = 0;
+        if (now >= c.start)
+        {
+          due = (byte_ns == 0) ? c.data.size() : std::min<size_t>(c.data.size(),(now - c.start) / byte_ns);
+        }
+        if (due > c.sent)
+        {
+          const ssize_t w = ::write(m_master,c.data.data() + c.sent,due - c.sent);
+          if (w == -1)
+          {
+            if (errno == EINTR || errno == EAGAIN)
+            {
+              break;
+            }
+#ifdef DEBUG
+            std::cout << "PtyServer::run : write failed : " << errno << std::endl;
+#endif
+            out.pop_front();
+            continue;
+          }
+          c.sent += static_cast<size_t>(w);
+          m_bytes_out += static_cast<uint64_t>(w);
+        }
+        if (c.sent < c.data.size())
+        {
+          break;
+        }
+        out.pop_front();
+      }
+      struct timespec wait;
+      struct timespec *timeout = nullptr;
+      if (!out.empty())
+      {
+        const Chunk &c = out.front();
+        const uint64_t next = c.start + (c.sent + 1) * byte_ns;
+        const uint64_t dt = (next > now) ? (next - now) : 0;
+        wait.tv_sec = static_cast<time_t>(dt / 1000000000ULL);
+        wait.tv_nsec = static_cast<long>(dt % 1000000000ULL);
+        timeout = &wait;
+      }
+      if (ppoll(fds,2,timeout,nullptr) == -1)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        break;
+      }
+      if (fds[1].revents != 0)
+      {
+        char c;
+        ssize_t rc = ::read(m_wake[0],&c,1);
+        (void)rc;
+        break;
+      }
+      if ((fds[0].revents & POLLIN) == 0)
+      {
+        continue;
+      }
+      const ssize_t n = ::read(m_master,buf,sizeof(buf));
+      if (n <= 0)
+      {
+        continue;
+      }
+      m_bytes_in += static_cast<uint64_t>(n);
+      now = monotonic_ns();
+      rx_done = std::max(now,rx_done) + static_cast<uint64_t>(n) * byte_ns;
+      reply.clear();
+      m_model->receive(buf,static_cast<size_t>(n),reply);
+      if (reply.empty())
+      {
+        continue;
+      }
+      Chunk c;
+      c.start = std::max(rx_done + m_latency_ns.load() + m_model->reply_delay_ns(),tx_free);
+      c.data.swap(reply);
+      c.sent = 0;
+      tx_free = c.start + c.data.size() * byte_ns;
+      out.push_back(std::move(c));
+    }
+  }
+
+  ///
+  /// PtyTransport
+  ///
+
+  PtyTransport::PtyTransport (std::shared_ptr<DeviceModel> model, const uint32_t baud_rate)
+    : SerialTransport("",baud_rate),
+      m_server(model)
+  {
+    m_serial.setPort(m_server.slave_name());
+    m_server.start();
+  }
+
+  PtyTransport::~PtyTransport ()
+  {
+    // the port goes before the master
+    if (m_serial.isOpen())
+    {
+      m_serial.close();
+    }
+  }
+
+  ///
+  /// LoopbackTransport
+  ///
+
+  LoopbackTransport::LoopbackTransport (std::shared_ptr<DeviceModel> model)
+    : m_model(model),
+      m_open(false),
+      m_timeout_ms(0),
+      m_rx_pos(0)
+  {
+  }
+
+  void LoopbackTransport::close()
+  {
+    m_open = false;
+    flush_input();
+  }
+
+  size_t LoopbackTransport::write(const std::string &data)
+  {
+    if (!m_open)
+    {
+      throw serial::PortNotOpenedException("LoopbackTransport::write");
+    }
+    if (m_rx_pos == m_rx.size())
+    {
+      m_rx.clear();
+      m_rx_pos = 0;
+    }
+    m_model->receive(data.data(),data.size(),m_rx);
+    return data.size();
+  }
+
+  size_t LoopbackTransport::readline(std::string &line, const size_t size, const std::string &eol)
+  {
+    if (!m_open)
+    {
+      throw serial::PortNotOpenedException("LoopbackTransport::readline");
+    }
+    const size_t avail = m_rx.size() - m_rx_pos;
+    size_t len = avail;
+    const size_t pos = m_rx.find(eol,m_rx_pos);
+    if (pos != std::string::npos)
+    {
+      len = pos - m_rx_pos + eol.size();
+    }
+    len = std::min(len,size);
+    line.append(m_rx,m_rx_pos,len);
+    m_rx_pos += len;
+    return len;
+  }
+
+  std::vector<std::string> LoopbackTransport::readlines(const size_t size, const std::string &eol, const size_t max_lines)
+  {
+    std::vector<std::string> lines;
+    size_t read_so_far = 0;
+    while (read_so_far < size && (max_lines == 0 || lines.size() < max_lines))
+    {
+      std::string line;
+      const size_t n = readline(line,size - read_so_far,eol);
+      if (n == 0)
+      {
+        break;
+      }
+      read_so_far += n;
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  void LoopbackTransport::flush_input()
+  {
+    m_rx.clear();
+    m_rx_pos = 0;
+  }
+
+} /* namespace device */
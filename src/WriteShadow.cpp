@@ -0,0 +1,122 @@
+/*
+ * WriteShadow.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: nbarros
+ */
+
+#include <WriteShadow.hh>
+
+//#define DEBUG 1
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+namespace device
+{
+
+  WriteShadow::WriteShadow ()
+    : m_enabled(false),
+      m_skipped(0)
+  {
+  }
+
+  void WriteShadow::track(const std::string &cmd)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tracked.insert(mnemonic(cmd));
+  }
+
+  void WriteShadow::resync_on(const std::string &cmd)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resyncs.insert(mnemonic(cmd));
+  }
+
+  bool WriteShadow::redundant(const std::string &cmd)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_enabled || m_last.empty())
+    {
+      return false;
+    }
+    std::unordered_map<std::string,std::string>::const_iterator it = m_last.find(mnemonic(cmd));
+    if (it == m_last.end() || it->second != cmd)
+    {
+      return false;
+    }
+#ifdef DEBUG
+    std::cout << "WriteShadow::redundant : skipping [" << cmd << "]" << std::endl;
+#endif
+    m_skipped++;
+    return true;
+  }
+
+  void WriteShadow::sent(const std::string &cmd, const bool written)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_tracked.empty() && m_resyncs.empty())
+    {
+      return;
+    }
+    const std::string m = mnemonic(cmd);
+    if (m_resyncs.count(m))
+    {
+#ifdef DEBUG
+      std::cout << "WriteShadow::sent : [" << cmd << "] resets the settings" << std::endl;
+#endif
+      m_last.clear();
+      return;
+    }
+    if (!m_tracked.count(m))
+    {
+      return;
+    }
+    if (written && m_enabled)
+    {
+      m_last[m] = cmd;
+    }
+    else
+    {
+      m_last.erase(m);
+    }
+  }
+
+  void WriteShadow::forget(const std::string &cmd)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_last.erase(mnemonic(cmd));
+  }
+
+  void WriteShadow::clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_last.clear();
+  }
+
+  void WriteShadow::set_enabled(const bool e)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = e;
+    // whatever was recorded before may be stale by the next time it is on
+    m_last.clear();
+  }
+
+  bool WriteShadow::get_enabled() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_enabled;
+  }
+
+  uint64_t WriteShadow::skipped() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_skipped;
+  }
+
+  std::string WriteShadow::mnemonic(const std::string &cmd)
+  {
+    return cmd.substr(0,cmd.find(' '));
+  }
+
+} /* namespace device */
@@ -54,6 +54,7 @@ using serial::Serial;
 using serial::SerialException;
 using serial::PortNotOpenedException;
 using serial::IOException;
+using serial::Tap;
 
 
 MillisecondTimer::MillisecondTimer (const uint32_t millis)
@@ -608,6 +609,12 @@ Serial::SerialImpl::read (uint8_t *buf, size_t size)
       }
     }
   }
+  if (bytes_read > 0) {
+    std::shared_ptr<Tap> tap = std::atomic_load (&tap_);
+    if (tap) {
+      tap->onRead (buf, bytes_read);
+    }
+  }
   return bytes_read;
 }
 
@@ -709,6 +716,12 @@ Serial::SerialImpl::write (const uint8_t *data, size_t length)
                           " in the list, this shouldn't happen!");
     }
   }
+  if (bytes_written > 0) {
+    std::shared_ptr<Tap> tap = std::atomic_load (&tap_);
+    if (tap) {
+      tap->onWrite (data, bytes_written);
+    }
+  }
   return bytes_written;
 }
 
@@ -724,6 +737,24 @@ Serial::SerialImpl::getPort () const
   return port_;
 }
 
+int
+Serial::SerialImpl::getFd () const
+{
+  return is_open_ ? fd_ : -1;
+}
+
+void
+Serial::SerialImpl::setTap (std::shared_ptr<Tap> tap)
+{
+  std::atomic_store (&tap_, tap);
+}
+
+std::shared_ptr<Tap>
+Serial::SerialImpl::getTap () const
+{
+  return std::atomic_load (&tap_);
+}
+
 void
 Serial::SerialImpl::setTimeout (serial::Timeout &timeout)
 {
@@ -3,14 +3,40 @@
  *
  *  Created on: May 23, 2023
  *      Author: nbarros
+ *
+ *  usage: probe_serial_ports [-i [port ...]]
+ *    -i  also ask what is connected to each port (all ports, or the ones given)
  */
 
 #include <utilities.hh>
+#include <DeviceProbe.hh>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
 
 int main(int argc, char**argv)
 {
   util::enumerate_ports();
+  if (argc > 1 && std::strcmp(argv[1],"-i") == 0)
+  {
+    device::DeviceProbe probe;
+    std::map<std::string,device::ProbeResult> found;
+    if (argc > 2)
+    {
+      found = probe.probe(std::vector<std::string>(argv + 2,argv + argc));
+    }
+    else
+    {
+      found = probe.probe_all();
+    }
+    for (const auto &entry : found)
+    {
+      const device::ProbeResult &r = entry.second;
+      std::printf("%s : %s (S/N [%s], adapter S/N [%s]) %s%s [%.0f ms]\n",r.port.c_str(),
+                  device::ProbeResult::kind_name(r.kind),r.serial_number.c_str(),
+                  r.adapter_serial.c_str(),r.info.c_str(),r.error.c_str(),r.elapsed_ms);
+    }
+  }
   return 0;
 }
-
-
@@ -1,13 +1,6 @@
 /* Copyright 2012 William Woodall and John Harrison */
 #include <algorithm>
-
-#if !defined(_WIN32) && !defined(__OpenBSD__) && !defined(__FreeBSD__)
-# include <alloca.h>
-#endif
-
-#if defined (__MINGW32__)
-# define alloca __builtin_alloca
-#endif
+#include <cstring>
 
 #include "serial/serial.h"
 
@@ -27,6 +20,7 @@ using std::string;
 using serial::Serial;
 using serial::SerialException;
 using serial::IOException;
+using serial::Tap;
 using serial::bytesize_t;
 using serial::parity_t;
 using serial::stopbits_t;
@@ -48,6 +42,134 @@ private:
   SerialImpl *pimpl_;
 };
 
+/*
+ * Receive buffer shared by all the read functions of a port.
+ *
+ * Instead of reading one byte per call, the framer pulls everything the
+ * driver has pending in a single read and frames lines in place. The EOL
+ * search runs over the contiguous buffer with memchr (vectorized in libc)
+ * and only compares the full EOL sequence on a candidate hit, so no
+ * temporaries are built. Whatever follows a complete line stays buffered
+ * for the next call.
+ */
+class Serial::LineFramer {
+public:
+  LineFramer () : buffer_(initial_capacity), head_(0), tail_(0) {}
+
+  size_t
+  size () const { return tail_ - head_; }
+
+  const uint8_t *
+  data () const { return buffer_.data () + head_; }
+
+  void
+  consume (size_t count)
+  {
+    head_ += std::min (count, size ());
+    if (head_ == tail_) {
+      head_ = tail_ = 0;
+    }
+  }
+
+  void
+  clear () { head_ = tail_ = 0; }
+
+  // Copies up to count buffered bytes into out and drops them from the buffer
+  size_t
+  take (uint8_t *out, size_t count)
+  {
+    size_t n = std::min (count, size ());
+    if (n > 0) {
+      memcpy (out, data (), n);
+      consume (n);
+    }
+    return n;
+  }
+
+  // Returns the length (EOL included) of the first line that is complete
+  // within the first 'limit' buffered bytes, or 0 if there is none yet.
+  // The scan starts at offset 'from', so bytes that were already searched
+  // are not looked at again.
+  size_t
+  find_eol (const string &eol, size_t from, size_t limit) const
+  {
+    const size_t eol_len = eol.length ();
+    const size_t avail = std::min (size (), limit);
+    if (eol_len == 0) {
+      return (avail > 0) ? 1 : 0;
+    }
+    const uint8_t *begin = data ();
+    const uint8_t *end = begin + avail;
+    const uint8_t *p = begin + std::min (from, avail);
+    const uint8_t first = static_cast<uint8_t> (eol[0]);
+    while (static_cast<size_t> (end - p) >= eol_len) {
+      p = static_cast<const uint8_t*>
+            (memchr (p, first, static_cast<size_t> (end - p) - eol_len + 1));
+      if (p == NULL) {
+        return 0;
+      }
+      if (memcmp (p, eol.data (), eol_len) == 0) {
+        return static_cast<size_t> (p - begin) + eol_len;
+      }
+      ++p;
+    }
+    return 0;
+  }
+
+  // Offset from which find_eol has to resume after a miss on the current
+  // contents (the tail may hold the first bytes of a split EOL).
+  size_t
+  resume_offset (const string &eol) const
+  {
+    return (size () >= eol.length ()) ? size () - eol.length () + 1 : 0;
+  }
+
+  // Pulls at most max_bytes from the port. Everything that is already
+  // pending is read in one call; if nothing is pending, blocks (within the
+  // port read timeout) for the first byte. Returns 0 on timeout.
+  size_t
+  fill (SerialImpl *pimpl, size_t max_bytes)
+  {
+    if (max_bytes == 0) {
+      return 0;
+    }
+    size_t room = reserve (max_bytes);
+    size_t pending = pimpl->available ();
+    size_t want = std::min (std::max (pending, static_cast<size_t> (1)), room);
+    size_t bytes_read = pimpl->read (buffer_.data () + tail_, want);
+    tail_ += bytes_read;
+    return bytes_read;
+  }
+
+private:
+  static const size_t initial_capacity = 4096;
+
+  // Makes room for count more bytes at the tail, compacting the pending
+  // bytes to the front before growing. Returns the room available.
+  size_t
+  reserve (size_t count)
+  {
+    if (buffer_.size () - tail_ >= count) {
+      return count;
+    }
+    if (head_ > 0) {
+      memmove (buffer_.data (), buffer_.data () + head_, size ());
+      tail_ -= head_;
+      head_ = 0;
+    }
+    if (buffer_.size () - tail_ < count) {
+      buffer_.resize (tail_ + count);
+    }
+    return count;
+  }
+
+  vector<uint8_t> buffer_;
+  size_t head_;
+  size_t tail_;
+};
+
+const size_t Serial::LineFramer::initial_capacity;
+
 class Serial::ScopedWriteLock {
 public:
   ScopedWriteLock(SerialImpl *pimpl) : pimpl_(pimpl) {
@@ -67,7 +189,8 @@ Serial::Serial (const string &port, uint32_t baudrate, serial::Timeout timeout,
                 bytesize_t bytesize, parity_t parity, stopbits_t stopbits,
                 flowcontrol_t flowcontrol)
  : pimpl_(new SerialImpl (port, baudrate, bytesize, parity,
-                                           stopbits, flowcontrol))
+                                           stopbits, flowcontrol)),
+   framer_(new LineFramer ())
 {
   pimpl_->setTimeout(timeout);
 }
@@ -75,18 +198,21 @@ Serial::Serial (const string &port, uint32_t baudrate, serial::Timeout timeout,
 Serial::~Serial ()
 {
   delete pimpl_;
+  delete framer_;
 }
 
 void
 Serial::open ()
 {
   pimpl_->open ();
+  framer_->clear ();
 }
 
 void
 Serial::close ()
 {
   pimpl_->close ();
+  framer_->clear ();
 }
 
 bool
@@ -98,12 +224,15 @@ Serial::isOpen () const
 size_t
 Serial::available ()
 {
-  return pimpl_->available ();
+  return framer_->size () + pimpl_->available ();
 }
 
 bool
 Serial::waitReadable ()
 {
+  if (framer_->size () > 0) {
+    return true;
+  }
   serial::Timeout timeout(pimpl_->getTimeout ());
   return pimpl_->waitReadable(timeout.read_timeout_constant);
 }
@@ -117,14 +246,20 @@ Serial::waitByteTimes (size_t count)
 size_t
 Serial::read_ (uint8_t *buffer, size_t size)
 {
-  return this->pimpl_->read (buffer, size);
+  // serve whatever the line framer already pulled from the port first
+  size_t bytes_read = framer_->take (buffer, size);
+  if (bytes_read == size) {
+    return bytes_read;
+  }
+  return bytes_read + this->pimpl_->read (buffer + bytes_read,
+                                          size - bytes_read);
 }
 
 size_t
 Serial::read (uint8_t *buffer, size_t size)
 {
   ScopedReadLock lock(this->pimpl_);
-  return this->pimpl_->read (buffer, size);
+  return this->read_ (buffer, size);
 }
 
 size_t
@@ -135,7 +270,7 @@ Serial::read (std::vector<uint8_t> &buffer, size_t size)
   size_t bytes_read = 0;
 
   try {
-    bytes_read = this->pimpl_->read (buffer_, size);
+    bytes_read = this->read_ (buffer_, size);
   }
   catch (const std::exception &e) {
     delete[] buffer_;
@@ -154,7 +289,7 @@ Serial::read (std::string &buffer, size_t size)
   uint8_t *buffer_ = new uint8_t[size];
   size_t bytes_read = 0;
   try {
-    bytes_read = this->pimpl_->read (buffer_, size);
+    bytes_read = this->read_ (buffer_, size);
   }
   catch (const std::exception &e) {
     delete[] buffer_;
@@ -177,27 +312,29 @@ size_t
 Serial::readline (string &buffer, size_t size, string eol)
 {
   ScopedReadLock lock(this->pimpl_);
-  size_t eol_len = eol.length ();
-  uint8_t *buffer_ = static_cast<uint8_t*>
-                              (alloca (size * sizeof (uint8_t)));
-  size_t read_so_far = 0;
+  size_t scanned = 0;
   while (true)
   {
-    size_t bytes_read = this->read_ (buffer_ + read_so_far, 1);
-    read_so_far += bytes_read;
-    if (bytes_read == 0) {
-      break; // Timeout occured on reading 1 byte
+    size_t line_len = framer_->find_eol (eol, scanned, size);
+    if (line_len == 0 && framer_->size () >= size) {
+      line_len = size; // Reached the maximum read length
     }
-    if(read_so_far < eol_len) continue;
-    if (string (reinterpret_cast<const char*>
-         (buffer_ + read_so_far - eol_len), eol_len) == eol) {
-      break; // EOL found
+    if (line_len > 0) {
+      buffer.append (reinterpret_cast<const char*> (framer_->data ()),
+                     line_len);
+      framer_->consume (line_len);
+      return line_len;
     }
-    if (read_so_far == size) {
-      break; // Reached the maximum read length
+    scanned = framer_->resume_offset (eol);
+    if (framer_->fill (pimpl_, size - framer_->size ()) == 0) {
+      break; // Timeout occured waiting for more data
     }
   }
-  buffer.append(reinterpret_cast<const char*> (buffer_), read_so_far);
+  // hand back the partial line that was received before the timeout
+  size_t read_so_far = framer_->size ();
+  buffer.append (reinterpret_cast<const char*> (framer_->data ()),
+                 read_so_far);
+  framer_->consume (read_so_far);
   return read_so_far;
 }
 
@@ -210,42 +347,42 @@ Serial::readline (size_t size, string eol)
 }
 
 vector<string>
-Serial::readlines (size_t size, string eol)
+Serial::readlines (size_t size, string eol, size_t max_lines)
 {
   ScopedReadLock lock(this->pimpl_);
   std::vector<std::string> lines;
-  size_t eol_len = eol.length ();
-  uint8_t *buffer_ = static_cast<uint8_t*>
-    (alloca (size * sizeof (uint8_t)));
   size_t read_so_far = 0;
-  size_t start_of_line = 0;
+  size_t scanned = 0;
   while (read_so_far < size) {
-    size_t bytes_read = this->read_ (buffer_+read_so_far, 1);
-    read_so_far += bytes_read;
-    if (bytes_read == 0) {
-      if (start_of_line != read_so_far) {
-        lines.push_back (
-          string (reinterpret_cast<const char*> (buffer_ + start_of_line),
-            read_so_far - start_of_line));
+    size_t limit = size - read_so_far;
+    size_t line_len = framer_->find_eol (eol, scanned, limit);
+    if (line_len > 0) {
+      // EOL found
+      lines.push_back (
+        string (reinterpret_cast<const char*> (framer_->data ()), line_len));
+      framer_->consume (line_len);
+      read_so_far += line_len;
+      scanned = 0;
+      if (max_lines != 0 && lines.size () == max_lines) {
+        break; // Got all the lines that were expected
       }
-      break; // Timeout occured on reading 1 byte
+      continue;
     }
-    if(read_so_far < eol_len) continue;
-    if (string (reinterpret_cast<const char*>
-         (buffer_ + read_so_far - eol_len), eol_len) == eol) {
-      // EOL found
-      lines.push_back(
-        string(reinterpret_cast<const char*> (buffer_ + start_of_line),
-          read_so_far - start_of_line));
-      start_of_line = read_so_far;
+    if (framer_->size () >= limit) {
+      lines.push_back (
+        string (reinterpret_cast<const char*> (framer_->data ()), limit));
+      framer_->consume (limit);
+      break; // Reached the maximum read length
     }
-    if (read_so_far == size) {
-      if (start_of_line != read_so_far) {
-        lines.push_back(
-          string(reinterpret_cast<const char*> (buffer_ + start_of_line),
-            read_so_far - start_of_line));
+    scanned = framer_->resume_offset (eol);
+    if (framer_->fill (pimpl_, limit - framer_->size ()) == 0) {
+      if (framer_->size () > 0) {
+        lines.push_back (
+          string (reinterpret_cast<const char*> (framer_->data ()),
+                  framer_->size ()));
+        framer_->consume (framer_->size ());
       }
-      break; // Reached the maximum read length
+      break; // Timeout occured waiting for more data
     }
   }
   return lines;
@@ -296,6 +433,26 @@ Serial::getPort () const
   return pimpl_->getPort ();
 }
 
+#if !defined(_WIN32)
+int
+Serial::getFd () const
+{
+  return pimpl_->getFd ();
+}
+
+void
+Serial::setTap (std::shared_ptr<Tap> tap)
+{
+  pimpl_->setTap (tap);
+}
+
+std::shared_ptr<Tap>
+Serial::getTap () const
+{
+  return pimpl_->getTap ();
+}
+#endif
+
 void
 Serial::setTimeout (serial::Timeout &timeout)
 {
@@ -377,6 +534,7 @@ void Serial::flush ()
 void Serial::flushInput ()
 {
   ScopedReadLock lock(this->pimpl_);
+  framer_->clear ();
   pimpl_->flushInput ();
 }
 
@@ -8,6 +8,7 @@
 #include <utilities.hh>
 #include <iostream>
 #include <serial/serial.h>
+#include <PortIndex.hh>
 #include <sstream>
 #include <set>
 
@@ -87,7 +88,7 @@ std::string escape(const char* src, const std::set<char> escapee, const char mar
 
 void enumerate_ports()
 {
-  vector<serial::PortInfo> devices_found = serial::list_ports();
+  vector<serial::PortInfo> devices_found = PortIndex::instance().ports();
   cout << "enumerate_ports : Number of devices found : " << devices_found.size() << endl;
   vector<serial::PortInfo>::iterator iter = devices_found.begin();
 
@@ -103,66 +104,22 @@ void enumerate_ports()
 std::string find_port(std::string param)
 {
 
-  // loop over all available ports and search if any of the fields matches the string
-  // that was passed
-  // if more than one port is found to match, return the best match
-  vector<serial::PortInfo> devices_found = serial::list_ports();
-#ifdef DEBUG
-  cout << "find_port : Number of devices found : " << devices_found.size() << endl;
-#endif
-  vector<serial::PortInfo>::iterator iter = devices_found.begin();
-
-  vector<serial::PortInfo> devices_match;
-  while( iter != devices_found.end() )
-  {
-    serial::PortInfo device = *iter++;
-    if (device.description.find(param) != device.description.npos)
-    {
-      devices_match.push_back(device);
-    }
-    else if (device.port.find(param) != device.port.npos)
-    {
-      devices_match.push_back(device);
-    }
-    else if (device.hardware_id.find(param) != device.hardware_id.npos)
-    {
-      devices_match.push_back(device);
-    }
-  }
-
-  // if we found more than one, just return the first found.
-  // if we found none, return empty string
-  if (devices_match.size() == 0)
+  // look the string up in the port index: serial number, port, description or
+  // hardware id, or else any port with a field that contains it.
+  // if more than one port matches, the first one listed is returned
+  serial::PortInfo device;
+  if (!PortIndex::instance().find(param,device))
   {
 #ifdef DEBUG
     cout << "find_port : Couldn't find any devices matching description" << endl;
 #endif
     return "";//throw std::runtime_error("Couldn't find any devices matching description");
   }
-  else if (devices_match.size() == 1)
-  {
 #ifdef DEBUG
-    cout << "find_port : Found device [" << devices_match.at(0).port << " , "
-        << devices_match.at(0).description << " , " << devices_match.at(0).hardware_id << "]" << endl;
+  cout << "find_port : Found device [" << device.port << " , "
+      << device.description << " , " << device.hardware_id << "]" << endl;
 #endif
-    return devices_match.at(0).port;
-  }
-  else // found multiple entries
-  {
-#ifdef DEBUG
-    cout << "find_port : Found multiple matching devices: "<< endl;
-    vector<serial::PortInfo>::iterator iter = devices_match.begin();
-    vector<serial::PortInfo> devices_match;
-    while( iter != devices_match.end() )
-    {
-    cout << " --> [" << devices_match.at(0).port << " , "
-        << devices_match.at(0).description << " , " << devices_match.at(0).hardware_id << "]" << endl;
-    }
-    cout << "find_port : Returning first entry " << endl;
-#endif
-    return devices_match.at(0).port;
-  }
-  return "";
+  return device.port;
 }
 
 template <typename T>